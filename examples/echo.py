@@ -35,6 +35,7 @@ SERVER = [
 ]
 
 DATA = 'echo.data'
+BOOTSTRAP_SCORES = 'echo.bootstrap'
 
 # echo.py features
 # - accept friend request
@@ -105,9 +106,7 @@ class ToxOptions():
 
 
 def save_to_file(tox, fname):
-    data = tox.get_savedata()
-    with open(fname, 'wb') as f:
-        f.write(data)
+    tox.save_to_path(fname)
 
 
 def load_from_file(fname):
@@ -129,7 +128,8 @@ class EchoBot(Tox):
 
     def connect(self):
         print('connecting...')
-        self.bootstrap(SERVER[0], SERVER[1], SERVER[2])
+        # re-bootstraps by itself when the connection drops
+        self.bootstrap_start([SERVER], path=BOOTSTRAP_SCORES)
 
     def loop(self):
         checked = False
@@ -145,7 +145,6 @@ class EchoBot(Tox):
 
                 if checked and not status:
                     print('Disconnected from DHT.')
-                    self.connect()
                     checked = False
 
                 self.av.witerate()
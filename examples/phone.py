@@ -215,9 +215,7 @@ class ToxOptions():
 
 
 def save_to_file(tox, fname):
-    data = tox.get_savedata()
-    with open(fname, 'wb') as f:
-        f.write(data)
+    tox.save_to_path(fname)
 
 
 def load_from_file(fname):
@@ -0,0 +1,728 @@
+/**
+ * @file   audio.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Passband edge as a fraction of the lower Nyquist frequency, and the
+ * Kaiser window shape: about 80 dB of stopband attenuation. */
+#define AUDIO_CUTOFF 0.9
+#define AUDIO_KAISER_BETA 8.0
+
+int audio_rate_is_opus(uint32_t rate)
+{
+  return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 ||
+    rate == 48000;
+}
+
+/* Polyphase windowed sinc resampler. Input is kept planar as float so
+ * that every output sample is one dot product per channel; positions are
+ * exact fractions of the input rate, so a stream never drifts. */
+struct audio_resampler {
+  uint32_t up;                  /* out_rate / gcd */
+  uint32_t down;                /* in_rate / gcd */
+  int channels;
+  int taps;
+  int interpolate;              /* filter rows are AUDIO_RESAMPLER_PHASES + 1
+                                   phases rather than one per 1 / up */
+  float* filter;
+  float* history[AUDIO_MAX_CHANNELS];
+  size_t capacity;              /* frames of history allocated */
+  size_t count;                 /* frames of history buffered */
+  size_t pos;                   /* first input frame of the next output */
+  uint32_t phase;               /* its offset, in 1 / up input frames */
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+  while (b != 0) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static double bessel_i0(double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  int k;
+
+  for (k = 1; k < 64 && term > sum * 1e-12; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+
+  return sum;
+}
+
+/* Taps of a lowpass at *cutoff* cycles per input frame for an output
+ * falling *offset* input frames past the middle of the taps, normalized
+ * to unity gain so that silence and DC come out unchanged. */
+static void design_phase(float* row, int taps, double offset, double cutoff)
+{
+  double half = taps / 2.0;
+  double sum = 0.0;
+  int k;
+
+  for (k = 0; k < taps; k++) {
+    double x = (k - taps / 2 + 1) - offset;
+    double r = x / half;
+    double h = x == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+    double w = r * r < 1.0 ?
+      bessel_i0(AUDIO_KAISER_BETA * sqrt(1.0 - r * r)) /
+      bessel_i0(AUDIO_KAISER_BETA) : 0.0;
+
+    row[k] = (float)(h * w);
+    sum += row[k];
+  }
+
+  for (k = 0; k < taps; k++) {
+    row[k] = (float)(row[k] / sum);
+  }
+}
+
+static int reserve_history(audio_resampler* resampler, size_t frames)
+{
+  int c;
+
+  if (frames <= resampler->capacity) {
+    return 0;
+  }
+
+  size_t capacity = resampler->capacity * 2;
+  if (capacity < frames) {
+    capacity = frames;
+  }
+
+  for (c = 0; c < resampler->channels; c++) {
+    float* history = (float*)realloc(resampler->history[c],
+        capacity * sizeof(float));
+    if (history == NULL) {
+      return -1;
+    }
+    resampler->history[c] = history;
+  }
+  resampler->capacity = capacity;
+
+  return 0;
+}
+
+audio_resampler* audio_resampler_new(uint32_t in_rate, uint32_t out_rate,
+    int channels)
+{
+  audio_resampler* resampler =
+    (audio_resampler*)calloc(1, sizeof(audio_resampler));
+  if (resampler == NULL) {
+    return NULL;
+  }
+
+  uint32_t divisor = gcd(in_rate, out_rate);
+  resampler->up = out_rate / divisor;
+  resampler->down = in_rate / divisor;
+  resampler->channels = channels;
+
+  /* downsampling lowers the cutoff, so the taps span as much time at the
+   * output rate as they would upsampling */
+  double ratio = out_rate < in_rate ? (double)out_rate / in_rate : 1.0;
+  int taps = (int)ceil(AUDIO_RESAMPLER_TAPS / ratio);
+  resampler->taps = taps + (taps & 1);
+
+  int phases = resampler->up;
+  if (resampler->up > AUDIO_RESAMPLER_PHASES) {
+    resampler->interpolate = 1;
+    phases = AUDIO_RESAMPLER_PHASES + 1;
+  }
+
+  resampler->filter = (float*)malloc((size_t)phases * resampler->taps *
+      sizeof(float));
+  if (resampler->filter == NULL ||
+      reserve_history(resampler, resampler->taps * 2) == -1) {
+    audio_resampler_free(resampler);
+    return NULL;
+  }
+
+  int p;
+  double step = resampler->interpolate ? AUDIO_RESAMPLER_PHASES :
+    resampler->up;
+  for (p = 0; p < phases; p++) {
+    design_phase(resampler->filter + (size_t)p * resampler->taps,
+        resampler->taps, p / step, ratio * AUDIO_CUTOFF / 2.0);
+  }
+
+  audio_resampler_reset(resampler);
+
+  return resampler;
+}
+
+void audio_resampler_free(audio_resampler* resampler)
+{
+  int c;
+
+  if (resampler == NULL) {
+    return;
+  }
+
+  for (c = 0; c < resampler->channels; c++) {
+    free(resampler->history[c]);
+  }
+  free(resampler->filter);
+  free(resampler);
+}
+
+void audio_resampler_reset(audio_resampler* resampler)
+{
+  int c;
+
+  /* leading silence puts the first output on the first input frame */
+  resampler->count = resampler->taps / 2 - 1;
+  resampler->pos = 0;
+  resampler->phase = 0;
+  for (c = 0; c < resampler->channels; c++) {
+    memset(resampler->history[c], 0, resampler->count * sizeof(float));
+  }
+}
+
+size_t audio_resampler_max_output(const audio_resampler* resampler,
+    size_t frames)
+{
+  return (resampler->count + frames) * resampler->up / resampler->down + 1;
+}
+
+static float dot(const float* a, const float* b, int n)
+{
+  float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+  int i;
+
+  /* independent sums, which the compiler can keep in vector lanes; n is
+   * always even */
+  for (i = 0; i + 4 <= n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < n; i++) {
+    s0 += a[i] * b[i];
+  }
+
+  return (s0 + s1) + (s2 + s3);
+}
+
+static int16_t saturate(float v)
+{
+  v += v < 0.0f ? -0.5f : 0.5f;
+  if (v >= 32767.0f) {
+    return 32767;
+  }
+  if (v <= -32768.0f) {
+    return -32768;
+  }
+  return (int16_t)v;
+}
+
+long audio_resample(audio_resampler* resampler, const int16_t* in,
+    size_t frames, int16_t* out)
+{
+  int channels = resampler->channels;
+  int taps = resampler->taps;
+  size_t i, n = 0;
+  int c;
+
+  if (reserve_history(resampler, resampler->count + frames) == -1) {
+    return -1;
+  }
+
+  for (c = 0; c < channels; c++) {
+    float* history = resampler->history[c] + resampler->count;
+    for (i = 0; i < frames; i++) {
+      history[i] = in[i * channels + c];
+    }
+  }
+  resampler->count += frames;
+
+  while (resampler->pos + taps <= resampler->count) {
+    size_t pos = resampler->pos;
+
+    if (!resampler->interpolate) {
+      const float* row = resampler->filter +
+        (size_t)resampler->phase * taps;
+      for (c = 0; c < channels; c++) {
+        out[n * channels + c] = saturate(dot(row,
+              resampler->history[c] + pos, taps));
+      }
+    } else {
+      uint64_t scaled = (uint64_t)resampler->phase * AUDIO_RESAMPLER_PHASES;
+      const float* row = resampler->filter +
+        (size_t)(scaled / resampler->up) * taps;
+      float frac = (float)(scaled % resampler->up) / resampler->up;
+      for (c = 0; c < channels; c++) {
+        float a = dot(row, resampler->history[c] + pos, taps);
+        float b = dot(row + taps, resampler->history[c] + pos, taps);
+        out[n * channels + c] = saturate(a + (b - a) * frac);
+      }
+    }
+    n++;
+
+    resampler->phase += resampler->down;
+    resampler->pos += resampler->phase / resampler->up;
+    resampler->phase %= resampler->up;
+  }
+
+  /* keep only the frames later outputs still need */
+  if (resampler->pos > 0) {
+    size_t keep = resampler->count - resampler->pos;
+    for (c = 0; c < channels; c++) {
+      memmove(resampler->history[c], resampler->history[c] + resampler->pos,
+          keep * sizeof(float));
+    }
+    resampler->count = keep;
+    resampler->pos = 0;
+  }
+
+  return (long)n;
+}
+
+void audio_remix(const int16_t* in, size_t frames, int in_channels,
+    int16_t* out, int out_channels)
+{
+  size_t i;
+
+  if (in_channels == out_channels) {
+    memmove(out, in, frames * in_channels * sizeof(int16_t));
+  } else if (in_channels == 1) {
+    for (i = frames; i-- > 0;) {
+      out[i * 2] = out[i * 2 + 1] = in[i];
+    }
+  } else {
+    for (i = 0; i < frames; i++) {
+      out[i] = (int16_t)((in[i * 2] + in[i * 2 + 1]) / 2);
+    }
+  }
+}
+
+void audio_converter_init(audio_converter* converter)
+{
+  memset(converter, 0, sizeof(audio_converter));
+}
+
+void audio_converter_free(audio_converter* converter)
+{
+  audio_resampler_free(converter->resampler);
+  free(converter->buffers[0]);
+  free(converter->buffers[1]);
+  audio_converter_init(converter);
+}
+
+int audio_converter_set(audio_converter* converter, uint32_t in_rate,
+    int in_channels, uint32_t out_rate, int out_channels)
+{
+  if (converter->in_rate == in_rate && converter->out_rate == out_rate &&
+      converter->in_channels == in_channels &&
+      converter->out_channels == out_channels) {
+    return 0;
+  }
+
+  audio_resampler_free(converter->resampler);
+  converter->resampler = NULL;
+  converter->in_rate = 0;
+
+  if (in_rate != out_rate) {
+    /* resample whichever side has fewer channels */
+    int channels = in_channels < out_channels ? in_channels : out_channels;
+    converter->resampler = audio_resampler_new(in_rate, out_rate, channels);
+    if (converter->resampler == NULL) {
+      return -1;
+    }
+  }
+
+  converter->in_rate = in_rate;
+  converter->out_rate = out_rate;
+  converter->in_channels = in_channels;
+  converter->out_channels = out_channels;
+
+  return 0;
+}
+
+void audio_converter_reset(audio_converter* converter)
+{
+  if (converter->resampler != NULL) {
+    audio_resampler_reset(converter->resampler);
+  }
+}
+
+static int reserve_buffer(audio_converter* converter, int i, size_t samples)
+{
+  if (samples <= converter->buffer_sizes[i]) {
+    return 0;
+  }
+
+  free(converter->buffers[i]);
+  converter->buffer_sizes[i] = 0;
+  converter->buffers[i] = (int16_t*)malloc(samples * sizeof(int16_t));
+  if (converter->buffers[i] == NULL) {
+    return -1;
+  }
+  converter->buffer_sizes[i] = samples;
+
+  return 0;
+}
+
+long audio_convert(audio_converter* converter, const int16_t* in,
+    size_t frames, const int16_t** out)
+{
+  const int16_t* pcm = in;
+  int channels = converter->in_channels;
+  long count = (long)frames;
+
+  if (converter->out_channels < channels) {
+    if (reserve_buffer(converter, 0, frames * converter->out_channels) == -1) {
+      return -1;
+    }
+    audio_remix(pcm, frames, channels, converter->buffers[0],
+        converter->out_channels);
+    pcm = converter->buffers[0];
+    channels = converter->out_channels;
+  }
+
+  if (converter->resampler != NULL) {
+    size_t size = audio_resampler_max_output(converter->resampler, count);
+    if (reserve_buffer(converter, 1, size * channels) == -1) {
+      return -1;
+    }
+    count = audio_resample(converter->resampler, pcm, count,
+        converter->buffers[1]);
+    if (count == -1) {
+      return -1;
+    }
+    pcm = converter->buffers[1];
+  }
+
+  if (converter->out_channels > channels) {
+    if (reserve_buffer(converter, 0, count * converter->out_channels) == -1) {
+      return -1;
+    }
+    audio_remix(pcm, count, channels, converter->buffers[0],
+        converter->out_channels);
+    pcm = converter->buffers[0];
+  }
+
+  *out = pcm;
+
+  return count;
+}
+
+void audio_fifo_init(audio_fifo* fifo, int channels)
+{
+  memset(fifo, 0, sizeof(audio_fifo));
+  fifo->channels = channels;
+}
+
+void audio_fifo_free(audio_fifo* fifo)
+{
+  free(fifo->samples);
+  audio_fifo_init(fifo, fifo->channels);
+}
+
+void audio_fifo_reset(audio_fifo* fifo, int channels)
+{
+  /* the allocation is kept only while it holds whole frames */
+  if (channels != fifo->channels) {
+    audio_fifo_free(fifo);
+  }
+  fifo->frames = 0;
+  fifo->channels = channels;
+}
+
+int audio_fifo_write(audio_fifo* fifo, const int16_t* pcm, size_t frames)
+{
+  size_t needed = fifo->frames + frames;
+
+  if (needed > fifo->size) {
+    size_t size = fifo->size * 2;
+    if (size < needed) {
+      size = needed;
+    }
+
+    int16_t* samples = (int16_t*)realloc(fifo->samples,
+        size * fifo->channels * sizeof(int16_t));
+    if (samples == NULL) {
+      return -1;
+    }
+    fifo->samples = samples;
+    fifo->size = size;
+  }
+
+  int16_t* end = fifo->samples + fifo->frames * fifo->channels;
+  if (pcm != NULL) {
+    memcpy(end, pcm, frames * fifo->channels * sizeof(int16_t));
+  } else {
+    memset(end, 0, frames * fifo->channels * sizeof(int16_t));
+  }
+  fifo->frames = needed;
+
+  return 0;
+}
+
+void audio_fifo_consume(audio_fifo* fifo, size_t frames)
+{
+  if (frames >= fifo->frames) {
+    fifo->frames = 0;
+    return;
+  }
+
+  fifo->frames -= frames;
+  memmove(fifo->samples, fifo->samples + frames * fifo->channels,
+      fifo->frames * fifo->channels * sizeof(int16_t));
+}
+
+void audio_jitter_init(audio_jitter* jitter)
+{
+  memset(jitter, 0, sizeof(audio_jitter));
+  audio_fifo_init(&jitter->fifo, 1);
+}
+
+void audio_jitter_free(audio_jitter* jitter)
+{
+  audio_fifo_free(&jitter->fifo);
+  free(jitter->last);
+  jitter->last = NULL;
+}
+
+int audio_jitter_configure(audio_jitter* jitter, int channels, size_t target,
+    size_t max, size_t period)
+{
+  if (jitter->fifo.channels == channels && jitter->target == target &&
+      jitter->max == max && jitter->period == period && jitter->last != NULL) {
+    return 0;
+  }
+
+  int16_t* last = (int16_t*)realloc(jitter->last,
+      period * channels * sizeof(int16_t));
+  if (last == NULL) {
+    return -1;
+  }
+
+  jitter->last = last;
+  jitter->target = target;
+  jitter->max = max;
+  jitter->period = period;
+  audio_fifo_reset(&jitter->fifo, channels);
+  audio_jitter_reset(jitter);
+
+  return 0;
+}
+
+void audio_jitter_reset(audio_jitter* jitter)
+{
+  jitter->fifo.frames = 0;
+  jitter->last_frames = 0;
+  jitter->conceal_pos = 0;
+  jitter->playing = 0;
+  jitter->started = 0;
+  jitter->fade_in = 0;
+}
+
+int audio_jitter_write(audio_jitter* jitter, const int16_t* pcm,
+    size_t frames)
+{
+  if (audio_fifo_write(&jitter->fifo, pcm, frames) == -1) {
+    return -1;
+  }
+  jitter->received += frames;
+
+  if (jitter->fifo.frames > jitter->max) {
+    size_t drop = jitter->fifo.frames - jitter->target;
+    audio_fifo_consume(&jitter->fifo, drop);
+    jitter->dropped += drop;
+  }
+
+  return 0;
+}
+
+/* Repeat the last period played, fading out over two periods. */
+static void conceal(audio_jitter* jitter, int16_t* out, size_t frames)
+{
+  int channels = jitter->fifo.channels;
+  size_t fade = jitter->period * 2;
+  size_t i;
+  int c;
+
+  for (i = 0; i < frames; i++, jitter->conceal_pos++) {
+    size_t pos = jitter->conceal_pos;
+    if (jitter->last_frames == 0 || pos >= fade) {
+      memset(out + i * channels, 0, (frames - i) * channels * sizeof(int16_t));
+      jitter->conceal_pos += frames - i;
+      break;
+    }
+
+    const int16_t* from = jitter->last + (pos % jitter->last_frames) * channels;
+    int32_t gain = (int32_t)((fade - pos) * 32768 / fade);
+    for (c = 0; c < channels; c++) {
+      out[i * channels + c] = (int16_t)((from[c] * gain) >> 15);
+    }
+  }
+
+  if (jitter->started) {
+    jitter->concealed += frames;
+  }
+}
+
+/* Keep the tail of what was just played to conceal from. */
+static void remember(audio_jitter* jitter, const int16_t* played,
+    size_t frames)
+{
+  int channels = jitter->fifo.channels;
+
+  if (frames >= jitter->period) {
+    memcpy(jitter->last, played + (frames - jitter->period) * channels,
+        jitter->period * channels * sizeof(int16_t));
+    jitter->last_frames = jitter->period;
+    return;
+  }
+
+  size_t keep = jitter->last_frames + frames > jitter->period ?
+    jitter->period - frames : jitter->last_frames;
+  memmove(jitter->last, jitter->last + (jitter->last_frames - keep) * channels,
+      keep * channels * sizeof(int16_t));
+  memcpy(jitter->last + keep * channels, played,
+      frames * channels * sizeof(int16_t));
+  jitter->last_frames = keep + frames;
+}
+
+void audio_jitter_read(audio_jitter* jitter, int16_t* out, size_t frames)
+{
+  int channels = jitter->fifo.channels;
+  size_t i;
+  int c;
+
+  if (!jitter->playing && jitter->fifo.frames >= jitter->target &&
+      jitter->fifo.frames > 0) {
+    jitter->playing = 1;
+  }
+
+  if (!jitter->playing) {
+    conceal(jitter, out, frames);
+    return;
+  }
+
+  size_t n = frames < jitter->fifo.frames ? frames : jitter->fifo.frames;
+  memcpy(out, jitter->fifo.samples, n * channels * sizeof(int16_t));
+  audio_fifo_consume(&jitter->fifo, n);
+
+  /* audio resuming after a gap ramps up over a quarter period */
+  if (jitter->fade_in) {
+    size_t ramp = jitter->period / 4 ? jitter->period / 4 : 1;
+    for (i = 0; i < n && i < ramp; i++) {
+      for (c = 0; c < channels; c++) {
+        out[i * channels + c] = (int16_t)(out[i * channels + c] * (int32_t)i /
+            (int32_t)ramp);
+      }
+    }
+    jitter->fade_in = 0;
+  }
+
+  remember(jitter, out, n);
+  jitter->played += n;
+  jitter->started = 1;
+  jitter->conceal_pos = 0;
+
+  if (n < frames) {
+    jitter->underruns++;
+    jitter->playing = 0;
+    jitter->fade_in = 1;
+    conceal(jitter, out + n * channels, frames - n);
+  }
+}
+
+void audio_measure(const int16_t* pcm, size_t samples, audio_level* level)
+{
+  uint64_t sum = 0;
+  int peak = 0;
+  size_t i;
+
+  for (i = 0; i < samples; i++) {
+    int32_t x = pcm[i];
+    int magnitude = x < 0 ? -x : x;
+    sum += (uint64_t)(x * x);
+    peak = magnitude > peak ? magnitude : peak;
+  }
+
+  level->rms = samples ? (int)(sqrt((double)sum / samples) + 0.5) : 0;
+  level->peak = peak;
+}
+
+void audio_gate_init(audio_gate* gate)
+{
+  memset(gate, 0, sizeof(audio_gate));
+}
+
+void audio_gate_configure(audio_gate* gate, int threshold,
+    uint32_t hangover_ms)
+{
+  if (threshold != gate->threshold || hangover_ms != gate->hangover_ms) {
+    gate->threshold = threshold;
+    gate->hangover_ms = hangover_ms;
+    audio_gate_reset(gate);
+  }
+}
+
+void audio_gate_reset(audio_gate* gate)
+{
+  gate->level.rms = 0;
+  gate->level.peak = 0;
+  gate->quiet = 0;
+  gate->open = 0;
+}
+
+int audio_gate_process(audio_gate* gate, const int16_t* pcm, size_t frames,
+    int channels, uint32_t rate)
+{
+  audio_measure(pcm, frames * channels, &gate->level);
+
+  if (gate->threshold == 0 || gate->level.rms >= gate->threshold) {
+    gate->quiet = 0;
+    gate->open = 1;
+  } else if (gate->open) {
+    /* the frame that runs past the hangover is the first held back */
+    gate->quiet += frames;
+    if (gate->quiet * 1000 > (uint64_t)gate->hangover_ms * rate) {
+      gate->open = 0;
+    }
+  }
+
+  if (gate->open) {
+    gate->passed += frames;
+  } else {
+    gate->suppressed += frames;
+  }
+
+  return gate->open;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file   audio.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_AUDIO_H
+#define PYTOX_AUDIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sample rate and channel conversion of interleaved 16 bit PCM, with the
+ * state of each stream kept between frames so that frame boundaries are
+ * seamless. Nothing here touches Python. */
+
+#define AUDIO_MIN_RATE 8000
+#define AUDIO_MAX_RATE 96000
+#define AUDIO_MAX_CHANNELS 2
+
+/* Windowed sinc taps per output sample, more when downsampling so that the
+ * cutoff follows the output rate. */
+#define AUDIO_RESAMPLER_TAPS 32
+
+/* Rate ratios needing more filter phases than this interpolate between
+ * phases instead of keeping one per output position. */
+#define AUDIO_RESAMPLER_PHASES 256
+
+/* Whether Opus encodes *rate* natively, and so toxav can send it. */
+int audio_rate_is_opus(uint32_t rate);
+
+typedef struct audio_resampler audio_resampler;
+
+/* Resampler of *channels* interleaved channels between rates in
+ * AUDIO_MIN_RATE to AUDIO_MAX_RATE. Returns NULL if out of memory. */
+audio_resampler* audio_resampler_new(uint32_t in_rate, uint32_t out_rate,
+    int channels);
+
+void audio_resampler_free(audio_resampler* resampler);
+
+/* Forget buffered input, as at the start of a new stream. */
+void audio_resampler_reset(audio_resampler* resampler);
+
+/* Most frames audio_resample() can return for *frames* input frames. */
+size_t audio_resampler_max_output(const audio_resampler* resampler,
+    size_t frames);
+
+/* Resample *frames* input frames into *out*, returning the number of frames
+ * written. Output lags input by AUDIO_RESAMPLER_TAPS / 2 input frames at
+ * most, and over a stream comes out at exactly out_rate / in_rate frames
+ * per input frame. Returns -1 if out of memory. */
+long audio_resample(audio_resampler* resampler, const int16_t* in,
+    size_t frames, int16_t* out);
+
+/* Convert *frames* frames between mono and stereo: mono is duplicated,
+ * stereo averaged. *in* and *out* may be the same when downmixing. */
+void audio_remix(const int16_t* in, size_t frames, int in_channels,
+    int16_t* out, int out_channels);
+
+/* A stream converted to a fixed output format, whatever the input. */
+typedef struct {
+  uint32_t in_rate;
+  uint32_t out_rate;
+  int in_channels;
+  int out_channels;
+  audio_resampler* resampler;   /* NULL while the rates match */
+  int16_t* buffers[2];          /* resampled and remixed frames */
+  size_t buffer_sizes[2];       /* in samples */
+} audio_converter;
+
+void audio_converter_init(audio_converter* converter);
+
+void audio_converter_free(audio_converter* converter);
+
+/* Convert to out_rate and out_channels from here on. Resampler state is
+ * kept if the formats are unchanged. Returns -1 if out of memory. */
+int audio_converter_set(audio_converter* converter, uint32_t in_rate,
+    int in_channels, uint32_t out_rate, int out_channels);
+
+void audio_converter_reset(audio_converter* converter);
+
+/* Convert *frames* frames set by audio_converter_set(), pointing *out* at
+ * the result, which is *in* itself if nothing needs converting or a buffer
+ * of the converter valid until its next call. Returns the number of output
+ * frames, or -1 if out of memory. */
+long audio_convert(audio_converter* converter, const int16_t* in,
+    size_t frames, const int16_t** out);
+
+/* Interleaved frames queued until a whole codec frame is available. */
+typedef struct {
+  int16_t* samples;
+  size_t frames;
+  size_t size;                  /* frames allocated */
+  int channels;
+} audio_fifo;
+
+void audio_fifo_init(audio_fifo* fifo, int channels);
+
+void audio_fifo_free(audio_fifo* fifo);
+
+/* Drop queued frames and switch to *channels* channels. */
+void audio_fifo_reset(audio_fifo* fifo, int channels);
+
+/* Append *frames* frames, or silence if *pcm* is NULL. Returns -1 if out of
+ * memory. */
+int audio_fifo_write(audio_fifo* fifo, const int16_t* pcm, size_t frames);
+
+/* Drop the oldest *frames* frames. */
+void audio_fifo_consume(audio_fifo* fifo, size_t frames);
+
+/* Playout buffer of one received stream, read at the pace of the consumer
+ * rather than of the network. Reading starts once *target* frames are
+ * buffered and, when the buffer runs dry, gaps are concealed by repeating
+ * the last *period* frames played while fading them out, after which the
+ * buffer refills to *target* before playing again. Writes beyond *max*
+ * frames drop the oldest audio down to *target*, bounding latency. */
+typedef struct {
+  audio_fifo fifo;
+  size_t target;
+  size_t max;
+  size_t period;
+  int16_t* last;                /* the last period frames played */
+  size_t last_frames;
+  size_t conceal_pos;           /* frames concealed since the last played */
+  int playing;
+  int started;                  /* played since the last reset */
+  int fade_in;                  /* ramp up the next frames played */
+  uint64_t received;            /* frames, as all the counters */
+  uint64_t played;
+  uint64_t concealed;
+  uint64_t dropped;
+  uint64_t underruns;           /* times the buffer ran dry */
+} audio_jitter;
+
+void audio_jitter_init(audio_jitter* jitter);
+
+void audio_jitter_free(audio_jitter* jitter);
+
+/* Set the layout and sizes in frames, dropping buffered audio if they
+ * change. Returns -1 if out of memory. */
+int audio_jitter_configure(audio_jitter* jitter, int channels, size_t target,
+    size_t max, size_t period);
+
+/* Drop buffered audio, keeping the counters. */
+void audio_jitter_reset(audio_jitter* jitter);
+
+/* Buffer *frames* received frames. Returns -1 if out of memory. */
+int audio_jitter_write(audio_jitter* jitter, const int16_t* pcm,
+    size_t frames);
+
+/* Fill *out* with exactly *frames* frames, buffered or concealed. */
+void audio_jitter_read(audio_jitter* jitter, int16_t* out, size_t frames);
+
+/* Level of a frame, in 16 bit sample units. */
+typedef struct {
+  int rms;
+  int peak;
+} audio_level;
+
+/* Measure *samples* samples of any layout into *level*. */
+void audio_measure(const int16_t* pcm, size_t samples, audio_level* level);
+
+/* Meter of a sent stream, and a gate holding back frames whose RMS is
+ * below *threshold* once *hangover_ms* have passed since the last one
+ * above it, so that silence is neither encoded nor sent. */
+typedef struct {
+  audio_level level;            /* of the last frame */
+  int threshold;                /* 0 to pass every frame */
+  uint32_t hangover_ms;
+  uint64_t quiet;               /* frames below threshold since the last above */
+  int open;
+  uint64_t passed;              /* frames, as suppressed */
+  uint64_t suppressed;
+} audio_gate;
+
+void audio_gate_init(audio_gate* gate);
+
+void audio_gate_configure(audio_gate* gate, int threshold,
+    uint32_t hangover_ms);
+
+/* Close the gate, keeping the counters. */
+void audio_gate_reset(audio_gate* gate);
+
+/* Measure a frame of *frames* frames at *rate*, returning 1 if it passes
+ * the gate and 0 if it is held back. */
+int audio_gate_process(audio_gate* gate, const int16_t* pcm, size_t frames,
+    int channels, uint32_t rate);
+
+#endif /* PYTOX_AUDIO_H */
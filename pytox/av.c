@@ -20,10 +20,12 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <math.h>
 #include <Python.h>
 #include <tox/toxav.h>
 
 #include "av.h"
+#include "convert.h"
 #include "core.h"
 #include "util.h"
 
@@ -34,26 +36,184 @@
 #endif
 
 
+/* Callbacks run on the thread of toxav_iterate() or tox_iterate(), with
+ * the GIL taken for them. */
 static void
 ToxAVCore_callback_call(ToxAV *toxAV, uint32_t friend_number, bool audio_enabled,
                         bool video_enabled, void *self)
 {
-    PyObject_CallMethod((PyObject*)self, "on_call", "iii",
-                        friend_number, audio_enabled, video_enabled);
+    PyGILState_STATE gstate = PyGILState_Ensure();
+
+    PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_call", "iii",
+                                        friend_number, audio_enabled, video_enabled);
+    Py_XDECREF(ret);
+
+    if (PyErr_Occurred()) {
+        PyErr_Print();
+    }
+
+    PyGILState_Release(gstate);
+}
+
+/* Raise ValueError unless *friend_number* is a friend, which also bounds
+ * the arrays indexed by friend number. */
+static int
+check_friend(ToxAVCore *self, uint32_t friend_number)
+{
+    Tox *tox = ((ToxCore*)self->core)->tox;
+
+    if (tox == NULL || !tox_friend_exists(tox, friend_number)) {
+        PyErr_Format(PyExc_ValueError, "no friend %u", friend_number);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Audio state of *friend_number*, created on first use. Returns NULL with
+ * ValueError set if there is no such friend, or MemoryError if out of
+ * memory. */
+static friend_audio*
+get_friend_audio(ToxAVCore *self, uint32_t friend_number)
+{
+    if ((friend_number >= self->friend_audio_count ||
+         self->friend_audio[friend_number] == NULL) &&
+        check_friend(self, friend_number) == -1) {
+        return NULL;
+    }
+
+    if (friend_number >= self->friend_audio_count) {
+        uint32_t count = self->friend_audio_count ? self->friend_audio_count : 16;
+        while (count <= friend_number) {
+            count *= 2;
+        }
+
+        friend_audio **friends = (friend_audio**)realloc(self->friend_audio,
+                                                         count * sizeof(friend_audio*));
+        if (friends == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        memset(friends + self->friend_audio_count, 0,
+               (count - self->friend_audio_count) * sizeof(friend_audio*));
+        self->friend_audio = friends;
+        self->friend_audio_count = count;
+    }
+
+    if (self->friend_audio[friend_number] == NULL) {
+        friend_audio *audio = (friend_audio*)malloc(sizeof(friend_audio));
+        if (audio == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        audio_converter_init(&audio->send);
+        audio_fifo_init(&audio->send_fifo, 1);
+        audio->send_primed = 0;
+        audio_converter_init(&audio->receive);
+        audio_jitter_init(&audio->jitter);
+        audio_gate_init(&audio->gate);
+        audio->receive_level.rms = 0;
+        audio->receive_level.peak = 0;
+        self->friend_audio[friend_number] = audio;
+    }
+
+    return self->friend_audio[friend_number];
+}
+
+static void
+friend_audio_free(friend_audio *audio)
+{
+    if (audio == NULL) {
+        return;
+    }
+
+    audio_converter_free(&audio->send);
+    audio_fifo_free(&audio->send_fifo);
+    audio_converter_free(&audio->receive);
+    audio_jitter_free(&audio->jitter);
+    free(audio);
+}
+
+/* Start the audio of a friend afresh, as when a call ends. */
+static void
+friend_audio_reset(friend_audio *audio)
+{
+    audio_converter_reset(&audio->send);
+    audio->send_primed = 0;
+    audio_converter_reset(&audio->receive);
+    audio_jitter_reset(&audio->jitter);
+    audio_gate_reset(&audio->gate);
+    audio->receive_level.rms = 0;
+    audio->receive_level.peak = 0;
+}
+
+/* Size the jitter buffer of *audio* for the receive format, concealing
+ * from the last 10 ms played. */
+static int
+configure_jitter(ToxAVCore *self, friend_audio *audio)
+{
+    uint32_t rate = self->audio_receive_rate;
+
+    if (audio_jitter_configure(&audio->jitter, self->audio_receive_channels,
+                               (size_t)rate * self->jitter_target_ms / 1000,
+                               (size_t)rate * self->jitter_max_ms / 1000, rate / 100) == -1) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    return 0;
 }
 
 static void
 ToxAVCore_callback_call_state(ToxAV *toxAV, uint32_t friend_number, uint32_t state, void *self)
 {
-    PyObject_CallMethod((PyObject*)self, "on_call_state", "ii", friend_number, state);
+    ToxAVCore *av = (ToxAVCore*)self;
+    PyGILState_STATE gstate = PyGILState_Ensure();
+
+    if ((state & (TOXAV_FRIEND_CALL_STATE_FINISHED | TOXAV_FRIEND_CALL_STATE_ERROR)) &&
+        friend_number < av->friend_audio_count && av->friend_audio[friend_number]) {
+        friend_audio_reset(av->friend_audio[friend_number]);
+    }
+
+    PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_call_state", "ii",
+                                        friend_number, state);
+    Py_XDECREF(ret);
+
+    if (PyErr_Occurred()) {
+        PyErr_Print();
+    }
+
+    PyGILState_Release(gstate);
 }
 
 static void
 ToxAVCore_callback_bit_rate_status(ToxAV *toxAV, uint32_t friend_number,
                                    uint32_t audio_bit_rate, uint32_t video_bit_rate, void *self)
 {
-    PyObject_CallMethod((PyObject*)self, "on_bit_rate_status", "iii",
-                        friend_number, audio_bit_rate, video_bit_rate);
+    PyGILState_STATE gstate = PyGILState_Ensure();
+
+    PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_bit_rate_status", "iii",
+                                        friend_number, audio_bit_rate, video_bit_rate);
+    Py_XDECREF(ret);
+
+    if (PyErr_Occurred()) {
+        PyErr_Print();
+    }
+
+    PyGILState_Release(gstate);
+}
+
+/* Received PCM as bytes, or as an AudioFrame after set_audio_frames(True). */
+static PyObject*
+pcm_object(ToxAVCore *self, const int16_t *pcm, size_t sample_count, uint8_t channels,
+           uint32_t sampling_rate)
+{
+    if (self->pcm_as_frames) {
+        return (PyObject*)ToxAudioFrame_new(self->pcm_frames, pcm, sample_count, channels,
+                                            sampling_rate);
+    }
+
+    return PyBytes_FromStringAndSize((const char*)pcm, sample_count * channels * 2);
 }
 
 static void
@@ -61,12 +221,54 @@ ToxAVCore_callback_audio_receive_frame(ToxAV *toxAV, uint32_t friend_number, con
                                        size_t sample_count, uint8_t channels, uint32_t sampling_rate,
                                        void *self)
 {
+    ToxAVCore *av = (ToxAVCore*)self;
     PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject *frame = NULL;
 
-    uint32_t length = sample_count * channels * 2;
-    PyObject_CallMethod((PyObject*)self, "on_audio_receive_frame", "i" BUF_TCS "iii",
-                        friend_number, (const char*)pcm, length, sample_count, channels, sampling_rate);
+    /* metered as decoded */
+    friend_audio *audio = get_friend_audio(av, friend_number);
+    if (audio == NULL) {
+        goto out;
+    }
+    audio_measure(pcm, sample_count * channels, &audio->receive_level);
+
+    /* converted as a continuous stream per friend */
+    if (av->audio_receive_rate != 0 && channels >= 1 && channels <= AUDIO_MAX_CHANNELS &&
+        sampling_rate >= AUDIO_MIN_RATE && sampling_rate <= AUDIO_MAX_RATE) {
+        long count = -1;
+        if (audio_converter_set(&audio->receive, sampling_rate, channels,
+                                av->audio_receive_rate, av->audio_receive_channels) == 0) {
+            count = audio_convert(&audio->receive, pcm, sample_count, &pcm);
+        }
+        if (count == -1) {
+            PyErr_NoMemory();
+            goto out;
+        }
 
+        /* buffered for audio_read() instead of passed on */
+        if (av->jitter_target_ms != 0) {
+            if (configure_jitter(av, audio) == 0 &&
+                audio_jitter_write(&audio->jitter, pcm, count) == -1) {
+                PyErr_NoMemory();
+            }
+            goto out;
+        }
+
+        sample_count = count;
+        channels = av->audio_receive_channels;
+        sampling_rate = av->audio_receive_rate;
+    }
+
+    frame = pcm_object(av, pcm, sample_count, channels, sampling_rate);
+    if (frame != NULL) {
+        PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_audio_receive_frame", "iOiii",
+                                            friend_number, frame, sample_count, channels,
+                                            sampling_rate);
+        Py_XDECREF(ret);
+        Py_DECREF(frame);
+    }
+
+out:
     if (PyErr_Occurred()) {
         PyErr_Print();
     }
@@ -74,121 +276,53 @@ ToxAVCore_callback_audio_receive_frame(ToxAV *toxAV, uint32_t friend_number, con
     PyGILState_Release(gstate);
 }
 
+/* A read only view of one of toxav's planes, height rows of width bytes
+ * *stride* apart. */
+static PyObject*
+plane_view(const uint8_t *data, int width, int height, int stride)
+{
+    Py_buffer view;
+    Py_ssize_t shape[2] = {height, width};
+    Py_ssize_t strides[2] = {stride, 1};
+
+    memset(&view, 0, sizeof(view));
+    view.buf = (void*)data;
+    view.readonly = 1;
+    view.itemsize = 1;
+    view.format = "B";
+#if PY_MAJOR_VERSION >= 3
+    /* the memoryview copies shape and strides */
+    view.len = (Py_ssize_t)width * height;
+    view.ndim = 2;
+    view.shape = shape;
+    view.strides = strides;
+#else
+    /* python 2 keeps pointers to them, so stay flat: row i at i * stride */
+    view.len = (Py_ssize_t)stride * (height - 1) + width;
+    view.ndim = 1;
+    (void)shape;
+    (void)strides;
+#endif
+
+    return PyMemoryView_FromBuffer(&view);
+}
+
+/* Views of toxav's buffers must not outlive the callback. */
 static void
-i420_to_rgb(int width, int height, const uint8_t *y, const uint8_t *u, const uint8_t *v,
-            int ystride, int ustride, int vstride, unsigned char *out)
-{
-    const int w = width;
-    const int w2 = w / 2;
-    const int pstride = w * 3;
-    const int h = height;
-    const int h2 = h / 2;
-
-    const int strideY = ystride;
-    const int strideU = ustride;
-    const int strideV = vstride;
-    int posy, posx;
-
-    for (posy = 0; posy < h2; posy++) {
-        unsigned char *dst = out + pstride * (posy * 2);
-        unsigned char *dst2 = out + pstride * (posy * 2 + 1);
-        const unsigned char *srcY = y + strideY * posy * 2;
-        const unsigned char *srcY2 = y + strideY * (posy * 2 + 1);
-        const unsigned char *srcU = u + strideU * posy;
-        const unsigned char *srcV = v + strideV * posy;
-
-        for (posx = 0; posx < w2; posx++) {
-            unsigned char Y, U, V;
-            short R, G, B;
-            short iR, iG, iB;
-
-            U = *(srcU++);
-            V = *(srcV++);
-            iR = (351 * (V - 128)) / 256;
-            iG = - (179 * (V - 128)) / 256 - (86 * (U - 128)) / 256;
-            iB = (444 * (U - 128)) / 256;
-
-            Y = *(srcY++);
-            R = Y + iR ;
-            G = Y + iG ;
-            B = Y + iB ;
-            R = (R < 0 ? 0 : (R > 255 ? 255 : R));
-            G = (G < 0 ? 0 : (G > 255 ? 255 : G));
-            B = (B < 0 ? 0 : (B > 255 ? 255 : B));
-            *(dst++) = R;
-            *(dst++) = G;
-            *(dst++) = B;
-
-            Y = *(srcY2++);
-            R = Y + iR ;
-            G = Y + iG ;
-            B = Y + iB ;
-            R = (R < 0 ? 0 : (R > 255 ? 255 : R));
-            G = (G < 0 ? 0 : (G > 255 ? 255 : G));
-            B = (B < 0 ? 0 : (B > 255 ? 255 : B));
-            *(dst2++) = R;
-            *(dst2++) = G;
-            *(dst2++) = B;
-
-            Y = *(srcY++) ;
-            R = Y + iR ;
-            G = Y + iG ;
-            B = Y + iB ;
-            R = (R < 0 ? 0 : (R > 255 ? 255 : R));
-            G = (G < 0 ? 0 : (G > 255 ? 255 : G));
-            B = (B < 0 ? 0 : (B > 255 ? 255 : B));
-            *(dst++) = R;
-            *(dst++) = G;
-            *(dst++) = B;
-
-            Y = *(srcY2++);
-            R = Y + iR ;
-            G = Y + iG ;
-            B = Y + iB ;
-            R = (R < 0 ? 0 : (R > 255 ? 255 : R));
-            G = (G < 0 ? 0 : (G > 255 ? 255 : G));
-            B = (B < 0 ? 0 : (B > 255 ? 255 : B));
-            *(dst2++) = R;
-            *(dst2++) = G;
-            *(dst2++) = B;
-        }
-    }
-}
-
-static void rgb_to_i420(unsigned char* rgb, vpx_image_t *img)
-{
-    int upos = 0;
-    int vpos = 0;
-    unsigned int x = 0, i = 0;
-    unsigned int line = 0;
-
-    for (line = 0; line < img->d_h; ++line) {
-        if (!(line % 2)) {
-            for (x = 0; x < img->d_w; x += 2) {
-                uint8_t r = rgb[3 * i];
-                uint8_t g = rgb[3 * i + 1];
-                uint8_t b = rgb[3 * i + 2];
-
-                img->planes[VPX_PLANE_Y][i++] = ((66*r + 129*g + 25*b) >> 8) + 16;
-                img->planes[VPX_PLANE_U][upos++] = ((-38*r + -74*g + 112*b) >> 8) + 128;
-                img->planes[VPX_PLANE_V][vpos++] = ((112*r + -94*g + -18*b) >> 8) + 128;
-
-                r = rgb[3 * i];
-                g = rgb[3 * i + 1];
-                b = rgb[3 * i + 2];
-
-                img->planes[VPX_PLANE_Y][i++] = ((66*r + 129*g + 25*b) >> 8) + 16;
-            }
-        } else {
-            for (x = 0; x < img->d_w; x += 1) {
-                uint8_t r = rgb[3 * i];
-                uint8_t g = rgb[3 * i + 1];
-                uint8_t b = rgb[3 * i + 2];
+release_views(PyObject *views)
+{
+#if PY_MAJOR_VERSION >= 3
+    Py_ssize_t i;
 
-                img->planes[VPX_PLANE_Y][i++] = ((66*r + 129*g + 25*b) >> 8) + 16;
-            }
+    for (i = 0; i < PyTuple_GET_SIZE(views); i++) {
+        PyObject *ret = PyObject_CallMethod(PyTuple_GET_ITEM(views, i), "release", NULL);
+        if (ret == NULL) {
+            PyErr_Print();
         }
+        Py_XDECREF(ret);
     }
+#endif
+    Py_DECREF(views);
 }
 
 static void
@@ -198,26 +332,65 @@ ToxAVCore_callback_video_receive_frame(ToxAV *toxAV, uint32_t friend_number, uin
 {
     ToxAVCore *self = (ToxAVCore*)user_data;
     PyGILState_STATE gstate = PyGILState_Ensure();
-
-    if (self->out_image && (self->o_w != width || self->o_h != height)) {
-        free(self->out_image);
-        self->out_image = NULL;
+    int format = self->video_format;
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    PyObject *ret = NULL;
+
+    if (format == CONVERT_FORMAT_I420 && self->video_borrow) {
+        /* zero copy: (y, u, v) views straight over toxav's planes */
+        PyObject *views = Py_BuildValue("(NNN)",
+                                        plane_view(y, width, height, ystride),
+                                        plane_view(u, chroma_width, chroma_height, ustride),
+                                        plane_view(v, chroma_width, chroma_height, vstride));
+        if (views != NULL) {
+            ret = PyObject_CallMethod((PyObject*)self, "on_video_receive_frame", "iiiO",
+                                      friend_number, width, height, views);
+            Py_XDECREF(ret);
+            release_views(views);
+        }
+        if (PyErr_Occurred()) {
+            PyErr_Print();
+        }
+        PyGILState_Release(gstate);
+        return;
     }
 
-    const int buf_size = width * height * 3;
-
-    if (self->out_image == NULL) {
-        self->o_w = width;
-        self->o_h = height;
-        self->out_image = malloc(buf_size);
+    /* the frame is the callee's to keep, its buffer is recycled once it is
+     * released */
+    ToxVideoFrame *frame = ToxVideoFrame_new(self->frames, format, width, height);
+    if (frame == NULL) {
+        PyErr_Print();
+        PyGILState_Release(gstate);
+        return;
     }
 
-    i420_to_rgb(width, height, y, u, v, ystride, ustride, vstride, self->out_image);
+    uint8_t *out = frame->base.buffer->data;
+    uint8_t *chroma = out + (size_t)width * height;
+
+    if (format == CONVERT_FORMAT_I420) {
+        size_t chroma_size = (size_t)chroma_width * chroma_height;
+        convert_copy_plane(width, height, y, ystride, out, width);
+        convert_copy_plane(chroma_width, chroma_height, u, ustride, chroma, chroma_width);
+        convert_copy_plane(chroma_width, chroma_height, v, vstride, chroma + chroma_size,
+                           chroma_width);
+    } else if (format == CONVERT_FORMAT_NV12) {
+        convert_i420_to_nv12(self->video_pool, width, height, y, u, v,
+                             ystride, ustride, vstride, out, width,
+                             chroma, chroma_width * 2);
+    } else {
+        int bytes_per_pixel = format == CONVERT_FORMAT_RGBA ? 4 : 3;
+        convert_i420_to_packed(self->video_pool, format, width, height,
+                               y, u, v, ystride, ustride, vstride, out,
+                               width * bytes_per_pixel);
+    }
 
     /* python method: on_video_receive_frame(friend_number, width, height, frame) */
-    PyObject_CallMethod((PyObject*)self, "on_video_receive_frame", "iii" BUF_TCS,
-                        friend_number, self->o_w, self->o_h, self->out_image, buf_size);
+    ret = PyObject_CallMethod((PyObject*)self, "on_video_receive_frame", "iiiO",
+                              friend_number, width, height, frame);
+    Py_DECREF(frame);
 
+    Py_XDECREF(ret);
     if (PyErr_Occurred()) {
         PyErr_Print();
     }
@@ -225,6 +398,68 @@ ToxAVCore_callback_video_receive_frame(ToxAV *toxAV, uint32_t friend_number, uin
     PyGILState_Release(gstate);
 }
 
+/* Queue group audio in the mixer of the group, if it has one. Returns 1
+ * if the audio was taken by a mixer. */
+static int
+mix_group_audio(ToxAVCore *self, int groupnumber, int peernumber, const int16_t *pcm,
+                unsigned int samples, uint8_t channels, unsigned int sample_rate)
+{
+    if (groupnumber < 0 || (uint32_t)groupnumber >= self->group_mix_count ||
+        self->group_mixes[groupnumber].mixer == NULL) {
+        return 0;
+    }
+
+    if (channels >= 1 && channels <= AUDIO_MAX_CHANNELS &&
+        sample_rate >= AUDIO_MIN_RATE && sample_rate <= AUDIO_MAX_RATE &&
+        group_mixer_write(self->group_mixes[groupnumber].mixer, peernumber, pcm, samples,
+                          channels, sample_rate) == -1) {
+        PyErr_NoMemory();
+    }
+
+    return 1;
+}
+
+/* Hand out the frames the group mixers have ready, sending them to the
+ * group set by set_group_mixer or passing them to on_group_mix. */
+static void
+flush_group_mixes(ToxAVCore *self)
+{
+    uint32_t i;
+
+    for (i = 0; i < self->group_mix_count; i++) {
+        group_mixer *mixer = NULL;
+
+        /* on_group_mix may replace or remove the mixer, or kill the Tox */
+        while ((mixer = self->group_mixes[i].mixer) != NULL && group_mixer_mix(mixer)) {
+            Tox *tox = ((ToxCore*)self->core)->tox;
+            if (tox == NULL) {
+                return;
+            }
+
+            int send_to = self->group_mixes[i].send_to;
+            if (send_to >= 0) {
+                toxav_group_send_audio(tox, send_to, mixer->mix, mixer->frame_size,
+                                       mixer->channels, mixer->rate);
+                continue;
+            }
+
+            PyObject *frame = pcm_object(self, mixer->mix, mixer->frame_size,
+                                         mixer->channels, mixer->rate);
+            if (frame != NULL) {
+                PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_group_mix", "iOiii",
+                                                    i, frame, (int)mixer->frame_size,
+                                                    mixer->channels, mixer->rate);
+                Py_XDECREF(ret);
+                Py_DECREF(frame);
+            }
+
+            if (PyErr_Occurred()) {
+                PyErr_Print();
+            }
+        }
+    }
+}
+
 /**
  * NOTE Compatibility with old toxav group calls TODO remove
  */
@@ -233,12 +468,19 @@ ToxAVCore_callback_add_av_groupchat(/*Tox*/void *tox, int groupnumber, int peern
                                     unsigned int samples, uint8_t channels, unsigned int sample_rate, void *self)
 {
     PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject *frame = NULL;
 
-    uint32_t length = samples * channels * 2;
-
-    PyObject_CallMethod((PyObject*)self, "on_add_av_groupchat", "ii" BUF_TCS "iii",
-                        groupnumber, peernumber, pcm, length,
-                        samples, channels, sample_rate);
+    if (!mix_group_audio((ToxAVCore*)self, groupnumber, peernumber, pcm, samples, channels,
+                         sample_rate)) {
+        frame = pcm_object((ToxAVCore*)self, pcm, samples, channels, sample_rate);
+    }
+    if (frame != NULL) {
+        PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_add_av_groupchat", "iiOiii",
+                                            groupnumber, peernumber, frame,
+                                            samples, channels, sample_rate);
+        Py_XDECREF(ret);
+        Py_DECREF(frame);
+    }
 
     if (PyErr_Occurred()) {
         PyErr_Print();
@@ -252,12 +494,19 @@ ToxAVCore_callback_join_av_groupchat(/*Tox*/void *tox, int groupnumber, int peer
                                      unsigned int samples, uint8_t channels, unsigned int sample_rate, void *self)
 {
     PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject *frame = NULL;
 
-    uint32_t length = samples * channels * 2;
-
-    PyObject_CallMethod((PyObject*)self, "on_join_av_groupchat", "ii" BUF_TCS "iii",
-                        groupnumber, peernumber, pcm, length,
-                        samples, channels, sample_rate);
+    if (!mix_group_audio((ToxAVCore*)self, groupnumber, peernumber, pcm, samples, channels,
+                         sample_rate)) {
+        frame = pcm_object((ToxAVCore*)self, pcm, samples, channels, sample_rate);
+    }
+    if (frame != NULL) {
+        PyObject *ret = PyObject_CallMethod((PyObject*)self, "on_join_av_groupchat", "iiOiii",
+                                            groupnumber, peernumber, frame,
+                                            samples, channels, sample_rate);
+        Py_XDECREF(ret);
+        Py_DECREF(frame);
+    }
 
     if (PyErr_Occurred()) {
         PyErr_Print();
@@ -285,6 +534,15 @@ static int init_helper(ToxAVCore *self, PyObject* args)
         return -1;
     }
 
+    if (!PyObject_TypeCheck(core, &ToxCoreType)) {
+        PyErr_SetString(PyExc_TypeError, "must associate with a core instance");
+        return -1;
+    }
+
+    if (ToxCore_ensure_tox((ToxCore*)core) == -1) {
+        return -1;
+    }
+
     self->core = core;
     Py_INCREF(self->core);
 
@@ -314,37 +572,588 @@ static int init_helper(ToxAVCore *self, PyObject* args)
 static PyObject*
 ToxAVCore_new(PyTypeObject *type, PyObject* args, PyObject* kwds)
 {
-    ToxAVCore* self = (ToxAVCore*)type->tp_alloc(type, 0);
-    self->av = NULL;
-    self->out_image = NULL;
-    self->i_w = self->i_h = self->o_w = self->o_h = 0;
+    ToxAVCore* self = (ToxAVCore*)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->av = NULL;
+    pthread_mutex_init(&self->audio_send_lock, NULL);
+    pthread_mutex_init(&self->video_send_lock, NULL);
+    self->in_image = NULL;
+    self->video_pool = NULL;
+    self->video_format = CONVERT_FORMAT_RGB;
+    self->video_borrow = 0;
+    self->i_w = self->i_h = 0;
+
+    self->pcm_as_frames = 0;
+    self->pcm_buffer = NULL;
+    self->pcm_size = 0;
+
+    self->send_sizes = NULL;
+    self->send_sizes_count = 0;
+
+    self->audio_send_rate = 0;
+    self->audio_send_channels = 0;
+    self->audio_receive_rate = 0;
+    self->audio_receive_channels = 0;
+    self->jitter_target_ms = 0;
+    self->jitter_max_ms = 0;
+    self->friend_audio = NULL;
+    self->friend_audio_count = 0;
+    self->group_mixes = NULL;
+    self->group_mix_count = 0;
+
+    self->frames = frame_pool_new();
+    self->pcm_frames = frame_pool_new();
+    self->scalers[0] = convert_scaler_new();
+    self->scalers[1] = convert_scaler_new();
+    if (self->frames == NULL || self->pcm_frames == NULL ||
+        self->scalers[0] == NULL || self->scalers[1] == NULL) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+
+    if (init_helper(self, NULL) == -1) {
+        return NULL;
+    }
+
+    return (PyObject*)self;
+}
+
+static int
+ToxAVCore_init(ToxAVCore *self, PyObject* args, PyObject* kwds)
+{
+    /* since __init__ in Python is optional(superclass need to call it
+     * explicitly), we need to initialize self->tox in ToxAVCore_new instead of
+     * init. If ToxAVCore_init is called, we re-initialize self->tox and pass
+     * the new ipv6enabled setting. */
+    return init_helper(self, args);
+}
+
+static void
+ToxAVCore_dealloc(ToxAVCore *self)
+{
+    if (self->av) {
+        toxav_kill(self->av);
+        self->av = NULL;
+        Py_DECREF(self->core);
+    }
+
+    pool_free(self->video_pool);
+    frame_pool_unref(self->frames);
+    frame_pool_unref(self->pcm_frames);
+    free(self->pcm_buffer);
+    convert_scaler_free(self->scalers[0]);
+    convert_scaler_free(self->scalers[1]);
+    free(self->send_sizes);
+    uint32_t i;
+    for (i = 0; i < self->friend_audio_count; i++) {
+        friend_audio_free(self->friend_audio[i]);
+    }
+    free(self->friend_audio);
+    for (i = 0; i < self->group_mix_count; i++) {
+        group_mixer_free(self->group_mixes[i].mixer);
+    }
+    free(self->group_mixes);
+    if (self->in_image) {
+        vpx_img_free(self->in_image);
+    }
+    pthread_mutex_destroy(&self->audio_send_lock);
+    pthread_mutex_destroy(&self->video_send_lock);
+
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject*
+ToxAVCore_set_video_format(ToxAVCore *self, PyObject* args, PyObject* kwds)
+{
+    static char *kwlist[] = {"format", "borrow", NULL};
+    int format = 0;
+    PyObject *borrow = Py_False;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|O", kwlist, &format, &borrow)) {
+        return NULL;
+    }
+
+    if (format < CONVERT_FORMAT_I420 || format > CONVERT_FORMAT_RGBA) {
+        PyErr_SetString(PyExc_ValueError, "unknown video format");
+        return NULL;
+    }
+
+    int value = PyObject_IsTrue(borrow);
+    if (value == -1) {
+        return NULL;
+    }
+    if (value && format != CONVERT_FORMAT_I420) {
+        PyErr_SetString(PyExc_ValueError, "only VIDEO_FORMAT_I420 can be borrowed");
+        return NULL;
+    }
+
+    self->video_format = format;
+    self->video_borrow = value;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_set_audio_frames(ToxAVCore *self, PyObject* args)
+{
+    PyObject *enabled = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &enabled)) {
+        return NULL;
+    }
+
+    int value = PyObject_IsTrue(enabled);
+    if (value == -1) {
+        return NULL;
+    }
+    self->pcm_as_frames = value;
+
+    Py_RETURN_NONE;
+}
+
+/* Parse a (sampling_rate, channels) pair, 0 and 0 for none. */
+static int
+parse_audio_format(PyObject* args, uint32_t *sampling_rate, int *channels, int opus)
+{
+    int rate = 0;
+
+    if (!PyArg_ParseTuple(args, "ii", &rate, channels)) {
+        return -1;
+    }
+
+    if (rate == 0 && *channels == 0) {
+        *sampling_rate = 0;
+        return 0;
+    }
+
+    if (*channels < 1 || *channels > AUDIO_MAX_CHANNELS) {
+        PyErr_SetString(PyExc_ValueError, "channels must be 1 or 2");
+        return -1;
+    }
+
+    if (opus ? !audio_rate_is_opus(rate) : rate < AUDIO_MIN_RATE || rate > AUDIO_MAX_RATE) {
+        PyErr_Format(PyExc_ValueError, "unsupported sampling rate: %d", rate);
+        return -1;
+    }
+    *sampling_rate = rate;
+
+    return 0;
+}
+
+static PyObject*
+ToxAVCore_set_audio_send_format(ToxAVCore *self, PyObject* args)
+{
+    uint32_t sampling_rate = 0;
+    int channels = 0;
+
+    if (parse_audio_format(args, &sampling_rate, &channels, 1) == -1) {
+        return NULL;
+    }
+
+    /* audio_send_frame sends with the GIL released, in the old format */
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->audio_send_lock);
+    Py_END_ALLOW_THREADS
+
+    if (sampling_rate != self->audio_send_rate || channels != self->audio_send_channels) {
+        uint32_t i;
+        for (i = 0; i < self->friend_audio_count; i++) {
+            if (self->friend_audio[i] != NULL) {
+                self->friend_audio[i]->send_primed = 0;
+            }
+        }
+    }
+
+    self->audio_send_rate = sampling_rate;
+    self->audio_send_channels = channels;
+    pthread_mutex_unlock(&self->audio_send_lock);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_set_audio_receive_format(ToxAVCore *self, PyObject* args)
+{
+    uint32_t sampling_rate = 0;
+    int channels = 0;
+
+    if (parse_audio_format(args, &sampling_rate, &channels, 0) == -1) {
+        return NULL;
+    }
+
+    if (sampling_rate == 0 && self->jitter_target_ms != 0) {
+        PyErr_SetString(PyExc_ValueError, "the jitter buffer needs a receive format");
+        return NULL;
+    }
+
+    self->audio_receive_rate = sampling_rate;
+    self->audio_receive_channels = channels;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_set_audio_jitter_buffer(ToxAVCore *self, PyObject* args)
+{
+    int target_ms = 0;
+    int max_ms = 0;
+
+    if (!PyArg_ParseTuple(args, "i|i", &target_ms, &max_ms)) {
+        return NULL;
+    }
+
+    if (target_ms < 0 || target_ms > 1000 || max_ms < 0 || max_ms > 2000) {
+        PyErr_SetString(PyExc_ValueError, "invalid jitter buffer size");
+        return NULL;
+    }
+
+    if (target_ms != 0 && self->audio_receive_rate == 0) {
+        PyErr_SetString(PyExc_ValueError, "the jitter buffer needs a receive format");
+        return NULL;
+    }
+
+    /* room for six 20 ms frames arriving at once by default */
+    if (max_ms == 0) {
+        max_ms = target_ms + 120;
+    }
+    if (target_ms != 0 && max_ms < target_ms + 20) {
+        PyErr_SetString(PyExc_ValueError, "max_ms must be at least target_ms + 20");
+        return NULL;
+    }
+
+    self->jitter_target_ms = target_ms;
+    self->jitter_max_ms = target_ms ? max_ms : 0;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_audio_read(ToxAVCore *self, PyObject* args)
+{
+    uint32_t friend_number = 0;
+    int sample_count = 0;
+
+    if (!PyArg_ParseTuple(args, "Ii", &friend_number, &sample_count)) {
+        return NULL;
+    }
+
+    if (self->jitter_target_ms == 0) {
+        PyErr_SetString(PyExc_ValueError, "the jitter buffer is not enabled");
+        return NULL;
+    }
+
+    if (sample_count <= 0 || (uint32_t)sample_count > self->audio_receive_rate * 10) {
+        PyErr_SetString(PyExc_ValueError, "invalid sample_count");
+        return NULL;
+    }
+
+    friend_audio *audio = get_friend_audio(self, friend_number);
+    if (audio == NULL || configure_jitter(self, audio) == -1) {
+        return NULL;
+    }
+
+    int channels = self->audio_receive_channels;
+    PyObject *pcm = NULL;
+    int16_t *out = NULL;
+
+    if (self->pcm_as_frames) {
+        ToxAudioFrame *frame = ToxAudioFrame_new(self->pcm_frames, NULL, sample_count,
+                                                 channels, self->audio_receive_rate);
+        if (frame != NULL) {
+            out = (int16_t*)frame->base.buffer->data;
+        }
+        pcm = (PyObject*)frame;
+    } else {
+        pcm = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)sample_count * channels * 2);
+        if (pcm != NULL) {
+            out = (int16_t*)PyBytes_AS_STRING(pcm);
+        }
+    }
+
+    if (pcm != NULL) {
+        audio_jitter_read(&audio->jitter, out, sample_count);
+    }
+
+    return pcm;
+}
+
+static PyObject*
+ToxAVCore_get_audio_jitter_stats(ToxAVCore *self, PyObject* args)
+{
+    uint32_t friend_number = 0;
+
+    if (!PyArg_ParseTuple(args, "I", &friend_number)) {
+        return NULL;
+    }
+
+    audio_jitter none;
+    const audio_jitter *jitter = &none;
+    if (friend_number < self->friend_audio_count && self->friend_audio[friend_number]) {
+        jitter = &self->friend_audio[friend_number]->jitter;
+    } else {
+        audio_jitter_init(&none);
+    }
+
+    return Py_BuildValue("{s:n,s:K,s:K,s:K,s:K,s:K}",
+                         "buffered", (Py_ssize_t)jitter->fifo.frames,
+                         "received", (unsigned long long)jitter->received,
+                         "played", (unsigned long long)jitter->played,
+                         "concealed", (unsigned long long)jitter->concealed,
+                         "dropped", (unsigned long long)jitter->dropped,
+                         "underruns", (unsigned long long)jitter->underruns);
+}
+
+static PyObject*
+ToxAVCore_set_audio_gate(ToxAVCore *self, PyObject* args)
+{
+    uint32_t friend_number = 0;
+    double threshold_db = 0;
+    int hangover_ms = 200;
+
+    if (!PyArg_ParseTuple(args, "Id|i", &friend_number, &threshold_db, &hangover_ms)) {
+        return NULL;
+    }
+
+    if (!(threshold_db >= -90 && threshold_db <= 0)) {
+        PyErr_SetString(PyExc_ValueError, "threshold_db must be between -90 and 0");
+        return NULL;
+    }
+
+    if (hangover_ms < 0 || hangover_ms > 10000) {
+        PyErr_SetString(PyExc_ValueError, "invalid hangover_ms");
+        return NULL;
+    }
+
+    friend_audio *audio = get_friend_audio(self, friend_number);
+    if (audio == NULL) {
+        return NULL;
+    }
+
+    /* as an RMS in sample units, at least 1 so that digital silence is
+     * held back even at -90 dBFS */
+    int threshold = 0;
+    if (threshold_db < 0) {
+        threshold = (int)(32768 * pow(10, threshold_db / 20) + 0.5);
+        threshold = threshold < 1 ? 1 : threshold;
+    }
+    audio_gate_configure(&audio->gate, threshold, hangover_ms);
+
+    Py_RETURN_NONE;
+}
+
+/* A level in dBFS, -inf for digital silence. */
+static double
+level_db(int level)
+{
+    return level > 0 ? 20 * log10(level / 32768.0) : -INFINITY;
+}
+
+static PyObject*
+ToxAVCore_get_audio_levels(ToxAVCore *self, PyObject* args)
+{
+    uint32_t friend_number = 0;
+
+    if (!PyArg_ParseTuple(args, "I", &friend_number)) {
+        return NULL;
+    }
+
+    friend_audio none;
+    const friend_audio *audio = &none;
+    if (friend_number < self->friend_audio_count && self->friend_audio[friend_number]) {
+        audio = self->friend_audio[friend_number];
+    } else {
+        audio_gate_init(&none.gate);
+        none.receive_level.rms = 0;
+        none.receive_level.peak = 0;
+    }
+
+    return Py_BuildValue("{s:d,s:d,s:d,s:d,s:O,s:K,s:K}",
+                         "send_rms", level_db(audio->gate.level.rms),
+                         "send_peak", level_db(audio->gate.level.peak),
+                         "receive_rms", level_db(audio->receive_level.rms),
+                         "receive_peak", level_db(audio->receive_level.peak),
+                         "sending", audio->gate.open ? Py_True : Py_False,
+                         "sent", (unsigned long long)audio->gate.passed,
+                         "suppressed", (unsigned long long)audio->gate.suppressed);
+}
+
+static PyObject*
+ToxAVCore_set_group_mixer(ToxAVCore *self, PyObject* args, PyObject* kwds)
+{
+    static char *kwlist[] = {"groupnumber", "sampling_rate", "channels", "send_to", NULL};
+    int groupnumber = 0;
+    int rate = 0;
+    int channels = 0;
+    int send_to = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iii|i", kwlist, &groupnumber, &rate,
+                                     &channels, &send_to)) {
+        return NULL;
+    }
+
+    if (groupnumber < 0 || send_to < -1) {
+        PyErr_SetString(PyExc_ValueError, "invalid group number");
+        return NULL;
+    }
+
+    if (rate != 0 || channels != 0) {
+        if (channels < 1 || channels > AUDIO_MAX_CHANNELS) {
+            PyErr_SetString(PyExc_ValueError, "channels must be 1 or 2");
+            return NULL;
+        }
+        if (send_to >= 0 ? !audio_rate_is_opus(rate) :
+            rate < AUDIO_MIN_RATE || rate > AUDIO_MAX_RATE) {
+            PyErr_Format(PyExc_ValueError, "unsupported sampling rate: %d", rate);
+            return NULL;
+        }
+    }
+
+    if ((uint32_t)groupnumber >= self->group_mix_count) {
+        if (rate == 0) {
+            Py_RETURN_NONE;
+        }
+
+        uint32_t count = self->group_mix_count ? self->group_mix_count : 8;
+        while (count <= (uint32_t)groupnumber) {
+            count *= 2;
+        }
+
+        group_mix *mixes = (group_mix*)realloc(self->group_mixes, count * sizeof(group_mix));
+        if (mixes == NULL) {
+            return PyErr_NoMemory();
+        }
+        memset(mixes + self->group_mix_count, 0,
+               (count - self->group_mix_count) * sizeof(group_mix));
+        self->group_mixes = mixes;
+        self->group_mix_count = count;
+    }
+
+    /* gains and queued audio are kept unless the format changes */
+    group_mix *mix = &self->group_mixes[groupnumber];
+    if (mix->mixer == NULL || rate == 0 || mix->mixer->rate != (uint32_t)rate ||
+        mix->mixer->channels != channels) {
+        group_mixer *mixer = NULL;
+        if (rate != 0) {
+            /* 20 ms frames */
+            mixer = group_mixer_new(rate, channels, rate / 50);
+            if (mixer == NULL) {
+                return PyErr_NoMemory();
+            }
+        }
+        group_mixer_free(mix->mixer);
+        mix->mixer = mixer;
+    }
+    mix->send_to = send_to;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_set_group_peer_gain(ToxAVCore *self, PyObject* args)
+{
+    int groupnumber = 0;
+    int peernumber = 0;
+    double gain = 1.0;
+
+    if (!PyArg_ParseTuple(args, "iid", &groupnumber, &peernumber, &gain)) {
+        return NULL;
+    }
+
+    if (groupnumber < 0 || (uint32_t)groupnumber >= self->group_mix_count ||
+        self->group_mixes[groupnumber].mixer == NULL) {
+        PyErr_SetString(PyExc_ValueError, "group has no mixer");
+        return NULL;
+    }
+
+    if (!(gain >= 0.0 && gain <= (double)MIXER_MAX_GAIN / MIXER_UNITY_GAIN)) {
+        PyErr_SetString(PyExc_ValueError, "gain must be between 0 and 4");
+        return NULL;
+    }
+
+    if (group_mixer_set_gain(self->group_mixes[groupnumber].mixer, peernumber,
+                             (int)(gain * MIXER_UNITY_GAIN + 0.5)) == -1) {
+        return PyErr_NoMemory();
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_set_video_send_size(ToxAVCore *self, PyObject* args)
+{
+    uint32_t friend_number = 0;
+    int width = 0, height = 0;
+
+    if (!PyArg_ParseTuple(args, "Iii", &friend_number, &width, &height)) {
+        return NULL;
+    }
+
+    if ((width == 0) != (height == 0) || width < 0 || height < 0 ||
+        width > 65535 || height > 65535) {
+        PyErr_SetString(PyExc_ValueError, "invalid frame size");
+        return NULL;
+    }
+
+    if (friend_number >= self->send_sizes_count) {
+        if (width == 0) {
+            Py_RETURN_NONE;
+        }
+        if (check_friend(self, friend_number) == -1) {
+            return NULL;
+        }
+
+        uint32_t count = self->send_sizes_count ? self->send_sizes_count : 16;
+        while (count <= friend_number) {
+            count *= 2;
+        }
+
+        send_size *sizes = (send_size*)realloc(self->send_sizes, count * sizeof(send_size));
+        if (sizes == NULL) {
+            return PyErr_NoMemory();
+        }
+        memset(sizes + self->send_sizes_count, 0,
+               (count - self->send_sizes_count) * sizeof(send_size));
+        self->send_sizes = sizes;
+        self->send_sizes_count = count;
+    }
+
+    self->send_sizes[friend_number].width = width;
+    self->send_sizes[friend_number].height = height;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxAVCore_set_video_threads(ToxAVCore *self, PyObject* args)
+{
+    int threads = 0;
 
-    if (init_helper(self, NULL) == -1) {
+    if (!PyArg_ParseTuple(args, "i", &threads)) {
         return NULL;
     }
 
-    return (PyObject*)self;
-}
-
-static int
-ToxAVCore_init(ToxAVCore *self, PyObject* args, PyObject* kwds)
-{
-    /* since __init__ in Python is optional(superclass need to call it
-     * explicitly), we need to initialize self->tox in ToxAVCore_new instead of
-     * init. If ToxAVCore_init is called, we re-initialize self->tox and pass
-     * the new ipv6enabled setting. */
-    return init_helper(self, args);
-}
+    if (threads < 1 || threads > 64) {
+        PyErr_SetString(PyExc_ValueError, "threads must be between 1 and 64");
+        return NULL;
+    }
 
-static int
-ToxAVCore_dealloc(ToxAVCore *self)
-{
-    if (self->av) {
-        Py_DECREF(self->core);
-        toxav_kill(self->av);
-        self->av = NULL;
+    /* the calling thread converts a band too */
+    pool_t *pool = NULL;
+    if (threads > 1) {
+        pool = pool_new(threads - 1);
+        if (pool == NULL) {
+            PyErr_SetString(ToxOpError, "failed to start video threads");
+            return NULL;
+        }
     }
-    return 0;
+
+    pool_free(self->video_pool);
+    self->video_pool = pool;
+
+    Py_RETURN_NONE;
 }
 
 static PyObject*
@@ -358,8 +1167,18 @@ ToxAVCore_call(ToxAVCore *self, PyObject* args)
         return NULL;
     }
 
+    /* toxav may wait on a call that toxav_iterate holds while calling back
+     * into Python, so the GIL is released around every toxav call */
     TOXAV_ERR_CALL err = 0;
-    bool ret = toxav_call(self->av, friend_number, audio_bit_rate, video_bit_rate, &err);
+    bool ret = false;
+    int state = ToxCore_begin_call((ToxCore*)self->core);
+    if (state == -1) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = toxav_call(self->av, friend_number, audio_bit_rate, video_bit_rate, &err);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call((ToxCore*)self->core, state);
     if (ret == false) {
         PyErr_Format(ToxOpError, "toxav call error: %d", err);
         return NULL;
@@ -378,7 +1197,15 @@ ToxAVCore_call_control(ToxAVCore *self, PyObject* args)
     }
 
     TOXAV_ERR_CALL_CONTROL err = 0;
-    bool ret = toxav_call_control(self->av, friend_number, control, &err);
+    bool ret = false;
+    int state = ToxCore_begin_call((ToxCore*)self->core);
+    if (state == -1) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = toxav_call_control(self->av, friend_number, control, &err);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call((ToxCore*)self->core, state);
     if (ret == false) {
         PyErr_Format(ToxOpError, "toxav call control error: %d", err);
         return NULL;
@@ -398,7 +1225,15 @@ ToxAVCore_bit_rate_set(ToxAVCore *self, PyObject* args)
     }
 
     TOXAV_ERR_BIT_RATE_SET err = 0;
-    bool ret = toxav_bit_rate_set(self->av, friend_number, audio_bit_rate, video_bit_rate, &err);
+    bool ret = false;
+    int state = ToxCore_begin_call((ToxCore*)self->core);
+    if (state == -1) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = toxav_bit_rate_set(self->av, friend_number, audio_bit_rate, video_bit_rate, &err);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call((ToxCore*)self->core, state);
     if (ret == false) {
         PyErr_Format(ToxOpError, "toxav bit rate set error: %d", err);
         return NULL;
@@ -406,24 +1241,193 @@ ToxAVCore_bit_rate_set(ToxAVCore *self, PyObject* args)
     return PyBool_FromLong(ret);
 }
 
+/* Borrow the PCM of *obj* for sending *samples* 16 bit samples: bytes, or
+ * an array of int16 items, which is gathered into pcm_buffer unless it is
+ * C-contiguous. */
+static int
+get_pcm(ToxAVCore *self, PyObject *obj, Py_buffer *view, size_t samples,
+        const int16_t **pcm)
+{
+    const uint16_t one = 1;
+    const char *format = NULL;
+
+    if (PyObject_GetBuffer(obj, view, PyBUF_RECORDS_RO) == -1) {
+        return -1;
+    }
+
+    /* int16 in native byte order, or raw bytes */
+    if (view->format != NULL) {
+        format = view->format;
+        if (*format == '@' || *format == '=' || *format == (*(const char*)&one ? '<' : '>')) {
+            format++;
+        }
+    }
+    if (view->itemsize != 1 && (view->itemsize != 2 || (format && strcmp(format, "h")))) {
+        PyErr_SetString(PyExc_ValueError, "pcm must be bytes or 16 bit signed samples");
+        PyBuffer_Release(view);
+        return -1;
+    }
+
+    if ((size_t)view->len < samples * 2) {
+        PyErr_SetString(PyExc_ValueError, "pcm shorter than sample_count * channels");
+        PyBuffer_Release(view);
+        return -1;
+    }
+
+    if (PyBuffer_IsContiguous(view, 'C')) {
+        *pcm = (const int16_t*)view->buf;
+        return 0;
+    }
+
+    if ((size_t)view->len > self->pcm_size) {
+        free(self->pcm_buffer);
+        self->pcm_size = 0;
+        self->pcm_buffer = (int16_t*)malloc(view->len);
+        if (self->pcm_buffer == NULL) {
+            PyBuffer_Release(view);
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->pcm_size = view->len;
+    }
+
+    if (PyBuffer_ToContiguous(self->pcm_buffer, view, view->len, 'C') == -1) {
+        PyBuffer_Release(view);
+        return -1;
+    }
+    *pcm = self->pcm_buffer;
+
+    return 0;
+}
+
+/* Send a frame to a friend, unless its gate holds it back as silence. */
+static bool
+send_gated(ToxAVCore *self, friend_audio *audio, uint32_t friend_number, const int16_t *pcm,
+           size_t sample_count, int channels, uint32_t sampling_rate,
+           TOXAV_ERR_SEND_FRAME *err)
+{
+    if (!audio_gate_process(&audio->gate, pcm, sample_count, channels, sampling_rate)) {
+        return true;
+    }
+
+    /* Opus encodes with the GIL released, *pcm* kept by audio_send_lock */
+    bool ret = false;
+    int state = ToxCore_begin_call((ToxCore*)self->core);
+    if (state == -1) {
+        return false;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = toxav_audio_send_frame(self->av, friend_number, pcm, sample_count, channels,
+                                 sampling_rate, err);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call((ToxCore*)self->core, state);
+
+    return ret;
+}
+
+/* Convert PCM to the format set by set_audio_send_format and send it in
+ * frames of the same duration, queueing the remainder for the next call.
+ * The stream starts with half a frame of silence, so that resampling
+ * jitter never leaves a call a sample short of a frame. */
+static bool
+audio_send_converted(ToxAVCore *self, friend_audio *audio, uint32_t friend_number,
+                     const int16_t *pcm, size_t sample_count, int channels,
+                     uint32_t sampling_rate, TOXAV_ERR_SEND_FRAME *err)
+{
+    int out_channels = self->audio_send_channels;
+    size_t frame_size = (uint64_t)sample_count * self->audio_send_rate / sampling_rate;
+    long count = -1;
+
+    if (!audio->send_primed) {
+        audio_converter_reset(&audio->send);
+        audio_fifo_reset(&audio->send_fifo, out_channels);
+        if (audio_fifo_write(&audio->send_fifo, NULL, frame_size / 2) == 0) {
+            audio->send_primed = 1;
+        }
+    }
+
+    if (audio->send_primed &&
+        audio_converter_set(&audio->send, sampling_rate, channels,
+                            self->audio_send_rate, out_channels) == 0) {
+        count = audio_convert(&audio->send, pcm, sample_count, &pcm);
+    }
+    if (count == -1 || audio_fifo_write(&audio->send_fifo, pcm, count) == -1) {
+        PyErr_NoMemory();
+        return false;
+    }
+
+    bool ret = true;
+    while (ret && frame_size > 0 && audio->send_fifo.frames >= frame_size) {
+        ret = send_gated(self, audio, friend_number, audio->send_fifo.samples, frame_size,
+                         out_channels, self->audio_send_rate, err);
+        audio_fifo_consume(&audio->send_fifo, frame_size);
+    }
+
+    return ret;
+}
+
 static PyObject*
 ToxAVCore_audio_send_frame(ToxAVCore *self, PyObject* args)
 {
     uint32_t friend_number;
-    int16_t *pcm = NULL;
-    uint32_t pcm_length;
+    PyObject *obj = NULL;
+    Py_buffer view;
+    const int16_t *pcm = NULL;
     uint32_t sample_count;
     uint32_t channels;
     uint32_t sampling_rate;
 
-    if (!PyArg_ParseTuple(args, "i" BUF_TCS "iii", &friend_number,
-                          (uint8_t**)&pcm, &pcm_length, &sample_count, &channels, &sampling_rate)) {
+    if (!PyArg_ParseTuple(args, "iOiii", &friend_number, &obj, &sample_count, &channels,
+                          &sampling_rate)) {
+        return NULL;
+    }
+
+    /* the send format stays as it is until the frame is sent */
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->audio_send_lock);
+    Py_END_ALLOW_THREADS
+
+    if (self->audio_send_rate != 0 &&
+        (channels < 1 || channels > AUDIO_MAX_CHANNELS ||
+         sampling_rate < AUDIO_MIN_RATE || sampling_rate > AUDIO_MAX_RATE)) {
+        pthread_mutex_unlock(&self->audio_send_lock);
+        PyErr_SetString(PyExc_ValueError, "unsupported audio format");
+        return NULL;
+    }
+
+    /* as toxav would, before keeping any state for the friend */
+    Tox *tox = ((ToxCore*)self->core)->tox;
+    if (tox == NULL || !tox_friend_exists(tox, friend_number)) {
+        pthread_mutex_unlock(&self->audio_send_lock);
+        PyErr_Format(ToxOpError, "toxav audio send frame error: %d",
+                     TOXAV_ERR_SEND_FRAME_FRIEND_NOT_FOUND);
+        return NULL;
+    }
+
+    friend_audio *audio = get_friend_audio(self, friend_number);
+    if (audio == NULL ||
+        get_pcm(self, obj, &view, (size_t)sample_count * channels, &pcm) == -1) {
+        pthread_mutex_unlock(&self->audio_send_lock);
         return NULL;
     }
 
     TOXAV_ERR_SEND_FRAME err = 0;
-    bool ret = toxav_audio_send_frame(self->av, friend_number, pcm,
-                                      sample_count, channels, sampling_rate, &err);
+    bool ret = true;
+
+    if (self->audio_send_rate == 0) {
+        ret = send_gated(self, audio, friend_number, pcm, sample_count, channels,
+                         sampling_rate, &err);
+    } else {
+        ret = audio_send_converted(self, audio, friend_number, pcm, sample_count, channels,
+                                   sampling_rate, &err);
+    }
+    PyBuffer_Release(&view);
+    pthread_mutex_unlock(&self->audio_send_lock);
+
+    if (ret == false && PyErr_Occurred()) {
+        return NULL;
+    }
+
     if (ret == false) {
         PyErr_Format(ToxOpError, "toxav audio send frame error: %d", err);
         return NULL;
@@ -431,42 +1435,409 @@ ToxAVCore_audio_send_frame(ToxAVCore *self, PyObject* args)
     return PyBool_FromLong(ret);
 }
 
+/* Plane layout of a frame passed to video_send_frame. */
+typedef struct {
+    int count;
+    Py_buffer views[3];
+    const uint8_t *data[3];
+    int stride[3];
+    int row_bytes[3];
+    int rows[3];
+    int explicit_stride;    /* stride argument given */
+} send_planes;
+
+static void
+release_send_planes(send_planes *planes)
+{
+    int i;
+
+    for (i = 0; i < planes->count; i++) {
+        if (planes->views[i].obj != NULL) {
+            PyBuffer_Release(&planes->views[i]);
+        }
+    }
+}
+
+/* Fill in strides from *stride*: None or 0 for tightly packed rows, an int
+ * for a single plane or a sequence of one int per plane. */
+static int
+parse_send_strides(send_planes *planes, PyObject *stride)
+{
+    int i;
+
+    for (i = 0; i < planes->count; i++) {
+        planes->stride[i] = planes->row_bytes[i];
+    }
+
+    if (stride == NULL || stride == Py_None) {
+        return 0;
+    }
+
+    planes->explicit_stride = 1;
+    if (PyIndex_Check(stride)) {
+        Py_ssize_t value = PyNumber_AsSsize_t(stride, PyExc_OverflowError);
+        if (value == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (value == 0) {
+            planes->explicit_stride = 0;
+            return 0;
+        }
+        if (planes->count != 1) {
+            PyErr_SetString(PyExc_TypeError, "stride must give one value per plane");
+            return -1;
+        }
+        if (value < 0 || value > INT_MAX) {
+            PyErr_SetString(PyExc_ValueError, "stride out of range");
+            return -1;
+        }
+        planes->stride[0] = value;
+    } else {
+        PyObject *seq = PySequence_Fast(stride, "stride must be an int or a sequence");
+        if (seq == NULL) {
+            return -1;
+        }
+        if (PySequence_Fast_GET_SIZE(seq) != planes->count) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_ValueError, "stride must give one value per plane");
+            return -1;
+        }
+        for (i = 0; i < planes->count; i++) {
+            Py_ssize_t value = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(seq, i),
+                                                  PyExc_OverflowError);
+            if (value == -1 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                return -1;
+            }
+            if (value < 0 || value > INT_MAX) {
+                Py_DECREF(seq);
+                PyErr_SetString(PyExc_ValueError, "stride out of range");
+                return -1;
+            }
+            planes->stride[i] = value;
+        }
+        Py_DECREF(seq);
+    }
+
+    for (i = 0; i < planes->count; i++) {
+        if (planes->stride[i] < planes->row_bytes[i]) {
+            PyErr_SetString(PyExc_ValueError, "stride shorter than a row");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Check the buffer of plane *i*. C-contiguous buffers are plain bytes laid
+ * out by the stride argument, other arrays need contiguous rows and bring
+ * their own row stride. */
+static int
+check_send_plane(send_planes *planes, int i, Py_buffer *view)
+{
+    if (view->itemsize != 1) {
+        PyErr_SetString(PyExc_ValueError, "frame must hold 8 bit samples");
+        return -1;
+    }
+
+    if (PyBuffer_IsContiguous(view, 'C')) {
+        if (view->len < (Py_ssize_t)planes->stride[i] * (planes->rows[i] - 1) +
+            planes->row_bytes[i]) {
+            PyErr_Format(PyExc_ValueError, "plane %d smaller than stride * height", i);
+            return -1;
+        }
+        planes->data[i] = (const uint8_t*)view->buf;
+        return 0;
+    }
+
+    if (planes->explicit_stride) {
+        PyErr_SetString(PyExc_ValueError, "stride given for an array with its own strides");
+        return -1;
+    }
+
+    Py_ssize_t row = 1;
+    int k;
+    for (k = view->ndim - 1; k > 0; k--) {
+        if (view->strides[k] != row) {
+            PyErr_SetString(PyExc_ValueError, "rows of the frame must be contiguous");
+            return -1;
+        }
+        row *= view->shape[k];
+    }
+
+    if (view->ndim < 2 || view->shape[0] != planes->rows[i] || row != planes->row_bytes[i]) {
+        PyErr_Format(PyExc_ValueError, "plane %d shape does not match width and height", i);
+        return -1;
+    }
+    if (view->strides[0] < row || view->strides[0] > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError, "negative or overlapping rows are not supported");
+        return -1;
+    }
+
+    planes->stride[i] = view->strides[0];
+    planes->data[i] = (const uint8_t*)view->buf;
+
+    return 0;
+}
+
+/* Borrow the planes of *frame*: one buffer per plane, or a single buffer
+ * holding them back to back. */
+static int
+get_send_planes(send_planes *planes, PyObject *frame)
+{
+    int i;
+
+    if (planes->count > 1 && (PyTuple_Check(frame) || PyList_Check(frame))) {
+        if (PySequence_Size(frame) != planes->count) {
+            PyErr_Format(PyExc_ValueError, "frame must have %d planes", planes->count);
+            return -1;
+        }
+
+        for (i = 0; i < planes->count; i++) {
+            PyObject *item = PySequence_GetItem(frame, i);
+            if (item == NULL) {
+                return -1;
+            }
+            int ret = PyObject_GetBuffer(item, &planes->views[i], PyBUF_RECORDS_RO);
+            Py_DECREF(item);
+            if (ret == -1 || check_send_plane(planes, i, &planes->views[i]) == -1) {
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+
+    if (PyObject_GetBuffer(frame, &planes->views[0], PyBUF_RECORDS_RO) == -1) {
+        return -1;
+    }
+
+    if (planes->count == 1) {
+        return check_send_plane(planes, 0, &planes->views[0]);
+    }
+
+    if (planes->views[0].itemsize != 1 || !PyBuffer_IsContiguous(&planes->views[0], 'C')) {
+        PyErr_SetString(PyExc_ValueError,
+                        "planes in one buffer must be C-contiguous 8 bit samples");
+        return -1;
+    }
+
+    Py_ssize_t offset = 0;
+    for (i = 0; i < planes->count; i++) {
+        planes->data[i] = (const uint8_t*)planes->views[0].buf + offset;
+        offset += (Py_ssize_t)planes->stride[i] * planes->rows[i];
+    }
+
+    /* the last row of the last plane may stop at its end */
+    i = planes->count - 1;
+    if (planes->views[0].len < offset - planes->stride[i] + planes->row_bytes[i]) {
+        PyErr_SetString(PyExc_ValueError, "frame smaller than stride * height");
+        return -1;
+    }
+
+    return 0;
+}
+
 static PyObject*
-ToxAVCore_video_send_frame(ToxAVCore *self, PyObject* args)
+ToxAVCore_video_send_frame(ToxAVCore *self, PyObject* args, PyObject* kwds)
 {
+    static char *kwlist[] = {"friend_number", "width", "height", "frame", "stride",
+                             "matrix", "format", NULL};
+
+    uint32_t friend_number = 0, width = 0, height = 0;
+    PyObject *frame = NULL;
+    PyObject *stride = NULL;
+    int matrix = CONVERT_BT601;
+    int format = CONVERT_FORMAT_RGB;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iiiO|Oii", kwlist,
+                                     &friend_number, &width, &height, &frame,
+                                     &stride, &matrix, &format)) {
+        return NULL;
+    }
+
+    if (width == 0 || height == 0 || width > 65535 || height > 65535) {
+        PyErr_SetString(PyExc_ValueError, "invalid frame size");
+        return NULL;
+    }
+
+    if (matrix != CONVERT_BT601 && matrix != CONVERT_BT709) {
+        PyErr_SetString(PyExc_ValueError, "unknown color matrix");
+        return NULL;
+    }
+
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    send_planes planes;
+    memset(&planes, 0, sizeof(planes));
+
+    switch (format) {
+        case CONVERT_FORMAT_RGB:
+            planes.count = 1;
+            planes.row_bytes[0] = width * 3;
+            planes.rows[0] = height;
+            break;
+        case CONVERT_FORMAT_I420:
+            planes.count = 3;
+            planes.row_bytes[0] = width;
+            planes.rows[0] = height;
+            planes.row_bytes[1] = planes.row_bytes[2] = chroma_width;
+            planes.rows[1] = planes.rows[2] = chroma_height;
+            break;
+        case CONVERT_FORMAT_NV12:
+            planes.count = 2;
+            planes.row_bytes[0] = width;
+            planes.rows[0] = height;
+            planes.row_bytes[1] = chroma_width * 2;
+            planes.rows[1] = chroma_height;
+            break;
+        default:
+            PyErr_SetString(PyExc_ValueError, "frames can be sent as RGB, I420 or NV12");
+            return NULL;
+    }
+
+    if (parse_send_strides(&planes, stride) == -1 ||
+        get_send_planes(&planes, frame) == -1) {
+        release_send_planes(&planes);
+        return NULL;
+    }
 
-    uint32_t friend_number = 0, len = 0, width = 0, height = 0;
-    char* data = NULL;
+    /* the size set for this friend, if any */
+    uint32_t out_width = width, out_height = height;
+    if (friend_number < self->send_sizes_count && self->send_sizes[friend_number].width) {
+        out_width = self->send_sizes[friend_number].width;
+        out_height = self->send_sizes[friend_number].height;
+    }
+    int scale = out_width != width || out_height != height;
 
-    if (!PyArg_ParseTuple(args, "iii" BUF_TCS, &friend_number, &width, &height, &data, &len)) {
+    if (width > out_width * CONVERT_SCALE_MAX_RATIO ||
+        height > out_height * CONVERT_SCALE_MAX_RATIO) {
+        release_send_planes(&planes);
+        PyErr_Format(PyExc_ValueError, "frame more than %d times the size set for friend %u",
+                     CONVERT_SCALE_MAX_RATIO, friend_number);
         return NULL;
     }
 
-    if (self->in_image && (self->i_w != width || self->i_h != height)) {
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->video_send_lock);
+    Py_END_ALLOW_THREADS
+
+    if (self->in_image && (self->i_w != out_width || self->i_h != out_height)) {
         vpx_img_free(self->in_image);
         self->in_image = NULL;
     }
 
     if (self->in_image == NULL) {
-        self->i_w = width;
-        self->i_h = height;
-        self->in_image = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, width, height, 1);
+        self->i_w = out_width;
+        self->i_h = out_height;
+        self->in_image = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, out_width, out_height, 1);
+        if (self->in_image == NULL) {
+            pthread_mutex_unlock(&self->video_send_lock);
+            release_send_planes(&planes);
+            return PyErr_NoMemory();
+        }
+    }
+
+    /* toxav takes tightly packed planes, anything else is packed into
+     * in_image, whose own strides may be padded */
+    vpx_image_t *img = self->in_image;
+    uint8_t *scratch[3] = {img->planes[VPX_PLANE_Y], img->planes[VPX_PLANE_U],
+                           img->planes[VPX_PLANE_V]};
+    int out_chroma_width = (out_width + 1) / 2;
+    int out_chroma_height = (out_height + 1) / 2;
+    int tight[3] = {out_width, out_chroma_width, out_chroma_width};
+    const uint8_t *y = scratch[0];
+    const uint8_t *u = scratch[1];
+    const uint8_t *v = scratch[2];
+    int y_packed = planes.stride[0] == tight[0];
+    int failed = 0;
+
+    if (scale) {
+        /* scaled straight into in_image, RGB converted after scaling */
+        if (format == CONVERT_FORMAT_RGB) {
+            failed = convert_scale_rgb_to_i420(self->video_pool, self->scalers[0], width, height,
+                                               planes.data[0], planes.stride[0],
+                                               out_width, out_height,
+                                               scratch[0], scratch[1], scratch[2],
+                                               tight[0], tight[1], tight[2], matrix);
+        } else if (format == CONVERT_FORMAT_I420) {
+            int i;
+
+            for (i = 0; i < 3 && !failed; i++) {
+                failed = convert_scale_plane(self->video_pool, self->scalers[i ? 1 : 0], 1,
+                                             i ? chroma_width : (int)width,
+                                             i ? chroma_height : (int)height,
+                                             planes.data[i], planes.stride[i],
+                                             i ? out_chroma_width : (int)out_width,
+                                             i ? out_chroma_height : (int)out_height,
+                                             scratch[i], tight[i]);
+            }
+        } else {
+            failed = convert_scale_nv12_to_i420(self->video_pool, self->scalers[0],
+                                                self->scalers[1], width, height,
+                                                planes.data[0], planes.stride[0],
+                                                planes.data[1], planes.stride[1],
+                                                out_width, out_height,
+                                                scratch[0], tight[0], scratch[1], tight[1],
+                                                scratch[2], tight[2]);
+        }
+    } else if (format == CONVERT_FORMAT_RGB) {
+        convert_rgb_to_i420(self->video_pool, width, height,
+                            planes.data[0], planes.stride[0],
+                            scratch[0], scratch[1], scratch[2],
+                            tight[0], tight[1], tight[2], matrix);
+    } else if (format == CONVERT_FORMAT_I420) {
+        int i;
+        const uint8_t **targets[3] = {&y, &u, &v};
+
+        for (i = 0; i < 3; i++) {
+            if (planes.stride[i] == tight[i]) {
+                *targets[i] = planes.data[i];
+            } else {
+                convert_copy_plane(planes.row_bytes[i], planes.rows[i],
+                                   planes.data[i], planes.stride[i],
+                                   scratch[i], tight[i]);
+            }
+        }
+    } else {
+        if (y_packed) {
+            y = planes.data[0];
+        }
+        convert_nv12_to_i420(width, height, planes.data[0], planes.stride[0],
+                             planes.data[1], planes.stride[1],
+                             y_packed ? NULL : scratch[0], tight[0],
+                             scratch[1], tight[1], scratch[2], tight[2]);
     }
 
-    rgb_to_i420((unsigned char*)data, self->in_image);
+    if (failed) {
+        pthread_mutex_unlock(&self->video_send_lock);
+        release_send_planes(&planes);
+        return PyErr_NoMemory();
+    }
 
+    /* VP8 encodes with the GIL released, the planes kept by their views
+     * and video_send_lock */
     TOXAV_ERR_SEND_FRAME err = 0;
-    bool ret = toxav_video_send_frame(self->av, friend_number, width, height,
-                                      self->in_image->planes[0],
-                                      self->in_image->planes[1],
-                                      self->in_image->planes[2],
-                                      &err);
+    bool ret = false;
+    int state = ToxCore_begin_call((ToxCore*)self->core);
+    if (state == -1) {
+        pthread_mutex_unlock(&self->video_send_lock);
+        release_send_planes(&planes);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = toxav_video_send_frame(self->av, friend_number, out_width, out_height,
+                                 y, u, v, &err);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call((ToxCore*)self->core, state);
+    pthread_mutex_unlock(&self->video_send_lock);
+    release_send_planes(&planes);
+
     if (ret == false) {
         PyErr_Format(ToxOpError, "toxav video send frame error: %d", err);
         return NULL;
     }
     return PyBool_FromLong(ret);
-
 }
 
 static PyObject*
@@ -481,7 +1852,15 @@ ToxAVCore_answer(ToxAVCore *self, PyObject* args)
     }
 
     TOXAV_ERR_ANSWER err = 0;
-    bool ret = toxav_answer(self->av, friend_number, audio_bit_rate, video_bit_rate, &err);
+    bool ret = false;
+    int state = ToxCore_begin_call((ToxCore*)self->core);
+    if (state == -1) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ret = toxav_answer(self->av, friend_number, audio_bit_rate, video_bit_rate, &err);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call((ToxCore*)self->core, state);
     if (ret == false) {
         PyErr_Format(ToxOpError, "toxav answer error: %d", err);
         return NULL;
@@ -516,19 +1895,34 @@ static PyObject*
 ToxAVCore_group_send_audio(ToxAVCore *self, PyObject* args)
 {
     uint32_t group_number;
-    int16_t *pcm;
-    uint32_t length;
+    PyObject *obj = NULL;
+    Py_buffer view;
+    const int16_t *pcm = NULL;
     uint32_t samples;
     uint32_t channels;
     uint32_t sample_rate;
 
-    if (!PyArg_ParseTuple(args, "i" BUF_TCS "iii", &group_number, &pcm, &length,
+    if (!PyArg_ParseTuple(args, "iOiii", &group_number, &obj,
                           &samples, &channels, &sample_rate)) {
         return NULL;
     }
 
+    /* pcm_buffer is shared with audio_send_frame. The GIL stays held, as
+     * group chats live in the Tox instance, which tox_iterate changes
+     * unlocked. */
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->audio_send_lock);
+    Py_END_ALLOW_THREADS
+
+    if (get_pcm(self, obj, &view, (size_t)samples * channels, &pcm) == -1) {
+        pthread_mutex_unlock(&self->audio_send_lock);
+        return NULL;
+    }
+
     Tox *tox = ((ToxCore*)self->core)->tox;
     int ret = toxav_group_send_audio(tox, group_number, pcm, samples, channels, sample_rate);
+    PyBuffer_Release(&view);
+    pthread_mutex_unlock(&self->audio_send_lock);
     if (ret == -1) {
         PyErr_Format(ToxOpError, "toxav group send audio error.");
         return NULL;
@@ -554,7 +1948,29 @@ ToxAVCore_iteration_interval(ToxAVCore *self)
 static PyObject*
 ToxAVCore_iterate(ToxAVCore *self)
 {
+    ToxCore *core = (ToxCore*)self->core;
+
+    /* iterate_lock is held by the iterate() this was called from */
+    if (ToxCore_check_iterating(core, "iterate()") == -1) {
+        return NULL;
+    }
+
+    /* decoding runs with the GIL released, callbacks take it back and
+     * must not wait for this call by killing the Tox */
+    int state = ToxCore_begin_call(core);
+    if (state == -1) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&core->iterate_lock);
+    ToxCore_set_iterating(core, 1);
     toxav_iterate(self->av);
+    ToxCore_set_iterating(core, 0);
+    pthread_mutex_unlock(&core->iterate_lock);
+    Py_END_ALLOW_THREADS
+    ToxCore_end_call(core, state);
+
+    flush_group_mixes(self);
     Py_RETURN_NONE;
 }
 
@@ -589,15 +2005,153 @@ static PyMethodDef ToxAVCore_methods[] = {
     {
         "audio_send_frame", (PyCFunction)ToxAVCore_audio_send_frame, METH_VARARGS,
         "audio_send_frame(friend_number, pcm, sample_count, channels, sampling_rate)\n"
-        "Send an audio frame to a friend."
+        "Send an audio frame to a friend. *pcm* is bytes or any buffer of 16 "
+        "bit signed samples, such as an AudioFrame or a strided array, with "
+        "*channels* interleaved. After set_audio_send_format the frame is "
+        "converted first, and sent once a whole frame of the same duration "
+        "has been converted. Opus encodes with the GIL released, the buffer "
+        "held until it returns. "
         "Returns True on success.\n\n"
     },
     {
-        "video_send_frame", (PyCFunction)ToxAVCore_video_send_frame, METH_VARARGS,
-        "video_send_frame(friend_number, width, height, y, u, v)\n"
-        "Send a video frame to a friend."
+        "video_send_frame", (PyCFunction)ToxAVCore_video_send_frame,
+        METH_VARARGS | METH_KEYWORDS,
+        "video_send_frame(friend_number, width, height, frame, stride=None, "
+        "matrix=COLOR_BT601, format=VIDEO_FORMAT_RGB)\n"
+        "Send a video frame to a friend. With VIDEO_FORMAT_RGB *frame* is "
+        "packed 8 bit RGB, converted to I420 with the COLOR_BT601 or "
+        "COLOR_BT709 *matrix*. VIDEO_FORMAT_I420 and VIDEO_FORMAT_NV12 frames "
+        "are sent without conversion, given as a (y, u, v) or (y, uv) sequence "
+        "of buffers or as one buffer holding the planes back to back. "
+        "*stride* gives the bytes per row, one int per plane, and defaults to "
+        "tightly packed rows. Non-contiguous arrays, such as a crop of a "
+        "larger image, are taken as height x width rows with their own row "
+        "stride. Frames are scaled to the size set by set_video_send_size. "
+        "VP8 encodes with the GIL released, the frame held until it returns. "
         "Returns True on success.\n\n"
     },
+    {
+        "set_video_format", (PyCFunction)ToxAVCore_set_video_format,
+        METH_VARARGS | METH_KEYWORDS,
+        "set_video_format(format, borrow=False)\n"
+        "Choose the pixel layout of frames passed to on_video_receive_frame. "
+        "VIDEO_FORMAT_RGB, the default, VIDEO_FORMAT_BGR and VIDEO_FORMAT_RGBA "
+        "give packed pixels, VIDEO_FORMAT_I420 the Y, U and V planes and "
+        "VIDEO_FORMAT_NV12 the Y plane followed by interleaved UV rows, all "
+        "tightly packed. Frames are VideoFrame buffers which stay valid until "
+        "released or collected, after which their memory is reused for later "
+        "frames. Packed pixels are exported as height x width x bytes per "
+        "pixel, for array libraries to wrap without copying. With *borrow* "
+        "VIDEO_FORMAT_I420 frames are copied nowhere: they come as a (y, u, v) "
+        "tuple of read only memoryviews over toxav's planes, with their "
+        "strides, which are released when the callback returns.\n\n"
+    },
+    {
+        "set_audio_frames", (PyCFunction)ToxAVCore_set_audio_frames, METH_VARARGS,
+        "set_audio_frames(enabled)\n"
+        "Pass the pcm of on_audio_receive_frame, on_add_av_groupchat and "
+        "on_join_av_groupchat as AudioFrame buffers of sample_count x "
+        "channels 16 bit samples, which stay valid until released, instead "
+        "of bytes.\n\n"
+    },
+    {
+        "set_audio_send_format", (PyCFunction)ToxAVCore_set_audio_send_format, METH_VARARGS,
+        "set_audio_send_format(sampling_rate, channels)\n"
+        "Convert PCM given to audio_send_frame to *sampling_rate*, one of "
+        "8000, 12000, 16000, 24000 and 48000, and mono or stereo *channels* "
+        "before encoding, whatever it is given as. Each friend's stream is "
+        "resampled continuously, starting half a frame late so that a whole "
+        "frame is sent per call. 0, 0 sends PCM as given.\n\n"
+    },
+    {
+        "set_audio_receive_format", (PyCFunction)ToxAVCore_set_audio_receive_format,
+        METH_VARARGS,
+        "set_audio_receive_format(sampling_rate, channels)\n"
+        "Convert the PCM of on_audio_receive_frame to *sampling_rate*, "
+        "between 8000 and 96000, and mono or stereo *channels*, resampling "
+        "each friend's stream continuously. sample_count then varies by a "
+        "frame between calls. 0, 0 passes PCM on as decoded.\n\n"
+    },
+    {
+        "set_audio_jitter_buffer", (PyCFunction)ToxAVCore_set_audio_jitter_buffer,
+        METH_VARARGS,
+        "set_audio_jitter_buffer(target_ms, max_ms=target_ms + 120)\n"
+        "Buffer received audio per friend for audio_read instead of calling "
+        "on_audio_receive_frame. Playback of a friend starts once *target_ms* "
+        "of audio is buffered, and audio beyond *max_ms* is dropped down to "
+        "*target_ms* to bound latency. Needs set_audio_receive_format. 0 "
+        "turns the buffer off.\n\n"
+    },
+    {
+        "audio_read", (PyCFunction)ToxAVCore_audio_read, METH_VARARGS,
+        "audio_read(friend_number, sample_count)\n"
+        "Take exactly *sample_count* frames of a friend's audio from the "
+        "jitter buffer, in the format set by set_audio_receive_format, as "
+        "bytes or as an AudioFrame after set_audio_frames(True). Gaps are "
+        "concealed by fading out the last 10 ms played, after which the "
+        "buffer refills to target_ms before playing again.\n\n"
+    },
+    {
+        "get_audio_jitter_stats", (PyCFunction)ToxAVCore_get_audio_jitter_stats,
+        METH_VARARGS,
+        "get_audio_jitter_stats(friend_number)\n"
+        "Return a dict of a friend's jitter buffer counters, all in frames: "
+        "buffered, received, played, concealed and dropped, and the number "
+        "of underruns, times the buffer ran dry.\n\n"
+    },
+    {
+        "set_audio_gate", (PyCFunction)ToxAVCore_set_audio_gate, METH_VARARGS,
+        "set_audio_gate(friend_number, threshold_db, hangover_ms=200)\n"
+        "Hold back frames given to audio_send_frame for *friend_number* "
+        "whose RMS level is below *threshold_db* dBFS, between -90 and 0, "
+        "once *hangover_ms* have passed since the last frame above it, so "
+        "that silence costs neither encoding nor bandwidth. Held back frames "
+        "still count as sent. 0 sends every frame.\n\n"
+    },
+    {
+        "get_audio_levels", (PyCFunction)ToxAVCore_get_audio_levels, METH_VARARGS,
+        "get_audio_levels(friend_number)\n"
+        "Return a dict of the RMS and peak levels in dBFS of the last frame "
+        "sent to and received from a friend, send_rms, send_peak, "
+        "receive_rms and receive_peak, -inf for silence, whether the "
+        "friend's gate is sending, and the number of frames sent and "
+        "suppressed by it.\n\n"
+    },
+    {
+        "set_group_mixer", (PyCFunction)ToxAVCore_set_group_mixer,
+        METH_VARARGS | METH_KEYWORDS,
+        "set_group_mixer(groupnumber, sampling_rate, channels, send_to=-1)\n"
+        "Mix the audio of all peers of a group natively instead of calling "
+        "on_add_av_groupchat or on_join_av_groupchat per peer. Peers are "
+        "converted to *sampling_rate* and *channels*, scaled by their gain "
+        "and summed with saturating SIMD addition into 20 ms frames, which "
+        "iterate passes to on_group_mix(groupnumber, pcm, sample_count, "
+        "channels, sampling_rate), or sends to group *send_to* when it is "
+        "not -1, in which case *sampling_rate* must be an Opus rate. A frame "
+        "waits for every peer with audio queued to have a whole frame, but "
+        "no longer than 40 ms. 0, 0 turns the mixer off.\n\n"
+    },
+    {
+        "set_group_peer_gain", (PyCFunction)ToxAVCore_set_group_peer_gain, METH_VARARGS,
+        "set_group_peer_gain(groupnumber, peernumber, gain)\n"
+        "Scale a peer's audio in the group mix by *gain*, between 0, which "
+        "mutes the peer, and 4. Needs set_group_mixer.\n\n"
+    },
+    {
+        "set_video_send_size", (PyCFunction)ToxAVCore_set_video_send_size, METH_VARARGS,
+        "set_video_send_size(friend_number, width, height)\n"
+        "Scale frames given to video_send_frame for *friend_number* to "
+        "*width* x *height* before encoding, so that captures need not be "
+        "resized in Python. Shrinking by less than 2x is bilinear, by more averages the area of "
+        "each output pixel, up to 16x. 0 x 0 sends frames as given.\n\n"
+    },
+    {
+        "set_video_threads", (PyCFunction)ToxAVCore_set_video_threads, METH_VARARGS,
+        "set_video_threads(threads)\n"
+        "Convert video frames of 640x360 or more in bands of rows on *threads* "
+        "native threads, including the calling one. 1, the default, converts "
+        "every frame on the calling thread.\n\n"
+    },
     {
         "answer", (PyCFunction)ToxAVCore_answer, METH_VARARGS,
         "answer(friend_number, audio_bit_rate, video_bit_rate)\n"
@@ -621,7 +2175,9 @@ static PyMethodDef ToxAVCore_methods[] = {
         "iterate", (PyCFunction)ToxAVCore_iterate,
         METH_VARARGS,
         "iterate()\n"
-        "Main loop for the session."
+        "Main loop for the session. Decoding runs with the GIL released and "
+        "never overlaps Tox.iterate, so the two may run on separate threads, "
+        "but neither may be called from a callback of the other."
     },
     {
         "join_av_groupchat", (PyCFunction)ToxAVCore_join_av_groupchat, METH_VARARGS,
@@ -632,7 +2188,7 @@ static PyMethodDef ToxAVCore_methods[] = {
     {
         "group_send_audio", (PyCFunction)ToxAVCore_group_send_audio, METH_VARARGS,
         "group_send_audio(groupnumber, pcm, samples, channels, sample_rate)\n"
-        "Send audio to the group chat."
+        "Send audio to the group chat. *pcm* is taken as by audio_send_frame. "
         "Returns -1 on failure.\n\n"
     },
     {
@@ -712,5 +2268,20 @@ void ToxAVCore_install_dict()
     SET(CALL_CONTROL_SHOW_VIDEO);
 #undef SET
 
+#define SET_CONVERT(key, name)                              \
+    PyObject* obj_##name = PyLong_FromLong(CONVERT_##name); \
+    PyDict_SetItemString(dict, #key, obj_##name);           \
+    Py_DECREF(obj_##name);
+
+    SET_CONVERT(COLOR_BT601, BT601);
+    SET_CONVERT(COLOR_BT709, BT709);
+
+    SET_CONVERT(VIDEO_FORMAT_I420, FORMAT_I420);
+    SET_CONVERT(VIDEO_FORMAT_NV12, FORMAT_NV12);
+    SET_CONVERT(VIDEO_FORMAT_RGB, FORMAT_RGB);
+    SET_CONVERT(VIDEO_FORMAT_BGR, FORMAT_BGR);
+    SET_CONVERT(VIDEO_FORMAT_RGBA, FORMAT_RGBA);
+#undef SET_CONVERT
+
     ToxAVCoreType.tp_dict = dict;
 }
@@ -23,19 +23,73 @@
 #ifndef PYTOX_AV_H
 #define PYTOX_AV_H
 
+#include <pthread.h>
 #include <Python.h>
 #include <tox/toxav.h>
 #include <vpx/vpx_image.h>
 
+#include "audio.h"
+#include "convert.h"
+#include "frame.h"
+#include "mixer.h"
+#include "pool.h"
+
+/* Size frames sent to a friend are scaled to, 0 x 0 to send them as given. */
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+} send_size;
+
+/* Native audio state of one friend, created on first use. */
+typedef struct {
+    audio_converter send;       /* to the format set by set_audio_send_format */
+    audio_fifo send_fifo;       /* converted PCM short of a whole frame */
+    int send_primed;            /* send_fifo started with half a frame */
+    audio_converter receive;    /* to the format set by set_audio_receive_format */
+    audio_jitter jitter;        /* received PCM waiting for audio_read */
+    audio_gate gate;            /* meter and silence gate of sent frames */
+    audio_level receive_level;  /* of the last frame received */
+} friend_audio;
+
+/* Mixer of a group and where its frames go. */
+typedef struct {
+    group_mixer *mixer;         /* NULL for per peer on_*_av_groupchat calls */
+    int send_to;                /* group the mix is sent to, -1 for on_group_mix */
+} group_mix;
+
 /* ToxAV definition */
 typedef struct {
     PyObject_HEAD
     PyObject *core;
     ToxAV *av;
+    /* Encoders run with the GIL released, reading buffers these keep from
+     * being reused until they return: pcm_buffer and the send fifos, and
+     * in_image. Never waited for with the GIL held. */
+    pthread_mutex_t audio_send_lock;
+    pthread_mutex_t video_send_lock;
     uint32_t i_w, i_h;
-    unsigned char* out_image;
-    uint32_t o_w, o_h;
+    frame_pool *frames;     /* buffers of received video frames */
+    frame_pool *pcm_frames; /* buffers of received PCM */
+    int pcm_as_frames;      /* pass PCM as AudioFrame rather than bytes */
+    int16_t *pcm_buffer;    /* strided PCM gathered for sending */
+    size_t pcm_size;
+    int video_format;       /* convert_format handed to on_video_receive_frame */
+    int video_borrow;       /* I420 as views of toxav's planes, not copied */
     vpx_image_t *in_image;
+    pool_t *video_pool;     /* color conversion workers, NULL for none */
+    convert_scaler *scalers[2]; /* luma or RGB, and chroma of sent frames */
+    send_size *send_sizes;  /* indexed by friend number */
+    uint32_t send_sizes_count;
+    uint32_t audio_send_rate;   /* 0 to send PCM as given */
+    int audio_send_channels;
+    uint32_t audio_receive_rate; /* 0 to pass PCM on as decoded */
+    int audio_receive_channels;
+    uint32_t jitter_target_ms;  /* 0 to pass received PCM to Python as it comes */
+    uint32_t jitter_max_ms;
+    friend_audio **friend_audio; /* indexed by friend number */
+    uint32_t friend_audio_count;
+    group_mix *group_mixes;     /* indexed by group number */
+    uint32_t group_mix_count;
 } ToxAVCore;
 
 /* This needs to be extern as it's dynamically loaded by the Python interpreter. */
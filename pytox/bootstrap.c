@@ -0,0 +1,303 @@
+/**
+ * @file   bootstrap.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "bootstrap.h"
+#include "util.h"
+
+#define SCORES_HEADER "# pytox bootstrap scores v1\n"
+
+void bootstrap_free_nodes(struct bootstrap_node* nodes, size_t count)
+{
+  size_t i;
+
+  if (nodes == NULL) {
+    return;
+  }
+
+  for (i = 0; i < count; i++) {
+    free(nodes[i].host);
+  }
+  free(nodes);
+}
+
+void bootstrap_resolve_node(void* nodes, size_t index)
+{
+  struct bootstrap_node* node = (struct bootstrap_node*)nodes + index;
+  struct addrinfo hints;
+  struct addrinfo* result = NULL;
+  struct addrinfo* ai = NULL;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  if (getaddrinfo(node->host, NULL, &hints, &result) != 0) {
+    return;
+  }
+
+  /* prefer IPv4, which works whether toxcore has IPv6 enabled or not */
+  for (ai = result; ai != NULL; ai = ai->ai_next) {
+    if (ai->ai_family == AF_INET) {
+      break;
+    }
+  }
+  if (ai == NULL) {
+    ai = result;
+  }
+
+  node->resolved = getnameinfo(ai->ai_addr, ai->ai_addrlen, node->ip,
+      sizeof(node->ip), NULL, 0, NI_NUMERICHOST) == 0;
+  freeaddrinfo(result);
+}
+
+bootstrap_manager* bootstrap_manager_new(struct bootstrap_node* nodes,
+    size_t count, size_t batch_size, uint32_t timeout_ms, const char* path)
+{
+  bootstrap_manager* manager =
+    (bootstrap_manager*)calloc(1, sizeof(bootstrap_manager));
+  if (manager == NULL) {
+    return NULL;
+  }
+
+  if (path != NULL) {
+    manager->path = strdup(path);
+    if (manager->path == NULL) {
+      free(manager);
+      return NULL;
+    }
+  }
+
+  manager->nodes = nodes;
+  manager->count = count;
+  manager->batch_size = batch_size ? batch_size : 1;
+  manager->timeout_ms = timeout_ms;
+
+  return manager;
+}
+
+void bootstrap_manager_free(bootstrap_manager* manager)
+{
+  if (manager == NULL) {
+    return;
+  }
+
+  bootstrap_free_nodes(manager->nodes, manager->count);
+  free(manager->path);
+  free(manager);
+}
+
+void bootstrap_manager_load(bootstrap_manager* manager)
+{
+  if (manager->path == NULL) {
+    return;
+  }
+
+  FILE* fp = fopen(manager->path, "r");
+  if (fp == NULL) {
+    return;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char hex[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+    unsigned int port, attempts, successes, failures, connect_ms;
+    uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+
+    if (line[0] == '#' || sscanf(line, "%64s %u %u %u %u %u", hex, &port,
+          &attempts, &successes, &failures, &connect_ms) != 6 ||
+        strlen(hex) != TOX_PUBLIC_KEY_SIZE * 2) {
+      continue;
+    }
+
+    hex_string_to_bytes((uint8_t*)hex, TOX_PUBLIC_KEY_SIZE, public_key);
+
+    size_t i;
+    for (i = 0; i < manager->count; i++) {
+      struct bootstrap_node* node = &manager->nodes[i];
+      if (node->port == port &&
+          memcmp(node->public_key, public_key, TOX_PUBLIC_KEY_SIZE) == 0) {
+        node->attempts = attempts;
+        node->successes = successes;
+        node->failures = failures;
+        node->connect_ms = connect_ms;
+      }
+    }
+  }
+
+  fclose(fp);
+}
+
+char* bootstrap_manager_serialize(const bootstrap_manager* manager,
+    size_t* length)
+{
+  /* key, port and four 32 bit counters per line */
+  size_t size = sizeof(SCORES_HEADER) +
+    manager->count * (TOX_PUBLIC_KEY_SIZE * 2 + 6 + 4 * 11 + 1);
+  char* text = (char*)malloc(size);
+  if (text == NULL) {
+    return NULL;
+  }
+
+  size_t used = snprintf(text, size, "%s", SCORES_HEADER);
+  size_t i;
+  for (i = 0; i < manager->count; i++) {
+    const struct bootstrap_node* node = &manager->nodes[i];
+    uint8_t hex[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+
+    bytes_to_hex_string(node->public_key, TOX_PUBLIC_KEY_SIZE, hex);
+    used += snprintf(text + used, size - used, "%s %u %u %u %u %u\n", hex,
+        node->port, node->attempts, node->successes, node->failures,
+        node->connect_ms);
+  }
+
+  *length = used;
+
+  return text;
+}
+
+uint64_t bootstrap_node_score(const bootstrap_manager* manager,
+    const struct bootstrap_node* node)
+{
+  /* a node never seen connecting ranks as if it had timed out once */
+  uint64_t base = node->successes ? node->connect_ms : manager->timeout_ms;
+  return base * (1 + (uint64_t)node->failures);
+}
+
+void bootstrap_manager_order(const bootstrap_manager* manager, size_t* order)
+{
+  size_t i, j;
+
+  /* insertion sort, stable so equally healthy nodes keep the given order */
+  for (i = 0; i < manager->count; i++) {
+    uint64_t score = bootstrap_node_score(manager, &manager->nodes[i]);
+    for (j = i; j > 0 && bootstrap_node_score(manager,
+          &manager->nodes[order[j - 1]]) > score; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+}
+
+static void start_batch(bootstrap_manager* manager, Tox* tox, uint64_t now_ms)
+{
+  size_t* order = (size_t*)malloc((manager->count ? manager->count : 1) *
+      sizeof(size_t));
+  if (order == NULL) {
+    return;
+  }
+
+  bootstrap_manager_order(manager, order);
+
+  size_t i;
+  size_t picked = 0;
+  for (i = 0; i < manager->count; i++) {
+    manager->nodes[i].in_batch = 0;
+  }
+
+  for (i = 0; i < manager->count && picked < manager->batch_size; i++) {
+    struct bootstrap_node* node = &manager->nodes[order[i]];
+    if (!node->resolved) {
+      continue;
+    }
+
+    if (tox_bootstrap(tox, node->ip, node->port, node->public_key, NULL)) {
+      tox_add_tcp_relay(tox, node->ip, node->port, node->public_key, NULL);
+      node->in_batch = 1;
+      node->attempts++;
+      picked++;
+    }
+  }
+
+  free(order);
+
+  /* pending even if empty, so that it is retried once it times out */
+  manager->batch_pending = 1;
+  manager->batch_started_ms = now_ms;
+  manager->rebootstrap = 0;
+  manager->batches++;
+  manager->dirty = 1;
+}
+
+void bootstrap_manager_connection(bootstrap_manager* manager,
+    TOX_CONNECTION status, uint64_t now_ms)
+{
+  size_t i;
+
+  if (status == TOX_CONNECTION_NONE) {
+    if (manager->connected) {
+      manager->connected = 0;
+      manager->rebootstrap = 1;
+    }
+    return;
+  }
+
+  if (!manager->connected && manager->batch_pending) {
+    uint32_t elapsed = now_ms - manager->batch_started_ms;
+
+    for (i = 0; i < manager->count; i++) {
+      struct bootstrap_node* node = &manager->nodes[i];
+      if (!node->in_batch) {
+        continue;
+      }
+
+      node->connect_ms = node->successes ?
+        (node->connect_ms * 3 + elapsed) / 4 : elapsed;
+      node->successes++;
+      node->failures = 0;
+    }
+
+    manager->batch_pending = 0;
+    manager->dirty = 1;
+  }
+
+  manager->connected = 1;
+}
+
+int bootstrap_manager_due(const bootstrap_manager* manager, uint64_t now_ms)
+{
+  return manager->rebootstrap || (!manager->connected &&
+      manager->batch_pending &&
+      now_ms - manager->batch_started_ms >= manager->timeout_ms);
+}
+
+void bootstrap_manager_tick(bootstrap_manager* manager, Tox* tox,
+    uint64_t now_ms)
+{
+  size_t i;
+
+  if (manager->rebootstrap) {
+    start_batch(manager, tox, now_ms);
+  } else if (bootstrap_manager_due(manager, now_ms)) {
+    for (i = 0; i < manager->count; i++) {
+      if (manager->nodes[i].in_batch) {
+        manager->nodes[i].failures++;
+      }
+    }
+    start_batch(manager, tox, now_ms);
+  }
+}
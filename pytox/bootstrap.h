@@ -0,0 +1,107 @@
+/**
+ * @file   bootstrap.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_BOOTSTRAP_H
+#define PYTOX_BOOTSTRAP_H
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <tox/tox.h>
+
+/* A bootstrap node. Nothing here touches Python, so resolution may run
+ * without the GIL. */
+struct bootstrap_node {
+  char* host;
+  uint16_t port;
+  uint8_t public_key[TOX_PUBLIC_KEY_SIZE];
+  char ip[INET6_ADDRSTRLEN];
+  int resolved;
+
+  /* health, see bootstrap_manager */
+  uint32_t attempts;
+  uint32_t successes;
+  uint32_t failures;     /* consecutive batches which timed out */
+  uint32_t connect_ms;   /* moving average of the time to connect */
+  int in_batch;
+};
+
+void bootstrap_free_nodes(struct bootstrap_node* nodes, size_t count);
+
+/* pool_task resolving nodes[index] to a numeric address. */
+void bootstrap_resolve_node(void* nodes, size_t index);
+
+/* Bootstraps from the healthiest nodes a batch at a time. Each node is
+ * credited with the time it took the batch it was part of to get the
+ * instance connected, and penalized when a batch times out. */
+typedef struct {
+  struct bootstrap_node* nodes;
+  size_t count;
+  size_t batch_size;
+  uint32_t timeout_ms;
+
+  int connected;
+  int batch_pending;
+  int rebootstrap;
+  uint64_t batch_started_ms;
+  uint64_t batches;
+
+  /* scores to persist, NULL if not persisted */
+  char* path;
+  int dirty;
+} bootstrap_manager;
+
+/* Takes ownership of *nodes*. Returns NULL if out of memory. */
+bootstrap_manager* bootstrap_manager_new(struct bootstrap_node* nodes,
+    size_t count, size_t batch_size, uint32_t timeout_ms, const char* path);
+
+void bootstrap_manager_free(bootstrap_manager* manager);
+
+/* Merge scores saved by bootstrap_manager_serialize() from manager->path.
+ * A missing or malformed file is ignored. */
+void bootstrap_manager_load(bootstrap_manager* manager);
+
+/* Return the scores as a malloc()ed text, its length in *length*. */
+char* bootstrap_manager_serialize(const bootstrap_manager* manager,
+    size_t* length);
+
+/* Fill *order* with node indices, healthiest first. */
+void bootstrap_manager_order(const bootstrap_manager* manager, size_t* order);
+
+/* Expected time to connect through a node, lower is better. */
+uint64_t bootstrap_node_score(const bootstrap_manager* manager,
+    const struct bootstrap_node* node);
+
+/* Feed a self connection status change. */
+void bootstrap_manager_connection(bootstrap_manager* manager,
+    TOX_CONNECTION status, uint64_t now_ms);
+
+/* Whether the next bootstrap_manager_tick() starts a new batch, so that
+ * nodes which did not resolve can be resolved again first. */
+int bootstrap_manager_due(const bootstrap_manager* manager, uint64_t now_ms);
+
+/* Start a new batch when needed, to be called after every tox_iterate().
+ * A batch in which no node could be bootstrapped from is retried after
+ * timeout_ms like any other. */
+void bootstrap_manager_tick(bootstrap_manager* manager, Tox* tox,
+    uint64_t now_ms);
+
+#endif /* PYTOX_BOOTSTRAP_H */
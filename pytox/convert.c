@@ -0,0 +1,1767 @@
+/**
+ * @file   convert.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define CONVERT_X86
+# include <immintrin.h>
+# define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define CONVERT_NEON
+# include <arm_neon.h>
+#endif
+
+/* Pixels converted per chroma pass, keeping the chroma terms on the stack. */
+#define CHUNK 1024
+
+/* Converts one row of *width* pixels. cr, cg and cb hold the chroma terms
+ * added to luma for each pair of pixels, swapping cr and cb gives BGR. */
+typedef void (*rgb_row_fn)(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgb, int width);
+
+/* Interleaves *count* U and V samples. */
+typedef void (*uv_row_fn)(const uint8_t* u, const uint8_t* v, uint8_t* uv,
+    int count);
+
+/* The reverse. */
+typedef void (*uv_split_fn)(const uint8_t* uv, uint8_t* u, uint8_t* v,
+    int count);
+
+/* 8 bit fixed point RGB to Y'CbCr coefficients. */
+typedef struct {
+  int16_t yr, yg, yb;
+  int16_t ur, ug, ub;
+  int16_t vr, vg, vb;
+} matrix_coefficients;
+
+static const matrix_coefficients matrices[] = {
+  {66, 129, 25, -38, -74, 112, 112, -94, -18},   /* CONVERT_BT601 */
+  {47, 157, 16, -26, -87, 112, 112, -102, -10},  /* CONVERT_BT709 */
+};
+
+/* Converts two RGB rows of *width* pixels to two luma rows and one chroma
+ * row. The last row of an odd height comes as rgb0 == rgb1, y0 == y1. */
+typedef void (*i420_rows_fn)(const uint8_t* rgb0, const uint8_t* rgb1,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width,
+    const matrix_coefficients* m);
+
+/* Blends *taps* rows of *count* bytes, weights out of 256 summing to 256. */
+typedef void (*blend_rows_fn)(const uint8_t* const* rows,
+    const uint16_t* weights, int taps, uint8_t* out, int count);
+
+/* Resampling across a row of *channels* interleaved samples, by output
+ * byte: byte j blends the input bytes at offsets[j] + t * channels for the
+ * *taps* taps t, weighted out of 256 summing to 256, taps 2p and 2p + 1 by
+ * pairs[2 * (p * count + j)] and the next. The first *safe* bytes may be
+ * computed from 4 byte loads at every other tap, which stay inside the
+ * row. */
+typedef struct {
+  int channels;
+  int count;
+  int taps;
+  int safe;
+  int* offsets;
+  int16_t* pairs;
+} scale_filter;
+
+typedef void (*scale_row_fn)(const scale_filter* filter, const uint8_t* src,
+    uint8_t* out);
+
+typedef struct {
+  const char* name;
+  rgb_row_fn rgb_row;
+  rgb_row_fn rgba_row;
+  uv_row_fn uv_row;
+  uv_split_fn uv_split;
+  i420_rows_fn i420_rows;
+  blend_rows_fn blend_rows;
+  scale_row_fn scale_row;
+  int (*supported)(void);
+} kernel;
+
+/* Chroma terms, the integer BT.601 approximation toxav clients always used. */
+static int16_t table_rv[256];
+static int16_t table_gu[256];
+static int16_t table_gv[256];
+static int16_t table_bu[256];
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static const kernel* selected;
+
+static inline uint8_t clamp(int value)
+{
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static void rgb_row_scalar(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgb, int width)
+{
+  int x;
+
+  for (x = 0; x < width; x++) {
+    rgb[0] = clamp(y[x] + cr[x >> 1]);
+    rgb[1] = clamp(y[x] + cg[x >> 1]);
+    rgb[2] = clamp(y[x] + cb[x >> 1]);
+    rgb += 3;
+  }
+}
+
+static void rgba_row_scalar(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgba, int width)
+{
+  int x;
+
+  for (x = 0; x < width; x++) {
+    rgba[0] = clamp(y[x] + cr[x >> 1]);
+    rgba[1] = clamp(y[x] + cg[x >> 1]);
+    rgba[2] = clamp(y[x] + cb[x >> 1]);
+    rgba[3] = 0xff;
+    rgba += 4;
+  }
+}
+
+static void uv_row_scalar(const uint8_t* u, const uint8_t* v, uint8_t* uv,
+    int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    uv[2 * i] = u[i];
+    uv[2 * i + 1] = v[i];
+  }
+}
+
+static void uv_split_scalar(const uint8_t* uv, uint8_t* u, uint8_t* v,
+    int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    u[i] = uv[2 * i];
+    v[i] = uv[2 * i + 1];
+  }
+}
+
+static inline uint8_t luma(const uint8_t* pixel, const matrix_coefficients* m)
+{
+  return ((m->yr * pixel[0] + m->yg * pixel[1] + m->yb * pixel[2] + 128) >> 8)
+    + 16;
+}
+
+static void i420_rows_scalar(const uint8_t* rgb0, const uint8_t* rgb1,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width,
+    const matrix_coefficients* m)
+{
+  int x;
+
+  for (x = 0; x < width; x += 2) {
+    /* an odd last column pairs with itself */
+    int next = x + 1 < width ? 3 : 0;
+    const uint8_t* p0 = rgb0 + 3 * x;
+    const uint8_t* p1 = rgb1 + 3 * x;
+
+    y0[x] = luma(p0, m);
+    y1[x] = luma(p1, m);
+    if (next) {
+      y0[x + 1] = luma(p0 + next, m);
+      y1[x + 1] = luma(p1 + next, m);
+    }
+
+    int r = (p0[0] + p0[next] + p1[0] + p1[next] + 2) >> 2;
+    int g = (p0[1] + p0[next + 1] + p1[1] + p1[next + 1] + 2) >> 2;
+    int b = (p0[2] + p0[next + 2] + p1[2] + p1[next + 2] + 2) >> 2;
+
+    u[x / 2] = ((m->ur * r + m->ug * g + m->ub * b + 128) >> 8) + 128;
+    v[x / 2] = ((m->vr * r + m->vg * g + m->vb * b + 128) >> 8) + 128;
+  }
+}
+
+/* Bytes [begin, count) of a blend, the sum of weights bounding every
+ * accumulator to 16 bits. */
+static inline void blend_tail(const uint8_t* const* rows,
+    const uint16_t* weights, int taps, uint8_t* out, int begin, int count)
+{
+  int i, t;
+
+  for (i = begin; i < count; i++) {
+    unsigned sum = 128;
+    for (t = 0; t < taps; t++) {
+      sum += weights[t] * rows[t][i];
+    }
+    out[i] = sum >> 8;
+  }
+}
+
+static void blend_rows_scalar(const uint8_t* const* rows,
+    const uint16_t* weights, int taps, uint8_t* out, int count)
+{
+  blend_tail(rows, weights, taps, out, 0, count);
+}
+
+/* Bytes [begin, count) of a resampled row. */
+static inline void scale_tail(const scale_filter* filter,
+    const uint8_t* src, uint8_t* out, int begin)
+{
+  int j, t;
+
+  for (j = begin; j < filter->count; j++) {
+    const uint8_t* in = src + filter->offsets[j];
+    unsigned sum = 128;
+    for (t = 0; t < filter->taps; t++) {
+      sum += filter->pairs[2 * ((size_t)(t / 2) * filter->count + j) + t % 2] *
+        in[t * filter->channels];
+    }
+    out[j] = sum >> 8;
+  }
+}
+
+static void scale_row_scalar(const scale_filter* filter, const uint8_t* src,
+    uint8_t* out)
+{
+  scale_tail(filter, src, out, 0);
+}
+
+static int always(void)
+{
+  return 1;
+}
+
+#ifdef CONVERT_X86
+/* SSE2 has no byte shuffle, so 4 pixels of RGB0 in 32 bit lanes are packed
+ * into 12 bytes with shifts. */
+TARGET("sse2")
+static inline void store_rgb4_sse2(uint8_t* rgb, __m128i pixels)
+{
+  const __m128i first = _mm_set_epi64x(0x0000000000ffffffLL,
+      0x0000000000ffffffLL);
+  const __m128i second = _mm_set_epi64x(0x0000ffffff000000LL,
+      0x0000ffffff000000LL);
+
+  /* 6 bytes in each 64 bit lane, then the high lane next to the low one */
+  __m128i halves = _mm_or_si128(_mm_and_si128(pixels, first),
+      _mm_and_si128(_mm_srli_epi64(pixels, 8), second));
+  __m128i packed = _mm_or_si128(_mm_move_epi64(halves),
+      _mm_slli_si128(_mm_srli_si128(halves, 8), 6));
+
+  int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+  _mm_storel_epi64((__m128i*)rgb, packed);
+  memcpy(rgb + 8, &tail, sizeof(tail));
+}
+
+/* Add the chroma terms for 16 pixels to their luma and saturate to bytes. */
+TARGET("sse2")
+static inline __m128i channel_sse2(__m128i y0, __m128i y1, const int16_t* c)
+{
+  __m128i terms = _mm_loadu_si128((const __m128i*)c);
+  return _mm_packus_epi16(_mm_add_epi16(y0, _mm_unpacklo_epi16(terms, terms)),
+      _mm_add_epi16(y1, _mm_unpackhi_epi16(terms, terms)));
+}
+
+TARGET("sse2")
+static void rgb_row_sse2(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgb, int width)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i luma = _mm_loadu_si128((const __m128i*)(y + x));
+    __m128i y0 = _mm_unpacklo_epi8(luma, zero);
+    __m128i y1 = _mm_unpackhi_epi8(luma, zero);
+
+    __m128i r = channel_sse2(y0, y1, cr + x / 2);
+    __m128i g = channel_sse2(y0, y1, cg + x / 2);
+    __m128i b = channel_sse2(y0, y1, cb + x / 2);
+
+    __m128i rg0 = _mm_unpacklo_epi8(r, g);
+    __m128i rg1 = _mm_unpackhi_epi8(r, g);
+    __m128i b0 = _mm_unpacklo_epi8(b, zero);
+    __m128i b1 = _mm_unpackhi_epi8(b, zero);
+
+    uint8_t* out = rgb + 3 * x;
+    store_rgb4_sse2(out, _mm_unpacklo_epi16(rg0, b0));
+    store_rgb4_sse2(out + 12, _mm_unpackhi_epi16(rg0, b0));
+    store_rgb4_sse2(out + 24, _mm_unpacklo_epi16(rg1, b1));
+    store_rgb4_sse2(out + 36, _mm_unpackhi_epi16(rg1, b1));
+  }
+
+  rgb_row_scalar(y + x, cr + x / 2, cg + x / 2, cb + x / 2, rgb + 3 * x,
+      width - x);
+}
+
+TARGET("sse2")
+static void rgba_row_sse2(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgba, int width)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi8((char)0xff);
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i luma = _mm_loadu_si128((const __m128i*)(y + x));
+    __m128i y0 = _mm_unpacklo_epi8(luma, zero);
+    __m128i y1 = _mm_unpackhi_epi8(luma, zero);
+
+    __m128i r = channel_sse2(y0, y1, cr + x / 2);
+    __m128i g = channel_sse2(y0, y1, cg + x / 2);
+    __m128i b = channel_sse2(y0, y1, cb + x / 2);
+
+    __m128i rg0 = _mm_unpacklo_epi8(r, g);
+    __m128i rg1 = _mm_unpackhi_epi8(r, g);
+    __m128i ba0 = _mm_unpacklo_epi8(b, alpha);
+    __m128i ba1 = _mm_unpackhi_epi8(b, alpha);
+
+    __m128i* out = (__m128i*)(rgba + 4 * x);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(rg0, ba0));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg0, ba0));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg1, ba1));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg1, ba1));
+  }
+
+  rgba_row_scalar(y + x, cr + x / 2, cg + x / 2, cb + x / 2, rgba + 4 * x,
+      width - x);
+}
+
+TARGET("sse2")
+static void uv_row_sse2(const uint8_t* u, const uint8_t* v, uint8_t* uv,
+    int count)
+{
+  int i;
+
+  for (i = 0; i + 16 <= count; i += 16) {
+    __m128i cu = _mm_loadu_si128((const __m128i*)(u + i));
+    __m128i cv = _mm_loadu_si128((const __m128i*)(v + i));
+    _mm_storeu_si128((__m128i*)(uv + 2 * i), _mm_unpacklo_epi8(cu, cv));
+    _mm_storeu_si128((__m128i*)(uv + 2 * i + 16), _mm_unpackhi_epi8(cu, cv));
+  }
+
+  uv_row_scalar(u + i, v + i, uv + 2 * i, count - i);
+}
+
+TARGET("sse2")
+static void uv_split_sse2(const uint8_t* uv, uint8_t* u, uint8_t* v,
+    int count)
+{
+  const __m128i low = _mm_set1_epi16(0xff);
+  int i;
+
+  for (i = 0; i + 16 <= count; i += 16) {
+    __m128i pairs0 = _mm_loadu_si128((const __m128i*)(uv + 2 * i));
+    __m128i pairs1 = _mm_loadu_si128((const __m128i*)(uv + 2 * i + 16));
+    _mm_storeu_si128((__m128i*)(u + i), _mm_packus_epi16(
+          _mm_and_si128(pairs0, low), _mm_and_si128(pairs1, low)));
+    _mm_storeu_si128((__m128i*)(v + i), _mm_packus_epi16(
+          _mm_srli_epi16(pairs0, 8), _mm_srli_epi16(pairs1, 8)));
+  }
+
+  uv_split_scalar(uv + 2 * i, u + i, v + i, count - i);
+}
+
+TARGET("sse2")
+static void blend_rows_sse2(const uint8_t* const* rows,
+    const uint16_t* weights, int taps, uint8_t* out, int count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i, t;
+
+  for (i = 0; i + 16 <= count; i += 16) {
+    __m128i low = _mm_set1_epi16(128);
+    __m128i high = low;
+
+    for (t = 0; t < taps; t++) {
+      __m128i weight = _mm_set1_epi16(weights[t]);
+      __m128i pixels = _mm_loadu_si128((const __m128i*)(rows[t] + i));
+      low = _mm_add_epi16(low,
+          _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), weight));
+      high = _mm_add_epi16(high,
+          _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), weight));
+    }
+
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(
+          _mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+  }
+
+  blend_tail(rows, weights, taps, out, i, count);
+}
+
+/* Both taps of a pair, *step* bytes apart, as the bytes of a word. */
+static inline int tap_pair(const uint8_t* in, int step)
+{
+  return in[0] | in[step] << 8;
+}
+
+TARGET("sse2")
+static void scale_row_sse2(const scale_filter* filter, const uint8_t* src,
+    uint8_t* out)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int step = filter->channels;
+  int j, p;
+
+  for (j = 0; j + 8 <= filter->safe; j += 8) {
+    const int* offsets = filter->offsets + j;
+    __m128i low = _mm_set1_epi32(128);
+    __m128i high = low;
+
+    for (p = 0; 2 * p < filter->taps; p++) {
+      const uint8_t* in = src + 2 * p * step;
+      const __m128i* weights = (const __m128i*)(filter->pairs +
+          2 * ((size_t)p * filter->count + j));
+      __m128i pairs = _mm_setr_epi16(tap_pair(in + offsets[0], step),
+          tap_pair(in + offsets[1], step), tap_pair(in + offsets[2], step),
+          tap_pair(in + offsets[3], step), tap_pair(in + offsets[4], step),
+          tap_pair(in + offsets[5], step), tap_pair(in + offsets[6], step),
+          tap_pair(in + offsets[7], step));
+      low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi8(pairs, zero),
+            _mm_loadu_si128(weights)));
+      high = _mm_add_epi32(high, _mm_madd_epi16(
+            _mm_unpackhi_epi8(pairs, zero), _mm_loadu_si128(weights + 1)));
+    }
+
+    __m128i words = _mm_packs_epi32(_mm_srai_epi32(low, 8),
+        _mm_srai_epi32(high, 8));
+    _mm_storel_epi64((__m128i*)(out + j), _mm_packus_epi16(words, words));
+  }
+
+  scale_tail(filter, src, out, j);
+}
+
+static int has_sse2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+/* pshufb masks interleaving 16 R, G and B bytes into 48 RGB bytes, indexed
+ * by output vector and channel, and the reverse, indexed by channel and
+ * input vector. */
+static uint8_t interleave_masks[3][3][16];
+static uint8_t deinterleave_masks[3][3][16];
+
+static void init_shuffle_masks(void)
+{
+  int vector, channel, i;
+
+  for (vector = 0; vector < 3; vector++) {
+    for (channel = 0; channel < 3; channel++) {
+      for (i = 0; i < 16; i++) {
+        int byte = vector * 16 + i;
+        interleave_masks[vector][channel][i] =
+          byte % 3 == channel ? byte / 3 : 0x80;
+
+        byte = 3 * i + channel;
+        deinterleave_masks[channel][vector][i] =
+          byte / 16 == vector ? byte % 16 : 0x80;
+      }
+    }
+  }
+}
+
+/* Split 16 RGB pixels into one vector per channel. */
+TARGET("ssse3")
+static inline void load_rgb16_ssse3(const uint8_t* rgb, __m128i* channels)
+{
+  __m128i in0 = _mm_loadu_si128((const __m128i*)rgb);
+  __m128i in1 = _mm_loadu_si128((const __m128i*)(rgb + 16));
+  __m128i in2 = _mm_loadu_si128((const __m128i*)(rgb + 32));
+  int channel;
+
+  for (channel = 0; channel < 3; channel++) {
+    const __m128i* masks = (const __m128i*)deinterleave_masks[channel];
+    channels[channel] = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(in0, _mm_loadu_si128(masks)),
+          _mm_shuffle_epi8(in1, _mm_loadu_si128(masks + 1))),
+        _mm_shuffle_epi8(in2, _mm_loadu_si128(masks + 2)));
+  }
+}
+
+/* Products are taken modulo 2^16, which is exact as every sum fits. */
+TARGET("ssse3")
+static inline __m128i dot_ssse3(__m128i r, __m128i g, __m128i b, int16_t cr,
+    int16_t cg, int16_t cb)
+{
+  return _mm_add_epi16(
+      _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)),
+        _mm_mullo_epi16(g, _mm_set1_epi16(cg))),
+      _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(cb)),
+        _mm_set1_epi16(128)));
+}
+
+TARGET("ssse3")
+static inline __m128i luma8_ssse3(__m128i r, __m128i g, __m128i b,
+    const matrix_coefficients* m)
+{
+  return _mm_add_epi16(_mm_srli_epi16(dot_ssse3(r, g, b, m->yr, m->yg, m->yb),
+        8), _mm_set1_epi16(16));
+}
+
+TARGET("ssse3")
+static inline __m128i luma16_ssse3(const __m128i* channels,
+    const matrix_coefficients* m)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  return _mm_packus_epi16(
+      luma8_ssse3(_mm_unpacklo_epi8(channels[0], zero),
+        _mm_unpacklo_epi8(channels[1], zero),
+        _mm_unpacklo_epi8(channels[2], zero), m),
+      luma8_ssse3(_mm_unpackhi_epi8(channels[0], zero),
+        _mm_unpackhi_epi8(channels[1], zero),
+        _mm_unpackhi_epi8(channels[2], zero), m));
+}
+
+/* Rounded average of each 2x2 block of one channel. */
+TARGET("ssse3")
+static inline __m128i average_ssse3(__m128i row0, __m128i row1)
+{
+  const __m128i ones = _mm_set1_epi8(1);
+  __m128i sums = _mm_add_epi16(_mm_maddubs_epi16(row0, ones),
+      _mm_maddubs_epi16(row1, ones));
+
+  return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+TARGET("ssse3")
+static inline __m128i chroma_ssse3(__m128i r, __m128i g, __m128i b,
+    int16_t cr, int16_t cg, int16_t cb)
+{
+  return _mm_add_epi16(_mm_srai_epi16(dot_ssse3(r, g, b, cr, cg, cb), 8),
+      _mm_set1_epi16(128));
+}
+
+TARGET("ssse3")
+static void i420_rows_ssse3(const uint8_t* rgb0, const uint8_t* rgb1,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width,
+    const matrix_coefficients* m)
+{
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i row0[3], row1[3];
+
+    load_rgb16_ssse3(rgb0 + 3 * x, row0);
+    load_rgb16_ssse3(rgb1 + 3 * x, row1);
+
+    _mm_storeu_si128((__m128i*)(y0 + x), luma16_ssse3(row0, m));
+    _mm_storeu_si128((__m128i*)(y1 + x), luma16_ssse3(row1, m));
+
+    __m128i r = average_ssse3(row0[0], row1[0]);
+    __m128i g = average_ssse3(row0[1], row1[1]);
+    __m128i b = average_ssse3(row0[2], row1[2]);
+    __m128i cu = chroma_ssse3(r, g, b, m->ur, m->ug, m->ub);
+    __m128i cv = chroma_ssse3(r, g, b, m->vr, m->vg, m->vb);
+
+    _mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(cu, cu));
+    _mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(cv, cv));
+  }
+
+  i420_rows_scalar(rgb0 + 3 * x, rgb1 + 3 * x, y0 + x, y1 + x, u + x / 2,
+      v + x / 2, width - x, m);
+}
+
+static int has_ssse3(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+}
+
+TARGET("avx2")
+static inline void store_rgb16_avx2(uint8_t* rgb, __m128i r, __m128i g,
+    __m128i b)
+{
+  int out;
+
+  for (out = 0; out < 3; out++) {
+    const __m128i* masks = (const __m128i*)interleave_masks[out];
+    __m128i bytes = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(r, _mm_loadu_si128(masks)),
+          _mm_shuffle_epi8(g, _mm_loadu_si128(masks + 1))),
+        _mm_shuffle_epi8(b, _mm_loadu_si128(masks + 2)));
+    _mm_storeu_si128((__m128i*)(rgb + 16 * out), bytes);
+  }
+}
+
+/* Repeat each of 8 chroma terms for the two pixels sharing it. */
+TARGET("avx2")
+static inline __m256i duplicate_avx2(const int16_t* c)
+{
+  __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)c));
+  return _mm256_or_si256(wide, _mm256_slli_epi32(wide, 16));
+}
+
+TARGET("avx2")
+static inline __m256i channel_avx2(__m256i y0, __m256i y1, const int16_t* c)
+{
+  __m256i bytes = _mm256_packus_epi16(
+      _mm256_add_epi16(y0, duplicate_avx2(c)),
+      _mm256_add_epi16(y1, duplicate_avx2(c + 8)));
+
+  /* packus works within 128 bit lanes */
+  return _mm256_permute4x64_epi64(bytes, 0xd8);
+}
+
+TARGET("avx2")
+static void rgb_row_avx2(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgb, int width)
+{
+  int x;
+
+  for (x = 0; x + 32 <= width; x += 32) {
+    __m256i y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x)));
+    __m256i y1 = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128((const __m128i*)(y + x + 16)));
+
+    __m256i r = channel_avx2(y0, y1, cr + x / 2);
+    __m256i g = channel_avx2(y0, y1, cg + x / 2);
+    __m256i b = channel_avx2(y0, y1, cb + x / 2);
+
+    store_rgb16_avx2(rgb + 3 * x, _mm256_castsi256_si128(r),
+        _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+    store_rgb16_avx2(rgb + 3 * x + 48, _mm256_extracti128_si256(r, 1),
+        _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(b, 1));
+  }
+
+  rgb_row_sse2(y + x, cr + x / 2, cg + x / 2, cb + x / 2, rgb + 3 * x,
+      width - x);
+}
+
+TARGET("avx2")
+static inline __m256i dot_avx2(__m256i r, __m256i g, __m256i b, int16_t cr,
+    int16_t cg, int16_t cb)
+{
+  return _mm256_add_epi16(
+      _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(cr)),
+        _mm256_mullo_epi16(g, _mm256_set1_epi16(cg))),
+      _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(cb)),
+        _mm256_set1_epi16(128)));
+}
+
+/* Luma of 16 pixels, as 16 bit lanes. */
+TARGET("avx2")
+static inline __m256i luma16_avx2(const __m128i* channels,
+    const matrix_coefficients* m)
+{
+  __m256i sum = dot_avx2(_mm256_cvtepu8_epi16(channels[0]),
+      _mm256_cvtepu8_epi16(channels[1]), _mm256_cvtepu8_epi16(channels[2]),
+      m->yr, m->yg, m->yb);
+
+  return _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+}
+
+TARGET("avx2")
+static inline __m256i combine_avx2(__m128i low, __m128i high)
+{
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+}
+
+/* Rounded average of the 2x2 blocks of 32 pixels of one channel. */
+TARGET("avx2")
+static inline __m256i average_avx2(const __m128i* row0, const __m128i* row1,
+    int channel)
+{
+  const __m256i ones = _mm256_set1_epi8(1);
+  __m256i sums = _mm256_add_epi16(
+      _mm256_maddubs_epi16(combine_avx2(row0[channel], row0[channel + 3]),
+        ones),
+      _mm256_maddubs_epi16(combine_avx2(row1[channel], row1[channel + 3]),
+        ones));
+
+  return _mm256_srli_epi16(_mm256_add_epi16(sums, _mm256_set1_epi16(2)), 2);
+}
+
+/* 16 chroma samples packed into bytes. */
+TARGET("avx2")
+static inline __m128i chroma_avx2(__m256i r, __m256i g, __m256i b,
+    int16_t cr, int16_t cg, int16_t cb)
+{
+  __m256i chroma = _mm256_add_epi16(
+      _mm256_srai_epi16(dot_avx2(r, g, b, cr, cg, cb), 8),
+      _mm256_set1_epi16(128));
+  __m256i bytes = _mm256_permute4x64_epi64(
+      _mm256_packus_epi16(chroma, chroma), 0xd8);
+
+  return _mm256_castsi256_si128(bytes);
+}
+
+TARGET("avx2")
+static void i420_rows_avx2(const uint8_t* rgb0, const uint8_t* rgb1,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width,
+    const matrix_coefficients* m)
+{
+  int x;
+
+  for (x = 0; x + 32 <= width; x += 32) {
+    /* R, G, B of the first 16 pixels, then of the next 16 */
+    __m128i row0[6], row1[6];
+
+    load_rgb16_ssse3(rgb0 + 3 * x, row0);
+    load_rgb16_ssse3(rgb0 + 3 * x + 48, row0 + 3);
+    load_rgb16_ssse3(rgb1 + 3 * x, row1);
+    load_rgb16_ssse3(rgb1 + 3 * x + 48, row1 + 3);
+
+    _mm256_storeu_si256((__m256i*)(y0 + x), _mm256_permute4x64_epi64(
+          _mm256_packus_epi16(luma16_avx2(row0, m), luma16_avx2(row0 + 3, m)),
+          0xd8));
+    _mm256_storeu_si256((__m256i*)(y1 + x), _mm256_permute4x64_epi64(
+          _mm256_packus_epi16(luma16_avx2(row1, m), luma16_avx2(row1 + 3, m)),
+          0xd8));
+
+    __m256i r = average_avx2(row0, row1, 0);
+    __m256i g = average_avx2(row0, row1, 1);
+    __m256i b = average_avx2(row0, row1, 2);
+
+    _mm_storeu_si128((__m128i*)(u + x / 2),
+        chroma_avx2(r, g, b, m->ur, m->ug, m->ub));
+    _mm_storeu_si128((__m128i*)(v + x / 2),
+        chroma_avx2(r, g, b, m->vr, m->vg, m->vb));
+  }
+
+  i420_rows_ssse3(rgb0 + 3 * x, rgb1 + 3 * x, y0 + x, y1 + x, u + x / 2,
+      v + x / 2, width - x, m);
+}
+
+TARGET("avx2")
+static void blend_rows_avx2(const uint8_t* const* rows,
+    const uint16_t* weights, int taps, uint8_t* out, int count)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  int i, t;
+
+  for (i = 0; i + 32 <= count; i += 32) {
+    __m256i low = _mm256_set1_epi16(128);
+    __m256i high = low;
+
+    /* unpacking and packing within lanes cancel out */
+    for (t = 0; t < taps; t++) {
+      __m256i weight = _mm256_set1_epi16(weights[t]);
+      __m256i pixels = _mm256_loadu_si256((const __m256i*)(rows[t] + i));
+      low = _mm256_add_epi16(low,
+          _mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), weight));
+      high = _mm256_add_epi16(high,
+          _mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), weight));
+    }
+
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(
+          _mm256_srli_epi16(low, 8), _mm256_srli_epi16(high, 8)));
+  }
+
+  blend_tail(rows, weights, taps, out, i, count);
+}
+
+/* Gathers the 4 bytes from each tap pair's first tap, moving the second
+ * tap to the high word. */
+TARGET("avx2")
+static void scale_row_avx2(const scale_filter* filter, const uint8_t* src,
+    uint8_t* out)
+{
+  const __m256i low_byte = _mm256_set1_epi32(0xff);
+  const __m256i third_byte = _mm256_set1_epi32(0xff0000);
+  int step = filter->channels;
+  const __m128i shift = _mm_cvtsi32_si128(step > 1 ? 8 * step - 16 : 0);
+  int j, p;
+
+  for (j = 0; j + 8 <= filter->safe; j += 8) {
+    __m256i offsets = _mm256_loadu_si256((const __m256i*)(filter->offsets +
+          j));
+    __m256i sum = _mm256_set1_epi32(128);
+
+    for (p = 0; 2 * p < filter->taps; p++) {
+      __m256i bytes = _mm256_i32gather_epi32(
+          (const int*)(src + 2 * p * step), offsets, 1);
+      __m256i second = step > 1 ? _mm256_srl_epi32(bytes, shift) :
+        _mm256_slli_epi32(bytes, 8);
+      __m256i pairs = _mm256_or_si256(_mm256_and_si256(bytes, low_byte),
+          _mm256_and_si256(second, third_byte));
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs,
+            _mm256_loadu_si256((const __m256i*)(filter->pairs +
+                2 * ((size_t)p * filter->count + j)))));
+    }
+
+    /* packing within lanes leaves 4 bytes at the start of each */
+    sum = _mm256_srai_epi32(sum, 8);
+    sum = _mm256_packs_epi32(sum, sum);
+    sum = _mm256_packus_epi16(sum, sum);
+    _mm_storel_epi64((__m128i*)(out + j), _mm_unpacklo_epi32(
+          _mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+  }
+
+  scale_tail(filter, src, out, j);
+}
+
+static int has_avx2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif /* CONVERT_X86 */
+
+#ifdef CONVERT_NEON
+static inline uint8x16_t channel_neon(int16x8_t y0, int16x8_t y1,
+    const int16_t* c)
+{
+  int16x8_t terms = vld1q_s16(c);
+  int16x8x2_t pairs = vzipq_s16(terms, terms);
+
+  return vcombine_u8(vqmovun_s16(vaddq_s16(y0, pairs.val[0])),
+      vqmovun_s16(vaddq_s16(y1, pairs.val[1])));
+}
+
+static void rgb_row_neon(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgb, int width)
+{
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    uint8x16_t luma = vld1q_u8(y + x);
+    int16x8_t y0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(luma)));
+    int16x8_t y1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(luma)));
+    uint8x16x3_t pixels;
+
+    pixels.val[0] = channel_neon(y0, y1, cr + x / 2);
+    pixels.val[1] = channel_neon(y0, y1, cg + x / 2);
+    pixels.val[2] = channel_neon(y0, y1, cb + x / 2);
+    vst3q_u8(rgb + 3 * x, pixels);
+  }
+
+  rgb_row_scalar(y + x, cr + x / 2, cg + x / 2, cb + x / 2, rgb + 3 * x,
+      width - x);
+}
+static inline int16x8_t dot_neon(int16x8_t r, int16x8_t g, int16x8_t b,
+    int16_t cr, int16_t cg, int16_t cb)
+{
+  int16x8_t sum = vmlaq_n_s16(vdupq_n_s16(128), r, cr);
+  sum = vmlaq_n_s16(sum, g, cg);
+  return vmlaq_n_s16(sum, b, cb);
+}
+
+static inline uint8x16_t luma16_neon(uint8x16x3_t pixels,
+    const matrix_coefficients* m)
+{
+  uint8x8_t halves[2];
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    uint8x8_t r = i ? vget_high_u8(pixels.val[0]) : vget_low_u8(pixels.val[0]);
+    uint8x8_t g = i ? vget_high_u8(pixels.val[1]) : vget_low_u8(pixels.val[1]);
+    uint8x8_t b = i ? vget_high_u8(pixels.val[2]) : vget_low_u8(pixels.val[2]);
+    int16x8_t sum = dot_neon(vreinterpretq_s16_u16(vmovl_u8(r)),
+        vreinterpretq_s16_u16(vmovl_u8(g)), vreinterpretq_s16_u16(vmovl_u8(b)),
+        m->yr, m->yg, m->yb);
+    halves[i] = vmovn_u16(vaddq_u16(
+          vshrq_n_u16(vreinterpretq_u16_s16(sum), 8), vdupq_n_u16(16)));
+  }
+
+  return vcombine_u8(halves[0], halves[1]);
+}
+
+static inline int16x8_t average_neon(uint8x16_t row0, uint8x16_t row1)
+{
+  uint16x8_t sums = vaddq_u16(vpaddlq_u8(row0), vpaddlq_u8(row1));
+  return vreinterpretq_s16_u16(vrshrq_n_u16(sums, 2));
+}
+
+static inline uint8x8_t chroma_neon(int16x8_t r, int16x8_t g, int16x8_t b,
+    int16_t cr, int16_t cg, int16_t cb)
+{
+  int16x8_t chroma = vaddq_s16(vshrq_n_s16(dot_neon(r, g, b, cr, cg, cb), 8),
+      vdupq_n_s16(128));
+  return vqmovun_s16(chroma);
+}
+
+static void i420_rows_neon(const uint8_t* rgb0, const uint8_t* rgb1,
+    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width,
+    const matrix_coefficients* m)
+{
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    uint8x16x3_t row0 = vld3q_u8(rgb0 + 3 * x);
+    uint8x16x3_t row1 = vld3q_u8(rgb1 + 3 * x);
+
+    vst1q_u8(y0 + x, luma16_neon(row0, m));
+    vst1q_u8(y1 + x, luma16_neon(row1, m));
+
+    int16x8_t r = average_neon(row0.val[0], row1.val[0]);
+    int16x8_t g = average_neon(row0.val[1], row1.val[1]);
+    int16x8_t b = average_neon(row0.val[2], row1.val[2]);
+
+    vst1_u8(u + x / 2, chroma_neon(r, g, b, m->ur, m->ug, m->ub));
+    vst1_u8(v + x / 2, chroma_neon(r, g, b, m->vr, m->vg, m->vb));
+  }
+
+  i420_rows_scalar(rgb0 + 3 * x, rgb1 + 3 * x, y0 + x, y1 + x, u + x / 2,
+      v + x / 2, width - x, m);
+}
+static void rgba_row_neon(const uint8_t* y, const int16_t* cr,
+    const int16_t* cg, const int16_t* cb, uint8_t* rgba, int width)
+{
+  int x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    uint8x16_t luma = vld1q_u8(y + x);
+    int16x8_t y0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(luma)));
+    int16x8_t y1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(luma)));
+    uint8x16x4_t pixels;
+
+    pixels.val[0] = channel_neon(y0, y1, cr + x / 2);
+    pixels.val[1] = channel_neon(y0, y1, cg + x / 2);
+    pixels.val[2] = channel_neon(y0, y1, cb + x / 2);
+    pixels.val[3] = vdupq_n_u8(0xff);
+    vst4q_u8(rgba + 4 * x, pixels);
+  }
+
+  rgba_row_scalar(y + x, cr + x / 2, cg + x / 2, cb + x / 2, rgba + 4 * x,
+      width - x);
+}
+
+static void uv_row_neon(const uint8_t* u, const uint8_t* v, uint8_t* uv,
+    int count)
+{
+  int i;
+
+  for (i = 0; i + 16 <= count; i += 16) {
+    uint8x16x2_t pairs;
+    pairs.val[0] = vld1q_u8(u + i);
+    pairs.val[1] = vld1q_u8(v + i);
+    vst2q_u8(uv + 2 * i, pairs);
+  }
+
+  uv_row_scalar(u + i, v + i, uv + 2 * i, count - i);
+}
+static void uv_split_neon(const uint8_t* uv, uint8_t* u, uint8_t* v,
+    int count)
+{
+  int i;
+
+  for (i = 0; i + 16 <= count; i += 16) {
+    uint8x16x2_t pairs = vld2q_u8(uv + 2 * i);
+    vst1q_u8(u + i, pairs.val[0]);
+    vst1q_u8(v + i, pairs.val[1]);
+  }
+
+  uv_split_scalar(uv + 2 * i, u + i, v + i, count - i);
+}
+
+static void blend_rows_neon(const uint8_t* const* rows,
+    const uint16_t* weights, int taps, uint8_t* out, int count)
+{
+  int i, t;
+
+  for (i = 0; i + 16 <= count; i += 16) {
+    uint16x8_t low = vdupq_n_u16(128);
+    uint16x8_t high = low;
+
+    for (t = 0; t < taps; t++) {
+      uint16x8_t weight = vdupq_n_u16(weights[t]);
+      uint8x16_t pixels = vld1q_u8(rows[t] + i);
+      low = vmlaq_u16(low, vmovl_u8(vget_low_u8(pixels)), weight);
+      high = vmlaq_u16(high, vmovl_u8(vget_high_u8(pixels)), weight);
+    }
+
+    vst1q_u8(out + i, vcombine_u8(vshrn_n_u16(low, 8),
+          vshrn_n_u16(high, 8)));
+  }
+
+  blend_tail(rows, weights, taps, out, i, count);
+}
+
+static void scale_row_neon(const scale_filter* filter, const uint8_t* src,
+    uint8_t* out)
+{
+  int step = filter->channels;
+  int j, p, k;
+
+  for (j = 0; j + 8 <= filter->safe; j += 8) {
+    const int* offsets = filter->offsets + j;
+    uint16x8_t sum = vdupq_n_u16(128);
+
+    for (p = 0; 2 * p < filter->taps; p++) {
+      const uint8_t* in = src + 2 * p * step;
+      uint8_t first[8], second[8];
+      for (k = 0; k < 8; k++) {
+        first[k] = in[offsets[k]];
+        second[k] = in[offsets[k] + step];
+      }
+
+      uint16x8x2_t weights = vld2q_u16((const uint16_t*)filter->pairs +
+          2 * ((size_t)p * filter->count + j));
+      sum = vmlaq_u16(sum, vmovl_u8(vld1_u8(first)), weights.val[0]);
+      sum = vmlaq_u16(sum, vmovl_u8(vld1_u8(second)), weights.val[1]);
+    }
+
+    vst1_u8(out + j, vshrn_n_u16(sum, 8));
+  }
+
+  scale_tail(filter, src, out, j);
+}
+#endif /* CONVERT_NEON */
+
+/* Best first. */
+static const kernel kernels[] = {
+#ifdef CONVERT_X86
+  {"avx2", rgb_row_avx2, rgba_row_sse2, uv_row_sse2, uv_split_sse2,
+    i420_rows_avx2, blend_rows_avx2, scale_row_avx2, has_avx2},
+  {"ssse3", rgb_row_sse2, rgba_row_sse2, uv_row_sse2, uv_split_sse2,
+    i420_rows_ssse3, blend_rows_sse2, scale_row_sse2, has_ssse3},
+  {"sse2", rgb_row_sse2, rgba_row_sse2, uv_row_sse2, uv_split_sse2,
+    i420_rows_scalar, blend_rows_sse2, scale_row_sse2, has_sse2},
+#endif
+#ifdef CONVERT_NEON
+  {"neon", rgb_row_neon, rgba_row_neon, uv_row_neon, uv_split_neon,
+    i420_rows_neon, blend_rows_neon, scale_row_neon, always},
+#endif
+  {"scalar", rgb_row_scalar, rgba_row_scalar, uv_row_scalar, uv_split_scalar,
+    i420_rows_scalar, blend_rows_scalar, scale_row_scalar, always},
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+static void init(void)
+{
+  int i;
+  size_t k;
+
+  for (i = 0; i < 256; i++) {
+    table_rv[i] = (351 * (i - 128)) / 256;
+    table_gu[i] = -(86 * (i - 128)) / 256;
+    table_gv[i] = -(179 * (i - 128)) / 256;
+    table_bu[i] = (444 * (i - 128)) / 256;
+  }
+
+#ifdef CONVERT_X86
+  init_shuffle_masks();
+#endif
+
+  for (k = 0; k < KERNEL_COUNT; k++) {
+    if (kernels[k].supported()) {
+      selected = &kernels[k];
+      break;
+    }
+  }
+}
+
+const char* convert_kernel(void)
+{
+  pthread_once(&init_once, init);
+  return selected->name;
+}
+
+int convert_set_kernel(const char* name)
+{
+  size_t k;
+
+  pthread_once(&init_once, init);
+
+  for (k = 0; k < KERNEL_COUNT; k++) {
+    if (strcmp(kernels[k].name, name) == 0 && kernels[k].supported()) {
+      selected = &kernels[k];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* Rows per band, even so that no chroma row is shared, and how many bands
+ * a frame is split into. */
+static int band_rows(pool_t* pool, int64_t pixels, int height, size_t* bands)
+{
+  if (pool == NULL || pool_size(pool) == 0 ||
+      pixels < CONVERT_POOL_MIN_PIXELS) {
+    *bands = 1;
+    return height;
+  }
+
+  int threads = pool_size(pool) + 1;
+  int rows = ((height + 1) / 2 + threads - 1) / threads * 2;
+  *bands = (height + rows - 1) / rows;
+
+  return rows;
+}
+
+size_t convert_frame_size(convert_format format, int width, int height)
+{
+  size_t pixels = (size_t)width * height;
+
+  switch (format) {
+    case CONVERT_FORMAT_I420:
+    case CONVERT_FORMAT_NV12:
+      return pixels + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    case CONVERT_FORMAT_RGBA:
+      return pixels * 4;
+    default:
+      return pixels * 3;
+  }
+}
+
+typedef struct {
+  int width, height, band_rows;
+  const uint8_t *y, *u, *v;
+  int ystride, ustride, vstride;
+  uint8_t* out;
+  int stride;
+  int bytes_per_pixel;
+  int swap;  /* BGR */
+  rgb_row_fn row;
+} i420_to_packed_job;
+
+static void i420_to_packed_band(void* arg, size_t index)
+{
+  const i420_to_packed_job* job = (const i420_to_packed_job*)arg;
+  int16_t cr[CHUNK / 2];
+  int16_t cg[CHUNK / 2];
+  int16_t cb[CHUNK / 2];
+  const int16_t* first = job->swap ? cb : cr;
+  const int16_t* third = job->swap ? cr : cb;
+  int begin = index * job->band_rows;
+  int end = begin + job->band_rows < job->height ?
+    begin + job->band_rows : job->height;
+  int row, x, i;
+
+  for (row = begin; row < end; row += 2) {
+    const uint8_t* src_y = job->y + (ptrdiff_t)row * job->ystride;
+    const uint8_t* src_u = job->u + (ptrdiff_t)(row / 2) * job->ustride;
+    const uint8_t* src_v = job->v + (ptrdiff_t)(row / 2) * job->vstride;
+    uint8_t* dst = job->out + (ptrdiff_t)row * job->stride;
+
+    for (x = 0; x < job->width; x += CHUNK) {
+      int count = job->width - x < CHUNK ? job->width - x : CHUNK;
+
+      /* one chroma sample for each 2x2 block, rounding odd sizes up */
+      for (i = 0; i < (count + 1) / 2; i++) {
+        uint8_t cu = src_u[x / 2 + i];
+        uint8_t cv = src_v[x / 2 + i];
+        cr[i] = table_rv[cv];
+        cg[i] = table_gv[cv] + table_gu[cu];
+        cb[i] = table_bu[cu];
+      }
+
+      uint8_t* pixels = dst + job->bytes_per_pixel * x;
+      job->row(src_y + x, first, cg, third, pixels, count);
+      if (row + 1 < job->height) {
+        job->row(src_y + job->ystride + x, first, cg, third,
+            pixels + job->stride, count);
+      }
+    }
+  }
+}
+
+void convert_i420_to_packed(pool_t* pool, convert_format format, int width,
+    int height, const uint8_t* y, const uint8_t* u, const uint8_t* v,
+    int ystride, int ustride, int vstride, uint8_t* out, int stride)
+{
+  i420_to_packed_job job;
+  size_t bands;
+
+  pthread_once(&init_once, init);
+
+  job.width = width;
+  job.height = height;
+  job.band_rows = band_rows(pool, (int64_t)width * height, height,
+      &bands);
+  job.y = y;
+  job.u = u;
+  job.v = v;
+  job.ystride = ystride;
+  job.ustride = ustride;
+  job.vstride = vstride;
+  job.out = out;
+  job.stride = stride;
+  job.bytes_per_pixel = format == CONVERT_FORMAT_RGBA ? 4 : 3;
+  job.swap = format == CONVERT_FORMAT_BGR;
+  job.row = format == CONVERT_FORMAT_RGBA ?
+    selected->rgba_row : selected->rgb_row;
+
+  if (bands > 1) {
+    pool_run(pool, bands, i420_to_packed_band, &job);
+  } else {
+    i420_to_packed_band(&job, 0);
+  }
+}
+
+typedef struct {
+  int width, height, band_rows;
+  const uint8_t *y, *u, *v;
+  int ystride, ustride, vstride;
+  uint8_t *dst_y, *dst_uv;
+  int dst_ystride, dst_uvstride;
+  uv_row_fn uv_row;
+} i420_to_nv12_job;
+
+static void i420_to_nv12_band(void* arg, size_t index)
+{
+  const i420_to_nv12_job* job = (const i420_to_nv12_job*)arg;
+  int begin = index * job->band_rows;
+  int end = begin + job->band_rows < job->height ?
+    begin + job->band_rows : job->height;
+  int row;
+
+  for (row = begin; row < end; row++) {
+    memcpy(job->dst_y + (ptrdiff_t)row * job->dst_ystride,
+        job->y + (ptrdiff_t)row * job->ystride, job->width);
+  }
+
+  for (row = begin / 2; row < (end + 1) / 2; row++) {
+    job->uv_row(job->u + (ptrdiff_t)row * job->ustride,
+        job->v + (ptrdiff_t)row * job->vstride,
+        job->dst_uv + (ptrdiff_t)row * job->dst_uvstride,
+        (job->width + 1) / 2);
+  }
+}
+
+void convert_i420_to_nv12(pool_t* pool, int width, int height,
+    const uint8_t* y, const uint8_t* u, const uint8_t* v, int ystride,
+    int ustride, int vstride, uint8_t* dst_y, int dst_ystride,
+    uint8_t* dst_uv, int dst_uvstride)
+{
+  i420_to_nv12_job job;
+  size_t bands;
+
+  pthread_once(&init_once, init);
+
+  job.width = width;
+  job.height = height;
+  job.band_rows = band_rows(pool, (int64_t)width * height, height,
+      &bands);
+  job.y = y;
+  job.u = u;
+  job.v = v;
+  job.ystride = ystride;
+  job.ustride = ustride;
+  job.vstride = vstride;
+  job.dst_y = dst_y;
+  job.dst_ystride = dst_ystride;
+  job.dst_uv = dst_uv;
+  job.dst_uvstride = dst_uvstride;
+  job.uv_row = selected->uv_row;
+
+  if (bands > 1) {
+    pool_run(pool, bands, i420_to_nv12_band, &job);
+  } else {
+    i420_to_nv12_band(&job, 0);
+  }
+}
+
+void convert_copy_plane(int width, int height, const uint8_t* src,
+    int src_stride, uint8_t* dst, int dst_stride)
+{
+  int row;
+
+  if (src_stride == width && dst_stride == width) {
+    memcpy(dst, src, (size_t)width * height);
+    return;
+  }
+
+  for (row = 0; row < height; row++) {
+    memcpy(dst + (ptrdiff_t)row * dst_stride,
+        src + (ptrdiff_t)row * src_stride, width);
+  }
+}
+
+void convert_nv12_to_i420(int width, int height, const uint8_t* y,
+    int ystride, const uint8_t* uv, int uvstride, uint8_t* dst_y,
+    int dst_ystride, uint8_t* dst_u, int dst_ustride, uint8_t* dst_v,
+    int dst_vstride)
+{
+  int row;
+
+  pthread_once(&init_once, init);
+
+  if (dst_y != NULL) {
+    convert_copy_plane(width, height, y, ystride, dst_y, dst_ystride);
+  }
+
+  for (row = 0; row < (height + 1) / 2; row++) {
+    selected->uv_split(uv + (ptrdiff_t)row * uvstride,
+        dst_u + (ptrdiff_t)row * dst_ustride,
+        dst_v + (ptrdiff_t)row * dst_vstride, (width + 1) / 2);
+  }
+}
+
+typedef struct {
+  int width, height, band_rows;
+  const uint8_t* rgb;
+  int rgb_stride;
+  uint8_t *y, *u, *v;
+  int ystride, ustride, vstride;
+  const matrix_coefficients* m;
+  i420_rows_fn i420_rows;
+} rgb_to_i420_job;
+
+static void rgb_to_i420_band(void* arg, size_t index)
+{
+  const rgb_to_i420_job* job = (const rgb_to_i420_job*)arg;
+  int begin = index * job->band_rows;
+  int end = begin + job->band_rows < job->height ?
+    begin + job->band_rows : job->height;
+  int row;
+
+  for (row = begin; row < end; row += 2) {
+    const uint8_t* src0 = job->rgb + (ptrdiff_t)row * job->rgb_stride;
+    uint8_t* dst0 = job->y + (ptrdiff_t)row * job->ystride;
+    int last = row + 1 == job->height;
+
+    job->i420_rows(src0, last ? src0 : src0 + job->rgb_stride, dst0,
+        last ? dst0 : dst0 + job->ystride,
+        job->u + (ptrdiff_t)(row / 2) * job->ustride,
+        job->v + (ptrdiff_t)(row / 2) * job->vstride, job->width, job->m);
+  }
+}
+
+void convert_rgb_to_i420(pool_t* pool, int width, int height,
+    const uint8_t* rgb, int rgb_stride, uint8_t* y, uint8_t* u, uint8_t* v,
+    int ystride, int ustride, int vstride, convert_matrix matrix)
+{
+  rgb_to_i420_job job;
+  size_t bands;
+
+  pthread_once(&init_once, init);
+
+  job.width = width;
+  job.height = height;
+  job.band_rows = band_rows(pool, (int64_t)width * height, height,
+      &bands);
+  job.rgb = rgb;
+  job.rgb_stride = rgb_stride;
+  job.y = y;
+  job.u = u;
+  job.v = v;
+  job.ystride = ystride;
+  job.ustride = ustride;
+  job.vstride = vstride;
+  job.m = &matrices[matrix];
+  job.i420_rows = selected->i420_rows;
+
+  if (bands > 1) {
+    pool_run(pool, bands, rgb_to_i420_band, &job);
+  } else {
+    rgb_to_i420_band(&job, 0);
+  }
+}
+
+/* Filter of one axis: output pixel i blends the *taps* input pixels from
+ * start[i] with weights[i * taps ...]. Across rows it is spread over the
+ * bytes of the pixels. */
+typedef struct {
+  int src, dst;
+  int taps;
+  int* start;
+  uint16_t* weights;
+  scale_filter across;
+} scale_axis;
+
+struct convert_scaler {
+  scale_axis x, y;
+  uint8_t* scratch;       /* rows of each band */
+  size_t scratch_size;
+  uint8_t* frame;         /* scaled NV12 chroma or RGB, to convert */
+  size_t frame_size;
+};
+
+convert_scaler* convert_scaler_new(void)
+{
+  return (convert_scaler*)calloc(1, sizeof(convert_scaler));
+}
+
+static void axis_free(scale_axis* axis)
+{
+  free(axis->start);
+  free(axis->weights);
+  free(axis->across.offsets);
+  free(axis->across.pairs);
+  memset(axis, 0, sizeof(scale_axis));
+}
+
+void convert_scaler_free(convert_scaler* scaler)
+{
+  if (scaler == NULL) {
+    return;
+  }
+
+  axis_free(&scaler->x);
+  axis_free(&scaler->y);
+  free(scaler->scratch);
+  free(scaler->frame);
+  free(scaler);
+}
+
+/* Drop the taps no output pixel weights, such as the one past the end of
+ * each pixel's area at integer ratios. */
+static void axis_trim(scale_axis* axis)
+{
+  int taps = 1;
+  int i, t;
+
+  for (i = 0; i < axis->dst; i++) {
+    const uint16_t* weights = axis->weights + (size_t)i * axis->taps;
+    int first = 0, last = axis->taps - 1;
+    while (first < last && weights[first] == 0) {
+      first++;
+    }
+    while (last > first && weights[last] == 0) {
+      last--;
+    }
+    if (last - first + 1 > taps) {
+      taps = last - first + 1;
+    }
+  }
+
+  if (taps == axis->taps) {
+    return;
+  }
+
+  /* the row moves to the first weighted tap, as far as the end of the
+   * taps and of the input allow */
+  for (i = 0; i < axis->dst; i++) {
+    const uint16_t* weights = axis->weights + (size_t)i * axis->taps;
+    int first = 0;
+    while (weights[first] == 0 && first < axis->taps - 1) {
+      first++;
+    }
+    if (first > axis->taps - taps) {
+      first = axis->taps - taps;
+    }
+    if (first > axis->src - taps - axis->start[i]) {
+      first = axis->src - taps - axis->start[i];
+    }
+
+    axis->start[i] += first;
+    for (t = 0; t < taps; t++) {
+      axis->weights[(size_t)i * taps + t] = weights[first + t];
+    }
+  }
+  axis->taps = taps;
+}
+
+/* Bilinear when shrinking less than 2x, as it only ever samples 2 inputs,
+ * otherwise the area each output pixel covers. */
+static int axis_set(scale_axis* axis, int src, int dst)
+{
+  if (axis->src == src && axis->dst == dst) {
+    return 0;
+  }
+
+  axis_free(axis);
+
+  double ratio = (double)src / dst;
+  int bilinear = dst * 2 > src;
+  int taps = bilinear ? 2 : (int)ceil(ratio) + 1;
+  if (taps > src) {
+    taps = src;
+  }
+
+  axis->start = (int*)malloc(dst * sizeof(int));
+  axis->weights = (uint16_t*)calloc((size_t)dst * taps, sizeof(uint16_t));
+  if (axis->start == NULL || axis->weights == NULL) {
+    axis_free(axis);
+    return -1;
+  }
+
+  int i, t;
+  for (i = 0; i < dst; i++) {
+    double coverage[CONVERT_SCALE_MAX_RATIO + 2] = {0};
+    int first;
+
+    if (bilinear) {
+      double center = (i + 0.5) * ratio - 0.5;
+      center = center < 0 ? 0 : (center > src - 1 ? src - 1 : center);
+      first = (int)center;
+      coverage[0] = 1 - (center - first);
+      coverage[1] = center - first;
+    } else {
+      double begin = i * ratio;
+      double end = begin + ratio;
+      first = (int)begin;
+      for (t = 0; t < taps; t++) {
+        double low = first + t > begin ? first + t : begin;
+        double high = first + t + 1 < end ? first + t + 1 : end;
+        coverage[t] = high > low ? (high - low) / ratio : 0;
+      }
+    }
+
+    /* keep the taps inside the input, the weights shift with them */
+    int shift = first + taps > src ? first + taps - src : 0;
+    uint16_t* weights = axis->weights + (size_t)i * taps;
+    int sum = 0;
+    int largest = shift;
+
+    axis->start[i] = first - shift;
+    for (t = 0; t + shift < taps; t++) {
+      weights[t + shift] = (uint16_t)(coverage[t] * 256 + 0.5);
+      sum += weights[t + shift];
+      if (weights[t + shift] > weights[largest]) {
+        largest = t + shift;
+      }
+    }
+    weights[largest] += 256 - sum;
+  }
+
+  axis->src = src;
+  axis->dst = dst;
+  axis->taps = taps;
+  axis_trim(axis);
+
+  return 0;
+}
+
+/* Spread the filter of *axis* over the bytes of *channels* interleaved
+ * samples, unless it already is. */
+static int axis_across(scale_axis* axis, int channels)
+{
+  scale_filter* filter = &axis->across;
+
+  if (filter->offsets != NULL && filter->channels == channels) {
+    return 0;
+  }
+
+  int count = axis->dst * channels;
+  int taps = axis->taps;
+
+  free(filter->offsets);
+  free(filter->pairs);
+  filter->offsets = (int*)malloc(count * sizeof(int));
+  filter->pairs = (int16_t*)calloc((size_t)(taps + 1) / 2 * count * 2,
+      sizeof(int16_t));
+  if (filter->offsets == NULL || filter->pairs == NULL) {
+    free(filter->offsets);
+    free(filter->pairs);
+    memset(filter, 0, sizeof(scale_filter));
+    return -1;
+  }
+
+  filter->channels = channels;
+  filter->count = count;
+  filter->taps = taps;
+  filter->safe = 0;
+
+  /* SIMD loads 4 bytes at every other tap, an odd count padded with a
+   * tap weighted 0 */
+  int end = axis->src * channels;
+  int last = ((taps + 1) / 2 - 1) * 2 * channels + 3;
+  int i, c, t;
+
+  for (i = 0; i < axis->dst; i++) {
+    for (c = 0; c < channels; c++) {
+      int j = i * channels + c;
+
+      filter->offsets[j] = axis->start[i] * channels + c;
+      for (t = 0; t < taps; t++) {
+        filter->pairs[2 * ((size_t)(t / 2) * count + j) + t % 2] =
+          axis->weights[(size_t)i * taps + t];
+      }
+      if (channels <= 3 && filter->safe == j &&
+          filter->offsets[j] + last < end) {
+        filter->safe++;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Set up *scaler* for *channels* interleaved samples and *slots* scratch
+ * areas of *slot_size* bytes. */
+static int scaler_prepare(convert_scaler* scaler, int channels,
+    int src_width, int src_height, int dst_width, int dst_height,
+    size_t slot_size, size_t slots)
+{
+  if (src_width > dst_width * CONVERT_SCALE_MAX_RATIO ||
+      src_height > dst_height * CONVERT_SCALE_MAX_RATIO ||
+      axis_set(&scaler->x, src_width, dst_width) == -1 ||
+      axis_set(&scaler->y, src_height, dst_height) == -1 ||
+      axis_across(&scaler->x, channels) == -1) {
+    return -1;
+  }
+
+  if (slot_size * slots > scaler->scratch_size) {
+    free(scaler->scratch);
+    scaler->scratch_size = 0;
+    scaler->scratch = (uint8_t*)malloc(slot_size * slots);
+    if (scaler->scratch == NULL) {
+      return -1;
+    }
+    scaler->scratch_size = slot_size * slots;
+  }
+
+  return 0;
+}
+
+/* Output row *row* of a scaled image: the input rows are blended into
+ * *line* and then resampled across, skipping either pass if that axis
+ * keeps its size. */
+static void scale_output_row(const convert_scaler* scaler,
+    const kernel* kernels, int channels, const uint8_t* src, int src_stride,
+    int row, uint8_t* line, uint8_t* out)
+{
+  const scale_axis* x = &scaler->x;
+  const scale_axis* y = &scaler->y;
+  int bytes = x->src * channels;
+  const uint8_t* blended = src + (ptrdiff_t)row * src_stride;
+
+  if (y->src != y->dst) {
+    const uint8_t* rows[CONVERT_SCALE_MAX_RATIO + 1];
+    int t;
+
+    for (t = 0; t < y->taps; t++) {
+      rows[t] = src + (ptrdiff_t)(y->start[row] + t) * src_stride;
+    }
+    blended = x->src == x->dst ? out : line;
+    kernels->blend_rows(rows, y->weights + (size_t)row * y->taps, y->taps,
+        (uint8_t*)blended, bytes);
+  }
+
+  if (x->src != x->dst) {
+    kernels->scale_row(&x->across, blended, out);
+  } else if (blended != out) {
+    memcpy(out, blended, bytes);
+  }
+}
+
+/* Make room for a scaled frame of *size* bytes in *scaler*. */
+static int scaler_frame(convert_scaler* scaler, size_t size)
+{
+  if (size > scaler->frame_size) {
+    free(scaler->frame);
+    scaler->frame_size = 0;
+    scaler->frame = (uint8_t*)malloc(size);
+    if (scaler->frame == NULL) {
+      return -1;
+    }
+    scaler->frame_size = size;
+  }
+
+  return 0;
+}
+
+typedef struct {
+  const convert_scaler* scaler;
+  const kernel* kernels;
+  int channels;
+  int height, band_rows;
+  const uint8_t* src;
+  int src_stride;
+  uint8_t* dst;
+  int dst_stride;
+  size_t slot_size;
+} scale_plane_job;
+
+static void scale_plane_band(void* arg, size_t index)
+{
+  const scale_plane_job* job = (const scale_plane_job*)arg;
+  uint8_t* line = job->scaler->scratch + index * job->slot_size;
+  int begin = index * job->band_rows;
+  int end = begin + job->band_rows < job->height ?
+    begin + job->band_rows : job->height;
+  int row;
+
+  for (row = begin; row < end; row++) {
+    scale_output_row(job->scaler, job->kernels, job->channels, job->src,
+        job->src_stride, row, line,
+        job->dst + (ptrdiff_t)row * job->dst_stride);
+  }
+}
+
+int convert_scale_plane(pool_t* pool, convert_scaler* scaler, int channels,
+    int src_width, int src_height, const uint8_t* src, int src_stride,
+    int dst_width, int dst_height, uint8_t* dst, int dst_stride)
+{
+  scale_plane_job job;
+  size_t bands;
+
+  pthread_once(&init_once, init);
+
+  job.band_rows = band_rows(pool, (int64_t)src_width * src_height,
+      dst_height, &bands);
+  job.slot_size = (size_t)src_width * channels;
+  if (scaler_prepare(scaler, channels, src_width, src_height, dst_width,
+        dst_height, job.slot_size, bands) == -1) {
+    return -1;
+  }
+
+  job.scaler = scaler;
+  job.kernels = selected;
+  job.channels = channels;
+  job.height = dst_height;
+  job.src = src;
+  job.src_stride = src_stride;
+  job.dst = dst;
+  job.dst_stride = dst_stride;
+
+  if (bands > 1) {
+    pool_run(pool, bands, scale_plane_band, &job);
+  } else {
+    scale_plane_band(&job, 0);
+  }
+
+  return 0;
+}
+
+int convert_scale_nv12_to_i420(pool_t* pool, convert_scaler* luma,
+    convert_scaler* chroma, int src_width, int src_height,
+    const uint8_t* y, int ystride, const uint8_t* uv, int uvstride,
+    int dst_width, int dst_height, uint8_t* dst_y, int dst_ystride,
+    uint8_t* dst_u, int dst_ustride, uint8_t* dst_v, int dst_vstride)
+{
+  int chroma_width = (dst_width + 1) / 2;
+  int chroma_height = (dst_height + 1) / 2;
+
+  if (scaler_frame(chroma, (size_t)chroma_width * 2 * chroma_height) == -1 ||
+      convert_scale_plane(pool, luma, 1, src_width, src_height, y, ystride,
+        dst_width, dst_height, dst_y, dst_ystride) == -1 ||
+      convert_scale_plane(pool, chroma, 2, (src_width + 1) / 2,
+        (src_height + 1) / 2, uv, uvstride, chroma_width, chroma_height,
+        chroma->frame, chroma_width * 2) == -1) {
+    return -1;
+  }
+
+  convert_nv12_to_i420(dst_width, dst_height, NULL, 0, chroma->frame,
+      chroma_width * 2, NULL, 0, dst_u, dst_ustride, dst_v, dst_vstride);
+
+  return 0;
+}
+
+int convert_scale_rgb_to_i420(pool_t* pool, convert_scaler* scaler,
+    int src_width, int src_height, const uint8_t* rgb, int rgb_stride,
+    int width, int height, uint8_t* y, uint8_t* u, uint8_t* v, int ystride,
+    int ustride, int vstride, convert_matrix matrix)
+{
+  if (scaler_frame(scaler, (size_t)width * height * 3) == -1 ||
+      convert_scale_plane(pool, scaler, 3, src_width, src_height, rgb,
+        rgb_stride, width, height, scaler->frame, width * 3) == -1) {
+    return -1;
+  }
+
+  convert_rgb_to_i420(pool, width, height, scaler->frame, width * 3, y, u, v,
+      ystride, ustride, vstride, matrix);
+
+  return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file   convert.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_CONVERT_H
+#define PYTOX_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+/* Pixel format conversion between toxav's I420 planes and packed formats.
+ * Row kernels are picked once at runtime from what the CPU supports, and
+ * every kernel produces exactly the bytes the scalar one does. Nothing here
+ * touches Python.
+ *
+ * Given a pool, frames of at least CONVERT_POOL_MIN_PIXELS are split into
+ * one band of rows per thread. Smaller frames, or a NULL pool, are
+ * converted on the calling thread. */
+
+#define CONVERT_POOL_MIN_PIXELS (640 * 360)
+
+/* Pixel layouts of frames handed to Python. */
+typedef enum {
+  CONVERT_FORMAT_I420,  /* toxav's planes as they are */
+  CONVERT_FORMAT_NV12,
+  CONVERT_FORMAT_RGB,
+  CONVERT_FORMAT_BGR,
+  CONVERT_FORMAT_RGBA,
+} convert_format;
+
+/* Bytes of a tightly packed width x height frame in *format*. */
+size_t convert_frame_size(convert_format format, int width, int height);
+
+/* Convert a width x height I420 image to packed 8 bit RGB, BGR or RGBA with
+ * opaque alpha, *stride* bytes per output row. Odd sizes are handled, the
+ * last column and row sharing the chroma sample of their neighbour. */
+void convert_i420_to_packed(pool_t* pool, convert_format format, int width,
+    int height, const uint8_t* y, const uint8_t* u, const uint8_t* v,
+    int ystride, int ustride, int vstride, uint8_t* out, int stride);
+
+/* Copy a width x height I420 image to NV12 planes, interleaving chroma. */
+void convert_i420_to_nv12(pool_t* pool, int width, int height,
+    const uint8_t* y, const uint8_t* u, const uint8_t* v, int ystride,
+    int ustride, int vstride, uint8_t* dst_y, int dst_ystride,
+    uint8_t* dst_uv, int dst_uvstride);
+
+/* Copy height rows of width bytes between strided planes. */
+void convert_copy_plane(int width, int height, const uint8_t* src,
+    int src_stride, uint8_t* dst, int dst_stride);
+
+/* Split the interleaved chroma of a width x height NV12 image into I420 U
+ * and V planes. Luma is copied too unless dst_y is NULL. */
+void convert_nv12_to_i420(int width, int height, const uint8_t* y,
+    int ystride, const uint8_t* uv, int uvstride, uint8_t* dst_y,
+    int dst_ystride, uint8_t* dst_u, int dst_ustride, uint8_t* dst_v,
+    int dst_vstride);
+
+/* Y'CbCr matrices for RGB input, both with studio swing. */
+typedef enum {
+  CONVERT_BT601,
+  CONVERT_BT709,
+} convert_matrix;
+
+/* Convert width x height packed 8 bit RGB, rgb_stride bytes per input row,
+ * to I420. Chroma is the average of each 2x2 block, the last column or row
+ * of odd sizes averaging with itself. */
+void convert_rgb_to_i420(pool_t* pool, int width, int height,
+    const uint8_t* rgb, int rgb_stride, uint8_t* y, uint8_t* u, uint8_t* v,
+    int ystride, int ustride, int vstride, convert_matrix matrix);
+
+/* Largest factor images can be shrunk by in one scaling pass. */
+#define CONVERT_SCALE_MAX_RATIO 16
+
+/* Filter tables and scratch rows for scaling, rebuilt whenever the sizes
+ * change. A scaler serves one call at a time. */
+typedef struct convert_scaler convert_scaler;
+
+convert_scaler* convert_scaler_new(void);
+
+void convert_scaler_free(convert_scaler* scaler);
+
+/* Scale an image of *channels* interleaved 8 bit samples per pixel.
+ * Shrinking by less than 2x is bilinear, by more averages the area each
+ * output pixel covers. Returns -1 if out of memory or shrinking more than
+ * CONVERT_SCALE_MAX_RATIO times. */
+int convert_scale_plane(pool_t* pool, convert_scaler* scaler, int channels,
+    int src_width, int src_height, const uint8_t* src, int src_stride,
+    int dst_width, int dst_height, uint8_t* dst, int dst_stride);
+
+/* Scale an NV12 image to I420 planes, *luma* and *chroma* caching the
+ * filters of either plane size. */
+int convert_scale_nv12_to_i420(pool_t* pool, convert_scaler* luma,
+    convert_scaler* chroma, int src_width, int src_height,
+    const uint8_t* y, int ystride, const uint8_t* uv, int uvstride,
+    int dst_width, int dst_height, uint8_t* dst_y, int dst_ystride,
+    uint8_t* dst_u, int dst_ustride, uint8_t* dst_v, int dst_vstride);
+
+/* convert_rgb_to_i420() of an RGB image scaled to width x height as by
+ * convert_scale_plane(), the scaled frame kept in *scaler*. */
+int convert_scale_rgb_to_i420(pool_t* pool, convert_scaler* scaler,
+    int src_width, int src_height, const uint8_t* rgb, int rgb_stride,
+    int width, int height, uint8_t* y, uint8_t* u, uint8_t* v, int ystride,
+    int ustride, int vstride, convert_matrix matrix);
+
+/* Name of the kernels in use: "scalar", "sse2", "ssse3", "avx2" or
+ * "neon". */
+const char* convert_kernel(void);
+
+/* Switch to the kernels called *name*, for tests and benchmarks. Returns -1
+ * if this build or CPU lacks them. */
+int convert_set_kernel(const char* name);
+
+#endif /* PYTOX_CONVERT_H */
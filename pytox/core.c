@@ -20,7 +20,15 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bootstrap.h"
 #include "core.h"
+#include "options.h"
+#include "pool.h"
 #include "util.h"
 
 #if PY_MAJOR_VERSION < 3
@@ -29,16 +37,229 @@
 # define BUF_TC "y"
 #endif
 
+/* Record a change to state that ends up in the savedata. */
+static void mark_dirty(ToxCore* self)
+{
+  uint64_t now = current_time_monotonic_ms();
+
+  if (self->mutations == self->saved_mutations) {
+    self->first_unsaved_ms = now;
+  }
+  self->mutations++;
+  self->last_mutation_ms = now;
+}
+
+static void autosave_stop(ToxCore* self);
+static void bootstrap_stop(ToxCore* self);
+
+/* logging module levels of TOX_LOG_LEVEL_*, TRACE being below DEBUG */
+static const int logging_levels[] = { 5, 10, 20, 30, 40 };
+
+/* Whether on_log is overridden by the class of *self*, so that calling the
+ * default no-op can be skipped. Worked out again only when the class
+ * changes, which resets its version tag. */
+static int on_log_overridden(ToxCore* self)
+{
+  PyTypeObject* type = Py_TYPE(self);
+  if (self->log_type == type && self->log_type_version != 0 &&
+      self->log_type_version == type->tp_version_tag) {
+    return self->log_overridden;
+  }
+
+  PyObject* stub = PyDict_GetItemString(ToxCoreType.tp_dict, "on_log");
+  PyObject* method = PyObject_GetAttrString((PyObject*)type, "on_log");
+  if (method == NULL) {
+    PyErr_Clear();
+    return 0;
+  }
+  Py_DECREF(method);
+
+  /* the lookup has given the type a version tag if it can have one */
+  self->log_type = type;
+  self->log_type_version = type->tp_version_tag;
+  self->log_overridden = method != stub;
+
+  return self->log_overridden;
+}
+
+/* Hand a record to the logger and on_log, with the GIL held. */
+static void log_emit(ToxCore* core, TOX_LOG_LEVEL level, const char *file,
+                     uint32_t line, const char *func, const char *message,
+                     uint32_t suppressed)
+{
+  PyObject* ret = NULL;
+
+  /* the logging module only formats records it emits */
+  if (core->log_logger != NULL && level <= TOX_LOG_LEVEL_ERROR) {
+    if (suppressed) {
+      ret = PyObject_CallMethod(core->log_logger, "log", "issIssI",
+          logging_levels[level], "%s:%d(%s): %s (%u similar suppressed)",
+          file, line, func, message, suppressed);
+    } else {
+      ret = PyObject_CallMethod(core->log_logger, "log", "issIss",
+          logging_levels[level], "%s:%d(%s): %s", file, line, func,
+          message);
+    }
+    /* a failing logger must not leave its error set for on_log */
+    if (ret == NULL) {
+      PyErr_Print();
+    }
+    Py_XDECREF(ret);
+  }
+
+  if (on_log_overridden(core)) {
+    ret = PyObject_CallMethod((PyObject*)core, "on_log", "isiss", level,
+        file, line, func, message);
+    if (ret == NULL) {
+      PyErr_Print();
+    }
+    Py_XDECREF(ret);
+  }
+}
+
 static void callback_log(Tox *tox, TOX_LOG_LEVEL level, const char *file, uint32_t line, const char *func,
                          const char *message, void* self)
 {
-    PyObject_CallMethod((PyObject*)self, "on_log", "isiss", level, file, line,
-                        func, message);
+  ToxCore* core = (ToxCore*)self;
+  uint32_t suppressed = 0;
+
+  /* toxav logs through here too, from calls made without the GIL, so
+   * Python is only called from within Tox.iterate() */
+  pthread_mutex_lock(&core->log_lock);
+
+  if (level < core->log.min_level) {
+    core->log.filtered++;
+    pthread_mutex_unlock(&core->log_lock);
+    return;
+  }
+
+  if (!log_rate_check(&core->log, file, line, current_time_monotonic_ms(),
+        &suppressed)) {
+    pthread_mutex_unlock(&core->log_lock);
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  double time = now.tv_sec + now.tv_nsec / 1e9;
+  log_push(&core->log, time, level, file, line, func, message, suppressed);
+
+  int iterating = core->log_iterating &&
+    pthread_equal(core->iterate_thread, pthread_self());
+  if (!iterating) {
+    log_push(&core->log_pending, time, level, file, line, func, message,
+        suppressed);
+  }
+
+  pthread_mutex_unlock(&core->log_lock);
+
+  if (iterating) {
+    log_emit(core, level, file, line, func, message, suppressed);
+  }
+}
+
+/* Hand the records logged outside Tox.iterate() to Python. */
+static void log_emit_pending(ToxCore* self)
+{
+  log_record* records = NULL;
+  size_t count = 0;
+
+  pthread_mutex_lock(&self->log_lock);
+  if (self->log_pending.count > 0) {
+    records = (log_record*)malloc(self->log_pending.count * sizeof(log_record));
+    if (records != NULL) {
+      count = self->log_pending.count;
+      log_copy(&self->log_pending, records, 1);
+    } else {
+      log_state_clear(&self->log_pending);
+    }
+  }
+  pthread_mutex_unlock(&self->log_lock);
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    log_emit(self, records[i].level, records[i].file, records[i].line,
+        records[i].func, records[i].message, records[i].suppressed);
+    free(records[i].file);
+  }
+  free(records);
+}
+
+int ToxCore_begin_call(ToxCore* self)
+{
+  int iterating = 0;
+
+  /* kill() clears tox with the GIL held before waiting for calls */
+  if (self->tox == NULL) {
+    PyErr_SetString(ToxOpError, "toxcore object killed.");
+    return -1;
+  }
+
+  pthread_mutex_lock(&self->calls_lock);
+  self->calls++;
+  pthread_mutex_unlock(&self->calls_lock);
+
+  /* a callback of tox_iterate() releasing the GIL */
+  pthread_mutex_lock(&self->log_lock);
+  if (self->log_iterating &&
+      pthread_equal(self->iterate_thread, pthread_self())) {
+    self->log_iterating = 0;
+    iterating = 1;
+  }
+  pthread_mutex_unlock(&self->log_lock);
+
+  return iterating;
+}
+
+void ToxCore_end_call(ToxCore* self, int state)
+{
+  if (state) {
+    pthread_mutex_lock(&self->log_lock);
+    self->log_iterating = 1;
+    pthread_mutex_unlock(&self->log_lock);
+  }
+
+  pthread_mutex_lock(&self->calls_lock);
+  if (--self->calls == 0) {
+    pthread_cond_broadcast(&self->calls_cond);
+  }
+  pthread_mutex_unlock(&self->calls_lock);
+}
+
+int ToxCore_check_iterating(ToxCore* self, const char* name)
+{
+  pthread_mutex_lock(&self->log_lock);
+  int iterating = self->iterating &&
+    pthread_equal(self->iterate_thread, pthread_self());
+  pthread_mutex_unlock(&self->log_lock);
+
+  if (iterating) {
+    PyErr_Format(ToxOpError, "%s called from a callback of iterate()", name);
+    return -1;
+  }
+
+  return 0;
+}
+
+void ToxCore_set_iterating(ToxCore* self, int iterating)
+{
+  pthread_mutex_lock(&self->log_lock);
+  self->iterate_thread = pthread_self();
+  self->iterating = iterating;
+  pthread_mutex_unlock(&self->log_lock);
 }
 
 static void callback_self_connection_status(Tox* tox, TOX_CONNECTION connection_status,
                                             void *self)
 {
+    ToxCore* core = (ToxCore*)self;
+    conn_stats_self(&core->stats, connection_status,
+        current_time_monotonic_ms());
+    if (core->bootstrap != NULL) {
+      bootstrap_manager_connection(core->bootstrap, connection_status,
+          current_time_monotonic_ms());
+    }
+
     PyObject_CallMethod((PyObject*)self, "on_self_connection_status", "i",
                         connection_status);
 }
@@ -65,6 +286,7 @@ static void callback_friend_message(Tox *tox, uint32_t friendnumber, TOX_MESSAGE
 static void callback_friend_name(Tox *tox, uint32_t friendnumber,
                                  const uint8_t* newname, size_t length, void* self)
 {
+  mark_dirty((ToxCore*)self);
   PyObject_CallMethod((PyObject*)self, "on_friend_name", "is#", friendnumber,
       newname, length - (newname[length - 1] == 0));
 }
@@ -72,6 +294,7 @@ static void callback_friend_name(Tox *tox, uint32_t friendnumber,
 static void callback_friend_status_message(Tox *tox, uint32_t friendnumber,
                                            const uint8_t *newstatus, size_t length, void* self)
 {
+  mark_dirty((ToxCore*)self);
   PyObject_CallMethod((PyObject*)self, "on_friend_status_message", "is#", friendnumber,
       newstatus, length - (newstatus[length - 1] == 0));
 }
@@ -100,6 +323,9 @@ static void callback_friend_read_receipt(Tox *tox, uint32_t friendnumber,
 static void callback_friend_connection_status(Tox *tox, uint32_t friendnumber,
     TOX_CONNECTION status, void* self)
 {
+  conn_stats_friend(&((ToxCore*)self)->stats, friendnumber, status,
+      current_time_monotonic_ms());
+
   PyObject_CallMethod((PyObject*)self, "on_friend_connection_status", "iO",
       friendnumber, PyBool_FromLong(status));
 }
@@ -166,67 +392,370 @@ static void callback_file_recv_chunk(Tox *tox, uint32_t friend_number, uint32_t
                         friend_number, file_number, position, data, length);
 }
 
-static void init_options(ToxCore* self, PyObject* pyopts, struct Tox_Options* tox_opts)
+/* Derive a pass-key from *passphrase*, with the GIL released since this is
+ * deliberately slow. *salt* may be NULL for a random salt. */
+static Tox_Pass_Key* derive_pass_key(const uint8_t* passphrase, size_t length,
+    const uint8_t* salt)
+{
+  Tox_Pass_Key* key = NULL;
+  TOX_ERR_KEY_DERIVATION err = 0;
+
+  Py_BEGIN_ALLOW_THREADS
+  if (salt != NULL) {
+    key = tox_pass_key_derive_with_salt(passphrase, length, salt, &err);
+  } else {
+    key = tox_pass_key_derive(passphrase, length, &err);
+  }
+  Py_END_ALLOW_THREADS
+
+  if (key == NULL) {
+    PyErr_Format(ToxOpError, "failed to derive pass-key: %d", err);
+  }
+
+  return key;
+}
+
+static void set_pass_key(ToxCore* self, Tox_Pass_Key* key)
+{
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&self->save_lock);
+  Py_END_ALLOW_THREADS
+
+  if (self->pass_key != NULL) {
+    tox_pass_key_free(self->pass_key);
+  }
+  self->pass_key = key;
+
+  pthread_mutex_unlock(&self->save_lock);
+}
+
+/* Storage that has to stay alive until tox_new() returns. */
+struct init_resources {
+  Py_buffer savedata;
+  int has_savedata;
+  void* map;
+  size_t map_length;
+  PyObject* proxy_host;
+  uint8_t* plain;
+  size_t plain_length;
+};
+
+static void release_init_resources(struct init_resources* res)
+{
+  if (res->has_savedata) {
+    PyBuffer_Release(&res->savedata);
+    res->has_savedata = 0;
+  }
+
+  if (res->map != NULL) {
+    munmap(res->map, res->map_length);
+    res->map = NULL;
+  }
+
+  Py_CLEAR(res->proxy_host);
+
+  if (res->plain != NULL) {
+    memset(res->plain, 0, res->plain_length);
+    free(res->plain);
+    res->plain = NULL;
+  }
+}
+
+/* Like PyObject_GetAttrString(), but a missing attribute is not an error:
+ * NULL is returned with no exception set. */
+static PyObject* get_option(PyObject* pyopts, const char* name)
+{
+  PyObject* p = PyObject_GetAttrString(pyopts, name);
+  if (p == NULL && PyErr_ExceptionMatches(PyExc_AttributeError)) {
+    PyErr_Clear();
+  }
+  return p;
+}
+
+/* Return 1 and store the option in *value* if present, 0 if missing and -1
+ * on error. */
+static int get_int_option(PyObject* pyopts, const char* name, long* value)
+{
+  PyObject* p = get_option(pyopts, name);
+  if (p == NULL) {
+    return PyErr_Occurred() ? -1 : 0;
+  }
+
+  *value = PyLong_AsLong(p);
+  Py_DECREF(p);
+  if (*value == -1 && PyErr_Occurred()) {
+    return -1;
+  }
+
+  return 1;
+}
+
+static int get_bool_option(PyObject* pyopts, const char* name, long* value)
+{
+  PyObject* p = get_option(pyopts, name);
+  if (p == NULL) {
+    return PyErr_Occurred() ? -1 : 0;
+  }
+
+  int truth = PyObject_IsTrue(p);
+  Py_DECREF(p);
+  if (truth == -1) {
+    return -1;
+  }
+  *value = truth;
+
+  return 1;
+}
+
+/* Map the savedata file at *path* read-only, so toxcore loads it in place. */
+static int map_savedata(const char* path, struct init_resources* res)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char*)path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char*)path);
+    close(fd);
+    return -1;
+  }
+
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char*)path);
+    return -1;
+  }
+
+  res->map = map;
+  res->map_length = st.st_size;
+
+  return 0;
+}
+
+/* Set up the pass-key from the savedata_passphrase option *p* and decrypt
+ * the savedata with it into res->plain. */
+static int init_passphrase(ToxCore* self, PyObject* p,
+    struct Tox_Options* tox_opts, struct init_resources* res)
 {
-    char *buf = NULL;
-    Py_ssize_t sz = 0;
-    PyObject *p = NULL;
+  char* passphrase = NULL;
+  Py_ssize_t length = 0;
+
+  if (p != NULL && p != Py_None) {
+    PyStringUnicode_AsStringAndSize(p, &passphrase, &length);
+    if (passphrase == NULL) {
+      return -1;
+    }
+  }
+
+  const uint8_t* data = tox_opts->savedata_data;
+  size_t data_length = tox_opts->savedata_length;
+  int encrypted = data_length >= TOX_PASS_ENCRYPTION_EXTRA_LENGTH &&
+    tox_is_data_encrypted(data);
 
-    p = PyObject_GetAttrString(pyopts, "savedata_data");
-    PyBytes_AsStringAndSize(p, &buf, &sz);
-    if (sz > 0) {
-        uint8_t *savedata_data = calloc(1, sz); /* XXX: Memory leak! */
-        memcpy(savedata_data, buf, sz);
-        tox_opts->savedata_data = savedata_data;
-        tox_opts->savedata_length = sz;
-        tox_opts->savedata_type = TOX_SAVEDATA_TYPE_TOX_SAVE;
+  if (passphrase == NULL || length == 0) {
+    if (encrypted) {
+      PyErr_SetString(ToxOpError, "savedata is encrypted, "
+          "savedata_passphrase required");
+      return -1;
     }
+    return 0;
+  }
 
-    p = PyObject_GetAttrString(pyopts, "proxy_host");
-    PyStringUnicode_AsStringAndSize(p, &buf, &sz);
-    if (sz > 0) {
-        char *proxy_host = calloc(1, sz); /* XXX: Memory leak! */
-        memcpy(proxy_host, buf, sz);
-        tox_opts->proxy_host = proxy_host;
+  uint8_t salt[TOX_PASS_SALT_LENGTH];
+  if (encrypted && !tox_get_salt(data, salt, NULL)) {
+    PyErr_SetString(ToxOpError, "bad encrypted savedata");
+    return -1;
+  }
+
+  /* Reuse the salt of the encrypted savedata, so the key derived here is
+   * good for both decrypting it now and encrypting later saves. */
+  Tox_Pass_Key* key = derive_pass_key((uint8_t*)passphrase, length,
+      encrypted ? salt : NULL);
+  if (key == NULL) {
+    return -1;
+  }
+
+  if (encrypted) {
+    res->plain_length = data_length - TOX_PASS_ENCRYPTION_EXTRA_LENGTH;
+    res->plain = (uint8_t*)malloc(res->plain_length ? res->plain_length : 1);
+    if (res->plain == NULL) {
+      tox_pass_key_free(key);
+      PyErr_NoMemory();
+      return -1;
     }
 
-    p = PyObject_GetAttrString(pyopts, "proxy_port");
-    if (p) {
-        tox_opts->proxy_port = PyLong_AsLong(p);
+    TOX_ERR_DECRYPTION err = 0;
+    if (!tox_pass_key_decrypt(key, data, data_length, res->plain, &err)) {
+      tox_pass_key_free(key);
+      PyErr_Format(ToxOpError, "failed to decrypt savedata: %d", err);
+      return -1;
     }
 
-    p = PyObject_GetAttrString(pyopts, "proxy_type");
-    if (p) {
-        tox_opts->proxy_type = PyLong_AsLong(p);
+    tox_opts->savedata_data = res->plain;
+    tox_opts->savedata_length = res->plain_length;
+  }
+
+  set_pass_key(self, key);
+
+  return 0;
+}
+
+/* Resolve the savedata and proxy options, which toxcore takes as pointers.
+ * Buffers handed to toxcore are borrowed, not copied, and recorded in *res*
+ * to be released once tox_new() has returned. NULL and None mean unset. */
+static int init_objects(ToxCore* self, struct Tox_Options* tox_opts,
+    struct init_resources* res, PyObject* path, PyObject* data,
+    PyObject* passphrase, PyObject* proxy_host)
+{
+  char* str = NULL;
+  Py_ssize_t len = 0;
+
+  tox_opts->savedata_data = NULL;
+  tox_opts->savedata_length = 0;
+  tox_opts->proxy_host = NULL;
+
+  if (path != NULL && path != Py_None) {
+    PyStringUnicode_AsStringAndSize(path, &str, &len);
+    if (str == NULL || (len > 0 && map_savedata(str, res) == -1)) {
+      return -1;
     }
+  }
 
-    p = PyObject_GetAttrString(pyopts, "ipv6_enabled");
-    if (p) {
-        tox_opts->ipv6_enabled = p == Py_True;
+  if (res->map != NULL) {
+    tox_opts->savedata_data = res->map;
+    tox_opts->savedata_length = res->map_length;
+  } else if (data != NULL && data != Py_None) {
+    if (PyObject_GetBuffer(data, &res->savedata, PyBUF_SIMPLE) == -1) {
+      return -1;
     }
+    res->has_savedata = 1;
+    tox_opts->savedata_data = res->savedata.buf;
+    tox_opts->savedata_length = res->savedata.len;
+  }
 
-    p = PyObject_GetAttrString(pyopts, "udp_enabled");
-    if (p) {
-        tox_opts->udp_enabled = p == Py_True;
+  if (tox_opts->savedata_length > 0) {
+    if (tox_opts->savedata_type == TOX_SAVEDATA_TYPE_NONE) {
+      tox_opts->savedata_type = TOX_SAVEDATA_TYPE_TOX_SAVE;
     }
 
-    p = PyObject_GetAttrString(pyopts, "start_port");
-    if (p) {
-        tox_opts->start_port = PyLong_AsLong(p);
+    if (tox_opts->savedata_type == TOX_SAVEDATA_TYPE_TOX_SAVE &&
+        init_passphrase(self, passphrase, tox_opts, res) == -1) {
+      return -1;
     }
+  } else {
+    tox_opts->savedata_type = TOX_SAVEDATA_TYPE_NONE;
+    tox_opts->savedata_data = NULL;
+  }
 
-    p = PyObject_GetAttrString(pyopts, "end_port");
-    if (p) {
-        tox_opts->end_port = PyLong_AsLong(p);
+  /* toxcore only reads proxy_host during tox_new(), keep the string alive
+   * until then instead of copying it. */
+  if (proxy_host != NULL && proxy_host != Py_None) {
+    PyStringUnicode_AsStringAndSize(proxy_host, &str, &len);
+    if (str == NULL) {
+      return -1;
+    }
+    if (len > 0) {
+      tox_opts->proxy_host = str;
+      Py_INCREF(proxy_host);
+      res->proxy_host = proxy_host;
     }
+  }
+
+  return 0;
+}
+
+/* Fill *tox_opts* from the attributes of an arbitrary options object. */
+static int init_attributes(ToxCore* self, PyObject* pyopts,
+    struct Tox_Options* tox_opts, struct init_resources* res)
+{
+  long value = 0;
+  int ret = 0;
+
+#define INT_OPTION(name)                                          \
+  if ((ret = get_int_option(pyopts, #name, &value)) == -1) {      \
+    return -1;                                                    \
+  } else if (ret == 1) {                                          \
+    tox_opts->name = value;                                       \
+  }
+
+#define BOOL_OPTION(name)                                         \
+  if ((ret = get_bool_option(pyopts, #name, &value)) == -1) {     \
+    return -1;                                                    \
+  } else if (ret == 1) {                                          \
+    tox_opts->name = value;                                       \
+  }
 
-    p = PyObject_GetAttrString(pyopts, "tcp_port");
-    if (p) {
-        tox_opts->tcp_port = PyLong_AsLong(p);
+  BOOL_OPTION(ipv6_enabled)
+  BOOL_OPTION(udp_enabled)
+  BOOL_OPTION(local_discovery_enabled)
+  BOOL_OPTION(hole_punching_enabled)
+  INT_OPTION(proxy_type)
+  INT_OPTION(proxy_port)
+  INT_OPTION(start_port)
+  INT_OPTION(end_port)
+  INT_OPTION(tcp_port)
+  INT_OPTION(savedata_type)
+
+#undef INT_OPTION
+#undef BOOL_OPTION
+
+  static const char* names[] = {
+    "savedata_path", "savedata_data", "savedata_passphrase", "proxy_host"
+  };
+  PyObject* objects[4] = { NULL, NULL, NULL, NULL };
+  int i;
+
+  ret = 0;
+  for (i = 0; i < 4; i++) {
+    objects[i] = get_option(pyopts, names[i]);
+    if (objects[i] == NULL && PyErr_Occurred()) {
+      ret = -1;
+      break;
     }
+  }
+
+  if (ret == 0) {
+    ret = init_objects(self, tox_opts, res, objects[0], objects[1],
+        objects[2], objects[3]);
+  }
+
+  for (i = 0; i < 4; i++) {
+    Py_XDECREF(objects[i]);
+  }
 
-    tox_opts->log_callback = callback_log;
-    tox_opts->log_user_data = self;
+  return ret;
+}
+
+/* Fill *tox_opts* from *pyopts*. A pytox.Options has been validated on
+ * assignment and is copied directly; any other object is read attribute by
+ * attribute, missing attributes keeping their defaults. */
+static int init_options(ToxCore* self, PyObject* pyopts,
+    struct Tox_Options* tox_opts, struct init_resources* res)
+{
+  int ret = 0;
+
+  if (PyObject_TypeCheck(pyopts, &ToxOptionsType)) {
+    ToxOptions* opts = (ToxOptions*)pyopts;
+    *tox_opts = opts->options;
+    ret = init_objects(self, tox_opts, res, opts->savedata_path,
+        opts->savedata_data, opts->savedata_passphrase, opts->proxy_host);
+  } else {
+    ret = init_attributes(self, pyopts, tox_opts, res);
+  }
+
+  tox_opts->log_callback = callback_log;
+  tox_opts->log_user_data = self;
+
+  return ret;
 }
 
 static int init_helper(ToxCore* self, PyObject* args)
@@ -248,13 +777,21 @@ static int init_helper(ToxCore* self, PyObject* args)
   struct Tox_Options options = {0};
   tox_options_default(&options);
 
+  struct init_resources res;
+  memset(&res, 0, sizeof(res));
+
   if (opts != NULL) {
-      init_options(self, opts, &options);
+      if (init_options(self, opts, &options, &res) == -1) {
+          release_init_resources(&res);
+          return -1;
+      }
   }
 
   TOX_ERR_NEW err = 0;
   Tox* tox = tox_new(&options, &err);
 
+  release_init_resources(&res);
+
   if (tox == NULL) {
       PyErr_Format(ToxOpError, "failed to initialize toxcore: %d", err);
       return -1;
@@ -278,41 +815,115 @@ static int init_helper(ToxCore* self, PyObject* args)
   tox_callback_file_recv_chunk(tox, callback_file_recv_chunk);
 
   self->tox = tox;
+  self->killed = 0;
+  conn_stats_reset(&self->stats, current_time_monotonic_ms());
 
   return 0;
 }
 
+int ToxCore_ensure_tox(ToxCore* self)
+{
+  if (self->tox != NULL) {
+    return 0;
+  }
+
+  if (self->killed) {
+    PyErr_SetString(ToxOpError, "toxcore object killed.");
+    return -1;
+  }
+
+  if (self->init_called) {
+    PyErr_SetString(ToxOpError, "toxcore failed to initialize.");
+    return -1;
+  }
+
+  /* __init__ was never called, e.g. by a subclass not chaining up to it:
+   * fall back to toxcore's default options. */
+  return init_helper(self, NULL);
+}
+
 static PyObject*
 ToxCore_new(PyTypeObject *type, PyObject* args, PyObject* kwds)
 {
   ToxCore* self = (ToxCore*)type->tp_alloc(type, 0);
-  self->tox = NULL;
-
-  /* We don't care about subclass's arguments */
-  if (init_helper(self, NULL) == -1) {
+  if (self == NULL) {
     return NULL;
   }
 
+  self->tox = NULL;
+  self->killed = 0;
+  self->init_called = 0;
+  self->save_buf = NULL;
+  self->save_buf_size = 0;
+  self->pass_key = NULL;
+  pthread_mutex_init(&self->save_lock, NULL);
+  pthread_mutex_init(&self->iterate_lock, NULL);
+  pthread_mutex_init(&self->calls_lock, NULL);
+  pthread_cond_init(&self->calls_cond, NULL);
+  self->calls = 0;
+  self->mutations = self->saved_mutations = 0;
+  self->saves = self->save_errors = 0;
+  self->autosave_running = 0;
+  self->autosave_path = NULL;
+  self->bootstrap = NULL;
+  self->bootstrap_resolver = NULL;
+  self->bootstrap_threads = 0;
+  pthread_mutex_init(&self->log_lock, NULL);
+  log_state_init(&self->log);
+  /* already rate limited on the way into log */
+  log_state_init(&self->log_pending);
+  self->log_pending.rate = 0;
+  self->iterating = 0;
+  self->log_iterating = 0;
+  self->log_logger = NULL;
+  self->log_type = NULL;
+  self->log_type_version = 0;
+  self->log_overridden = 0;
+  pthread_mutex_init(&self->autosave_lock, NULL);
+  pthread_cond_init(&self->autosave_cond, NULL);
+
   return (PyObject*)self;
 }
 
 static int ToxCore_init(ToxCore* self, PyObject* args, PyObject* kwds)
 {
-  /* since __init__ in Python is optional(superclass need to call it
-   * explicitly), we need to initialize self->tox in ToxCore_new instead of
-   * init. If ToxCore_init is called, we re-initialize self->tox and pass
-   * the new ipv6enabled setting. */
+  /* toxcore is only created here, with the real options. Since __init__ in
+   * Python is optional (a subclass has to call it explicitly), instances
+   * which skip it get a default one on first use, see ToxCore_ensure_tox. */
+  self->init_called = 1;
   return init_helper(self, args);
 }
 
-static int
+static void
 ToxCore_dealloc(ToxCore* self)
 {
+  autosave_stop(self);
+  bootstrap_stop(self);
+
   if (self->tox) {
     tox_kill(self->tox);
     self->tox = NULL;
   }
-  return 0;
+
+  free(self->save_buf);
+  self->save_buf = NULL;
+  if (self->pass_key != NULL) {
+    tox_pass_key_free(self->pass_key);
+    self->pass_key = NULL;
+  }
+  conn_stats_free(&self->stats);
+  log_state_free(&self->log);
+  log_state_free(&self->log_pending);
+  pthread_mutex_destroy(&self->log_lock);
+  Py_CLEAR(self->log_logger);
+  pthread_mutex_destroy(&self->save_lock);
+  pthread_mutex_destroy(&self->iterate_lock);
+  pthread_mutex_destroy(&self->calls_lock);
+  pthread_cond_destroy(&self->calls_cond);
+  pthread_mutex_destroy(&self->autosave_lock);
+  pthread_cond_destroy(&self->autosave_cond);
+
+  Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
 static PyObject*
@@ -394,6 +1005,7 @@ ToxCore_friend_add(ToxCore* self, PyObject* args)
   }
 
   if (success) {
+    mark_dirty(self);
     return PyLong_FromLong(friend_number);
   } else {
     return NULL;
@@ -422,6 +1034,7 @@ ToxCore_friend_add_norequest(ToxCore* self, PyObject* args)
     return NULL;
   }
 
+  mark_dirty(self);
   return PyLong_FromLong(res);
 }
 
@@ -488,6 +1101,9 @@ ToxCore_friend_delete(ToxCore* self, PyObject* args)
     return NULL;
   }
 
+  conn_stats_friend_removed(&self->stats, friend_num,
+      current_time_monotonic_ms());
+  mark_dirty(self);
   Py_RETURN_TRUE;
 }
 
@@ -569,6 +1185,7 @@ ToxCore_self_set_name(ToxCore* self, PyObject* args)
     return NULL;
   }
 
+  mark_dirty(self);
   Py_RETURN_TRUE;
 }
 
@@ -656,6 +1273,7 @@ ToxCore_self_set_status_message(ToxCore* self, PyObject* args)
     return NULL;
   }
 
+  mark_dirty(self);
   Py_RETURN_TRUE;
 }
 
@@ -676,6 +1294,7 @@ ToxCore_self_set_status(ToxCore* self, PyObject* args)
     return NULL;
   }
 
+  mark_dirty(self);
   Py_RETURN_NONE;
 }
 
@@ -772,6 +1391,31 @@ ToxCore_self_get_status(ToxCore* self, PyObject* args)
   return PyLong_FromLong(status);
 }
 
+static PyObject*
+last_online_to_datetime(uint64_t timestamp)
+{
+  if (timestamp == 0) {
+    Py_RETURN_NONE;
+  }
+
+  PyObject* datetime = PyImport_ImportModule("datetime");
+  if (datetime == NULL) {
+    return NULL;
+  }
+
+  PyObject* datetimeClass = PyObject_GetAttrString(datetime, "datetime");
+  Py_DECREF(datetime);
+  if (datetimeClass == NULL) {
+    return NULL;
+  }
+
+  PyObject* ret = PyObject_CallMethod(datetimeClass, "fromtimestamp", "K",
+      timestamp);
+  Py_DECREF(datetimeClass);
+
+  return ret;
+}
+
 static PyObject*
 ToxCore_friend_get_last_online(ToxCore* self, PyObject* args)
 {
@@ -784,15 +1428,7 @@ ToxCore_friend_get_last_online(ToxCore* self, PyObject* args)
 
   uint64_t status = tox_friend_get_last_online(self->tox, friend_num, NULL);
 
-  if (status == 0) {
-    Py_RETURN_NONE;
-  }
-
-  PyObject* datetime = PyImport_ImportModule("datetime");
-  PyObject* datetimeClass = PyObject_GetAttrString(datetime, "datetime");
-  PyObject* ret = PyObject_CallMethod(datetimeClass, "fromtimestamp", "K", status);
-
-  return ret;
+  return last_online_to_datetime(status);
 }
 
 static PyObject*
@@ -838,37 +1474,124 @@ ToxCore_self_get_friend_list_size(ToxCore* self, PyObject* args)
   return PyLong_FromUnsignedLong(count);
 }
 
+typedef void (*uint32_list_getter)(const Tox*, uint32_t*);
+
+/* Build an array.array('I') of *count* items and let toxcore fill its
+ * storage directly, avoiding any intermediate copy. */
 static PyObject*
-ToxCore_self_get_friend_list(ToxCore* self, PyObject* args)
+uint32_array_new(ToxCore* self, size_t count, uint32_list_getter getter)
 {
-  CHECK_TOX(self);
+  PyObject* array_module = PyImport_ImportModule("array");
+  if (array_module == NULL) {
+    return NULL;
+  }
 
-  uint32_t count = tox_self_get_friend_list_size(self->tox);
-  uint32_t* list = (uint32_t*)malloc(count * sizeof(uint32_t));
-  if (!list) {
+  PyObject* one = PyObject_CallMethod(array_module, "array", "s[i]", "I", 0);
+  Py_DECREF(array_module);
+  if (one == NULL) {
     return NULL;
   }
 
-  uint32_t n = count;
-  tox_self_get_friend_list(self->tox, list);
+  PyObject* array = PySequence_Repeat(one, count);
+  Py_DECREF(one);
+  if (array == NULL) {
+    return NULL;
+  }
 
-  PyObject* plist = PyList_New(0);
-  if (!plist) {
-    free(list);
+  if (count == 0) {
+    return array;
+  }
+
+#if PY_MAJOR_VERSION >= 3
+  Py_buffer view;
+  if (PyObject_GetBuffer(array, &view, PyBUF_WRITABLE) == -1) {
+    Py_DECREF(array);
     return NULL;
   }
 
-  uint32_t i = 0;
-  for (i = 0; i < n; ++i) {
-    PyList_Append(plist, PyLong_FromLong(list[i]));
+  if ((size_t)view.len != count * sizeof(uint32_t)) {
+    PyBuffer_Release(&view);
+    Py_DECREF(array);
+    PyErr_SetString(ToxOpError, "array item size mismatch");
+    return NULL;
   }
-  free(list);
 
-  return plist;
+  getter(self->tox, (uint32_t*)view.buf);
+  PyBuffer_Release(&view);
+#else
+  void* buf = NULL;
+  Py_ssize_t len = 0;
+  if (PyObject_AsWriteBuffer(array, &buf, &len) == -1) {
+    Py_DECREF(array);
+    return NULL;
+  }
+
+  if ((size_t)len != count * sizeof(uint32_t)) {
+    Py_DECREF(array);
+    PyErr_SetString(ToxOpError, "array item size mismatch");
+    return NULL;
+  }
+
+  getter(self->tox, (uint32_t*)buf);
+#endif
+
+  return array;
 }
 
 static PyObject*
-ToxCore_conference_new(ToxCore* self, PyObject* args)
+uint32_list_new(ToxCore* self, size_t count, uint32_list_getter getter,
+    int as_array)
+{
+  if (as_array) {
+    return uint32_array_new(self, count, getter);
+  }
+
+  uint32_t* list = (uint32_t*)malloc((count ? count : 1) * sizeof(uint32_t));
+  if (list == NULL) {
+    return PyErr_NoMemory();
+  }
+
+  getter(self->tox, list);
+
+  PyObject* plist = PyList_New(count);
+  if (plist == NULL) {
+    free(list);
+    return NULL;
+  }
+
+  size_t i = 0;
+  for (i = 0; i < count; ++i) {
+    PyObject* item = PyLong_FromUnsignedLong(list[i]);
+    if (item == NULL) {
+      Py_DECREF(plist);
+      free(list);
+      return NULL;
+    }
+    PyList_SET_ITEM(plist, i, item);
+  }
+  free(list);
+
+  return plist;
+}
+
+static PyObject*
+ToxCore_self_get_friend_list(ToxCore* self, PyObject* args, PyObject* kwds)
+{
+  CHECK_TOX(self);
+
+  static char* kwlist[] = {"as_array", NULL};
+  int as_array = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &as_array)) {
+    return NULL;
+  }
+
+  size_t count = tox_self_get_friend_list_size(self->tox);
+  return uint32_list_new(self, count, tox_self_get_friend_list, as_array);
+}
+
+static PyObject*
+ToxCore_conference_new(ToxCore* self, PyObject* args)
 {
   CHECK_TOX(self);
 
@@ -876,8 +1599,10 @@ ToxCore_conference_new(ToxCore* self, PyObject* args)
   uint32_t conference_number = tox_conference_new(self->tox, &error);
   if (error != TOX_ERR_CONFERENCE_NEW_OK) {
     PyErr_SetString(ToxOpError, "failed to create conference");
+    return NULL;
   }
 
+  mark_dirty(self);
   return PyLong_FromLong(conference_number);
 }
 
@@ -896,8 +1621,10 @@ ToxCore_conference_delete(ToxCore* self, PyObject* args)
   tox_conference_delete(self->tox, conference_number, &error);
   if (error != TOX_ERR_CONFERENCE_DELETE_OK) {
     PyErr_SetString(ToxOpError, "failed to delete conference");
+    return NULL;
   }
 
+  mark_dirty(self);
   Py_RETURN_NONE;
 }
 
@@ -940,8 +1667,10 @@ ToxCore_conference_set_title(ToxCore* self, PyObject* args)
   tox_conference_set_title(self->tox, conference_number, title, length, &error);
   if (error != TOX_ERR_CONFERENCE_TITLE_OK) {
     PyErr_SetString(ToxOpError, "failed to set the conference title");
+    return NULL;
   }
 
+  mark_dirty(self);
   Py_RETURN_NONE;
 }
 
@@ -1026,8 +1755,10 @@ ToxCore_conference_join(ToxCore* self, PyObject* args)
       &error);
   if (error != TOX_ERR_CONFERENCE_JOIN_OK) {
     PyErr_SetString(ToxOpError, "failed to join conference");
+    return NULL;
   }
 
+  mark_dirty(self);
   return PyLong_FromLong(ret);
 }
 
@@ -1105,31 +1836,19 @@ ToxCore_conference_get_chatlist_size(ToxCore* self, PyObject* args)
 }
 
 static PyObject*
-ToxCore_conference_get_chatlist(ToxCore* self, PyObject* args)
+ToxCore_conference_get_chatlist(ToxCore* self, PyObject* args, PyObject* kwds)
 {
   CHECK_TOX(self);
 
-  uint32_t count = tox_conference_get_chatlist_size(self->tox);
-  uint32_t* list = (uint32_t*)malloc(count * sizeof(uint32_t));
-  if (list == NULL) {
-    PyErr_SetString(ToxOpError, "allocation failure");
-    Py_RETURN_NONE;
-  }
-
-  tox_conference_get_chatlist(self->tox, list);
+  static char* kwlist[] = {"as_array", NULL};
+  int as_array = 0;
 
-  PyObject* plist = PyList_New(0);
-  if (!plist) {
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &as_array)) {
     return NULL;
   }
 
-  uint32_t i = 0;
-  for (i = 0; i < count; ++i) {
-    PyList_Append(plist, PyLong_FromLong(list[i]));
-  }
-  free(list);
-
-  return plist;
+  size_t count = tox_conference_get_chatlist_size(self->tox);
+  return uint32_list_new(self, count, tox_conference_get_chatlist, as_array);
 }
 
 static PyObject*
@@ -1279,6 +1998,7 @@ ToxCore_self_set_nospam(ToxCore* self, PyObject* args)
   }
 
   tox_self_set_nospam(self->tox, nospam);
+  mark_dirty(self);
   Py_RETURN_NONE;
 }
 
@@ -1360,82 +2080,1167 @@ ToxCore_add_tcp_relay(ToxCore* self, PyObject* args)
   Py_RETURN_TRUE;
 }
 
+/* Parse a sequence of (address, port, public_key) sequences, as the SERVER
+ * entries of the examples. */
+static struct bootstrap_node* parse_bootstrap_nodes(PyObject* seq,
+    size_t count)
+{
+  struct bootstrap_node* nodes = (struct bootstrap_node*)calloc(
+      count ? count : 1, sizeof(struct bootstrap_node));
+  if (nodes == NULL) {
+    PyErr_NoMemory();
+    return NULL;
+  }
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    PyObject* node = PySequence_Tuple(PySequence_Fast_GET_ITEM(seq, i));
+    if (node == NULL) {
+      goto error;
+    }
+
+    char* host = NULL;
+    int host_length = 0;
+    char* public_key = NULL;
+    int pk_length = 0;
+
+    if (!PyArg_ParseTuple(node, "s#Hs#", &host, &host_length,
+          &nodes[i].port, &public_key, &pk_length)) {
+      Py_DECREF(node);
+      goto error;
+    }
+
+    if (pk_length != TOX_PUBLIC_KEY_SIZE * 2) {
+      Py_DECREF(node);
+      PyErr_Format(PyExc_ValueError, "node %zu: bad public key length", i);
+      goto error;
+    }
+
+    hex_string_to_bytes((uint8_t*)public_key, TOX_PUBLIC_KEY_SIZE,
+        nodes[i].public_key);
+    nodes[i].host = strndup(host, host_length);
+    Py_DECREF(node);
+
+    if (nodes[i].host == NULL) {
+      PyErr_NoMemory();
+      goto error;
+    }
+  }
+
+  return nodes;
+
+error:
+  bootstrap_free_nodes(nodes, count);
+  return NULL;
+}
+
+/* Resolve all nodes on a pool of up to *threads* workers with the GIL
+ * released, or through the Python callable *resolver* if not None. */
+static int resolve_bootstrap_nodes(struct bootstrap_node* nodes, size_t count,
+    PyObject* resolver, int threads)
+{
+  size_t i;
+
+  if (resolver != Py_None) {
+    for (i = 0; i < count; i++) {
+      PyObject* ip = PyObject_CallFunction(resolver, "s", nodes[i].host);
+      if (ip == NULL) {
+        return -1;
+      }
+
+      if (ip != Py_None) {
+        char* str = NULL;
+        Py_ssize_t len = 0;
+
+        PyStringUnicode_AsStringAndSize(ip, &str, &len);
+        if (str == NULL) {
+          Py_DECREF(ip);
+          return -1;
+        }
+        if (len > 0 && (size_t)len < sizeof(nodes[i].ip)) {
+          memcpy(nodes[i].ip, str, len + 1);
+          nodes[i].resolved = 1;
+        }
+      }
+      Py_DECREF(ip);
+    }
+
+    return 0;
+  }
+
+  if (threads < 0) {
+    threads = 0;
+  } else if ((size_t)threads >= count) {
+    threads = count ? count - 1 : 0;
+  }
+
+  pool_t* pool = NULL;
+  Py_BEGIN_ALLOW_THREADS
+  pool = pool_new(threads);
+  if (pool != NULL) {
+    pool_run(pool, count, bootstrap_resolve_node, nodes);
+    pool_free(pool);
+  }
+  Py_END_ALLOW_THREADS
+
+  if (pool == NULL) {
+    PyErr_SetString(ToxOpError, "failed to start resolver threads");
+    return -1;
+  }
+
+  return 0;
+}
+
 static PyObject*
-ToxCore_self_get_connection_status(ToxCore* self, PyObject* args)
+ToxCore_bootstrap_many(ToxCore* self, PyObject* args, PyObject* kwds)
 {
   CHECK_TOX(self);
 
-  TOX_CONNECTION conn = tox_self_get_connection_status(self->tox);
+  static char* kwlist[] = {"nodes", "resolver", "tcp_relay", "threads", NULL};
+  PyObject* nodes = NULL;
+  PyObject* resolver = Py_None;
+  int tcp_relay = 1;
+  int threads = 8;
 
-  return PyLong_FromLong(conn);
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Oii", kwlist, &nodes,
+        &resolver, &tcp_relay, &threads)) {
+    return NULL;
+  }
+
+  if (resolver != Py_None && !PyCallable_Check(resolver)) {
+    PyErr_SetString(PyExc_TypeError, "resolver must be callable");
+    return NULL;
+  }
+
+  PyObject* seq = PySequence_Fast(nodes, "nodes must be a sequence");
+  if (seq == NULL) {
+    return NULL;
+  }
+
+  size_t count = PySequence_Fast_GET_SIZE(seq);
+  struct bootstrap_node* parsed = parse_bootstrap_nodes(seq, count);
+  Py_DECREF(seq);
+  if (parsed == NULL) {
+    return NULL;
+  }
+
+  if (resolve_bootstrap_nodes(parsed, count, resolver, threads) == -1) {
+    bootstrap_free_nodes(parsed, count);
+    return NULL;
+  }
+
+  /* the instance may have been killed while the GIL was released */
+  if (self->tox == NULL) {
+    bootstrap_free_nodes(parsed, count);
+    PyErr_SetString(ToxOpError, "toxcore object killed.");
+    return NULL;
+  }
+
+  PyObject* results = PyList_New(count);
+  if (results == NULL) {
+    bootstrap_free_nodes(parsed, count);
+    return NULL;
+  }
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    struct bootstrap_node* node = &parsed[i];
+    bool udp = false;
+    bool tcp = false;
+
+    if (node->resolved) {
+      udp = tox_bootstrap(self->tox, node->ip, node->port, node->public_key,
+          NULL);
+      if (tcp_relay) {
+        tcp = tox_add_tcp_relay(self->tox, node->ip, node->port,
+            node->public_key, NULL);
+      }
+    }
+
+    PyObject* ip = Py_None;
+    if (node->resolved) {
+      ip = PYSTRING_FromString(node->ip);
+    } else {
+      Py_INCREF(ip);
+    }
+
+    PyObject* result = Py_BuildValue("(NOO)", ip,
+        udp ? Py_True : Py_False, tcp ? Py_True : Py_False);
+    if (result == NULL) {
+      Py_DECREF(results);
+      bootstrap_free_nodes(parsed, count);
+      return NULL;
+    }
+    PyList_SET_ITEM(results, i, result);
+  }
+
+  bootstrap_free_nodes(parsed, count);
+
+  return results;
+}
+
+/* Write the bootstrap scores if they changed, releasing the GIL for the
+ * file I/O. Failures are ignored, scores are only a hint. */
+static void bootstrap_persist(ToxCore* self)
+{
+  bootstrap_manager* manager = self->bootstrap;
+  if (manager == NULL || manager->path == NULL || !manager->dirty) {
+    return;
+  }
+
+  size_t length = 0;
+  char* text = bootstrap_manager_serialize(manager, &length);
+  char* path = strdup(manager->path);
+  if (text != NULL && path != NULL) {
+    manager->dirty = 0;
+    Py_BEGIN_ALLOW_THREADS
+    write_file_atomic(path, (const uint8_t*)text, length);
+    Py_END_ALLOW_THREADS
+  }
+
+  free(text);
+  free(path);
+}
+
+static void bootstrap_stop(ToxCore* self)
+{
+  bootstrap_persist(self);
+  bootstrap_manager_free(self->bootstrap);
+  self->bootstrap = NULL;
+  Py_CLEAR(self->bootstrap_resolver);
+}
+
+/* Resolve the nodes of the bootstrap manager which have not resolved yet,
+ * before it starts its next batch. Resolution works on a copy, since the
+ * manager may be stopped or replaced while the GIL is released. */
+static int bootstrap_resolve_missing(ToxCore* self)
+{
+  bootstrap_manager* manager = self->bootstrap;
+  size_t i, j;
+  size_t missing = 0;
+
+  for (i = 0; i < manager->count; i++) {
+    missing += !manager->nodes[i].resolved;
+  }
+  if (missing == 0) {
+    return 0;
+  }
+
+  struct bootstrap_node* copy = (struct bootstrap_node*)calloc(missing,
+      sizeof(struct bootstrap_node));
+  size_t* index = (size_t*)malloc(missing * sizeof(size_t));
+  if (copy == NULL || index == NULL) {
+    free(copy);
+    free(index);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  for (i = 0, j = 0; i < manager->count; i++) {
+    if (!manager->nodes[i].resolved) {
+      copy[j].host = strdup(manager->nodes[i].host);
+      if (copy[j].host == NULL) {
+        bootstrap_free_nodes(copy, missing);
+        free(index);
+        PyErr_NoMemory();
+        return -1;
+      }
+      index[j++] = i;
+    }
+  }
+
+  int ret = resolve_bootstrap_nodes(copy, missing, self->bootstrap_resolver,
+      self->bootstrap_threads);
+
+  if (self->bootstrap == manager) {
+    for (j = 0; j < missing; j++) {
+      if (copy[j].resolved) {
+        memcpy(manager->nodes[index[j]].ip, copy[j].ip, sizeof(copy[j].ip));
+        manager->nodes[index[j]].resolved = 1;
+      }
+    }
+  }
+
+  bootstrap_free_nodes(copy, missing);
+  free(index);
+
+  return ret;
 }
 
 static PyObject*
-ToxCore_kill(ToxCore* self, PyObject* args)
+ToxCore_bootstrap_start(ToxCore* self, PyObject* args, PyObject* kwds)
 {
   CHECK_TOX(self);
 
-  tox_kill(self->tox);
-  self->tox = NULL;
+  static char* kwlist[] = {"nodes", "path", "batch", "timeout", "resolver",
+    "threads", NULL};
+  PyObject* nodes = NULL;
+  char* path = NULL;
+  int batch = 4;
+  double timeout = 10.0;
+  PyObject* resolver = Py_None;
+  int threads = 8;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|zidOi", kwlist, &nodes,
+        &path, &batch, &timeout, &resolver, &threads)) {
+    return NULL;
+  }
+
+  if (batch <= 0 || timeout <= 0) {
+    PyErr_SetString(PyExc_ValueError, "batch and timeout must be positive");
+    return NULL;
+  }
+
+  if (resolver != Py_None && !PyCallable_Check(resolver)) {
+    PyErr_SetString(PyExc_TypeError, "resolver must be callable");
+    return NULL;
+  }
+
+  PyObject* seq = PySequence_Fast(nodes, "nodes must be a sequence");
+  if (seq == NULL) {
+    return NULL;
+  }
+
+  size_t count = PySequence_Fast_GET_SIZE(seq);
+  struct bootstrap_node* parsed = parse_bootstrap_nodes(seq, count);
+  Py_DECREF(seq);
+  if (parsed == NULL) {
+    return NULL;
+  }
+
+  if (resolve_bootstrap_nodes(parsed, count, resolver, threads) == -1) {
+    bootstrap_free_nodes(parsed, count);
+    return NULL;
+  }
+
+  if (self->tox == NULL) {
+    bootstrap_free_nodes(parsed, count);
+    PyErr_SetString(ToxOpError, "toxcore object killed.");
+    return NULL;
+  }
+
+  bootstrap_manager* manager = bootstrap_manager_new(parsed, count, batch,
+      (uint32_t)(timeout * 1000), path);
+  if (manager == NULL) {
+    bootstrap_free_nodes(parsed, count);
+    return PyErr_NoMemory();
+  }
+
+  size_t i;
+  size_t resolved = 0;
+  for (i = 0; i < count; i++) {
+    resolved += parsed[i].resolved;
+  }
+
+  bootstrap_stop(self);
+  self->bootstrap = manager;
+  Py_INCREF(resolver);
+  self->bootstrap_resolver = resolver;
+  self->bootstrap_threads = threads;
+
+  bootstrap_manager_load(manager);
+  manager->dirty = 1;
+  manager->connected =
+    tox_self_get_connection_status(self->tox) != TOX_CONNECTION_NONE;
+  manager->rebootstrap = !manager->connected;
+  bootstrap_manager_tick(manager, self->tox, current_time_monotonic_ms());
+  bootstrap_persist(self);
+
+  return PyLong_FromSize_t(resolved);
+}
+
+static PyObject*
+ToxCore_bootstrap_stop(ToxCore* self, PyObject* args)
+{
+  bootstrap_stop(self);
 
   Py_RETURN_NONE;
 }
 
 static PyObject*
-ToxCore_iteration_interval(ToxCore* self, PyObject* args)
+ToxCore_get_bootstrap_nodes(ToxCore* self, PyObject* args)
 {
-  CHECK_TOX(self);
+  bootstrap_manager* manager = self->bootstrap;
+  if (manager == NULL) {
+    return PyList_New(0);
+  }
 
-  uint32_t interval = tox_iteration_interval(self->tox);
+  size_t* order = (size_t*)malloc((manager->count ? manager->count : 1) *
+      sizeof(size_t));
+  if (order == NULL) {
+    return PyErr_NoMemory();
+  }
+  bootstrap_manager_order(manager, order);
 
-  return PyLong_FromUnsignedLongLong(interval);
+  PyObject* list = PyList_New(manager->count);
+  if (list == NULL) {
+    free(order);
+    return NULL;
+  }
+
+  size_t i;
+  for (i = 0; i < manager->count; i++) {
+    struct bootstrap_node* node = &manager->nodes[order[i]];
+    uint8_t hex[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+    bytes_to_hex_string(node->public_key, TOX_PUBLIC_KEY_SIZE, hex);
+
+    PyObject* ip = Py_None;
+    PyObject* connect_time = Py_None;
+    if (node->resolved) {
+      ip = PYSTRING_FromString(node->ip);
+    } else {
+      Py_INCREF(ip);
+    }
+    if (node->successes) {
+      connect_time = PyFloat_FromDouble(node->connect_ms / 1000.0);
+    } else {
+      Py_INCREF(connect_time);
+    }
+
+    PyObject* entry = Py_BuildValue("{s:s,s:H,s:s,s:N,s:I,s:I,s:I,s:N}",
+        "address", node->host,
+        "port", node->port,
+        "public_key", hex,
+        "ip", ip,
+        "attempts", node->attempts,
+        "successes", node->successes,
+        "failures", node->failures,
+        "connect_time", connect_time);
+    if (entry == NULL) {
+      Py_DECREF(list);
+      free(order);
+      return NULL;
+    }
+    PyList_SET_ITEM(list, i, entry);
+  }
+
+  free(order);
+
+  return list;
 }
 
 static PyObject*
-ToxCore_iterate(ToxCore* self, PyObject* args)
+ToxCore_self_get_connection_status(ToxCore* self, PyObject* args)
 {
   CHECK_TOX(self);
 
-  tox_iterate(self->tox, self);
+  TOX_CONNECTION conn = tox_self_get_connection_status(self->tox);
 
-  if (PyErr_Occurred()) {
+  return PyLong_FromLong(conn);
+}
+
+static PyObject* histogram_to_dict(const stats_histogram* histogram)
+{
+  PyObject* buckets = PyList_New(STATS_HISTOGRAM_BUCKETS);
+  if (buckets == NULL) {
     return NULL;
   }
-  Py_RETURN_NONE;
+
+  int i;
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+    PyObject* bucket = NULL;
+    if (i < STATS_HISTOGRAM_BUCKETS - 1) {
+      bucket = Py_BuildValue("(dK)", stats_histogram_bounds[i] / 1000.0,
+          (unsigned long long)histogram->counts[i]);
+    } else {
+      bucket = Py_BuildValue("(OK)", Py_None,
+          (unsigned long long)histogram->counts[i]);
+    }
+    if (bucket == NULL) {
+      Py_DECREF(buckets);
+      return NULL;
+    }
+    PyList_SET_ITEM(buckets, i, bucket);
+  }
+
+  PyObject* mean = Py_None;
+  if (histogram->samples) {
+    mean = PyFloat_FromDouble(histogram->total_ms / 1000.0 /
+        histogram->samples);
+  } else {
+    Py_INCREF(mean);
+  }
+
+  return Py_BuildValue("{s:N,s:K,s:N}",
+      "buckets", buckets,
+      "count", (unsigned long long)histogram->samples,
+      "mean", mean);
 }
 
 static PyObject*
-ToxCore_get_savedata_size(ToxCore* self, PyObject* args)
+connection_to_dict(const stats_connection* conn, uint64_t now_ms)
+{
+  return Py_BuildValue("{s:i,s:d,s:K,s:K,s:K}",
+      "connection", conn->status,
+      "age", (now_ms - conn->since_ms) / 1000.0,
+      "connects", (unsigned long long)conn->connects,
+      "disconnects", (unsigned long long)conn->disconnects,
+      "flaps", (unsigned long long)conn->flaps);
+}
+
+static PyObject*
+ToxCore_get_stats(ToxCore* self, PyObject* args)
 {
   CHECK_TOX(self);
 
-  uint32_t size = tox_get_savedata_size(self->tox);
+  const conn_stats* stats = &self->stats;
+  uint64_t now = current_time_monotonic_ms();
 
-  return PyLong_FromUnsignedLong(size);
+  pthread_mutex_lock(&self->log_lock);
+  uint64_t log_filtered = self->log.filtered;
+  uint64_t log_suppressed = self->log.suppressed;
+  pthread_mutex_unlock(&self->log_lock);
+
+  PyObject* friends = PyDict_New();
+  if (friends == NULL) {
+    return NULL;
+  }
+
+  uint32_t i;
+  for (i = 0; i < stats->friends_size; i++) {
+    const stats_connection* conn = &stats->friends[i];
+    if (conn->connects == 0 && conn->status == TOX_CONNECTION_NONE) {
+      continue;
+    }
+
+    PyObject* key = PyLong_FromUnsignedLong(i);
+    PyObject* value = connection_to_dict(conn, now);
+    if (key == NULL || value == NULL ||
+        PyDict_SetItem(friends, key, value) == -1) {
+      Py_XDECREF(key);
+      Py_XDECREF(value);
+      Py_DECREF(friends);
+      return NULL;
+    }
+    Py_DECREF(key);
+    Py_DECREF(value);
+  }
+
+  PyObject* first_connect = Py_None;
+  if (stats->first_connected_ms) {
+    first_connect = PyFloat_FromDouble(
+        (stats->first_connected_ms - stats->start_ms) / 1000.0);
+  } else {
+    Py_INCREF(first_connect);
+  }
+
+  return Py_BuildValue("{s:d,s:N,s:N,s:N,s:N,s:K,s:K,s:K,s:N,s:N,s:K,s:K}",
+      "uptime", (now - stats->start_ms) / 1000.0,
+      "time_to_first_connect", first_connect,
+      "self", connection_to_dict(&stats->self, now),
+      "connect_time", histogram_to_dict(&stats->self_connect),
+      "session_time", histogram_to_dict(&stats->self_session),
+      "friend_connects", (unsigned long long)stats->friend_connects,
+      "friend_disconnects", (unsigned long long)stats->friend_disconnects,
+      "friend_flaps", (unsigned long long)stats->friend_flaps,
+      "friend_session_time", histogram_to_dict(&stats->friend_session),
+      "friends", friends,
+      "log_filtered", (unsigned long long)log_filtered,
+      "log_suppressed", (unsigned long long)log_suppressed);
 }
 
 static PyObject*
-ToxCore_get_savedata(ToxCore* self, PyObject* args)
+ToxCore_set_log_level(ToxCore* self, PyObject* args)
 {
-  CHECK_TOX(self);
+  int level = 0;
 
-  uint32_t size = tox_get_savedata_size(self->tox);
-  uint8_t* buf = (uint8_t*)malloc(size);
-  tox_get_savedata(self->tox, buf);
+  if (!PyArg_ParseTuple(args, "i", &level)) {
+    return NULL;
+  }
 
-  PyObject* res = PYBYTES_FromStringAndSize((const char*)buf, size);
-  free(buf);
+  if (level < TOX_LOG_LEVEL_TRACE || level > TOX_LOG_LEVEL_ERROR + 1) {
+    PyErr_SetString(PyExc_ValueError, "bad log level");
+    return NULL;
+  }
 
-  return res;
+  pthread_mutex_lock(&self->log_lock);
+  self->log.min_level = level;
+  pthread_mutex_unlock(&self->log_lock);
+
+  Py_RETURN_NONE;
 }
 
-static PyMethodDef Tox_methods[] = {
-  {
-    "on_log", (PyCFunction)ToxCore_callback_stub, METH_VARARGS,
-    "on_log(level, file, line, func, message)\n"
-    "Callback for internal log messages, default implementation does "
-    "nothing."
-  },
+static PyObject*
+ToxCore_set_log_rate_limit(ToxCore* self, PyObject* args)
+{
+  unsigned int rate = 0;
+  unsigned int burst = 0;
+
+  if (!PyArg_ParseTuple(args, "I|I", &rate, &burst)) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&self->log_lock);
+  self->log.rate = rate;
+  self->log.burst = burst ? burst : rate;
+  memset(self->log.sites, 0, sizeof(self->log.sites));
+  pthread_mutex_unlock(&self->log_lock);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_set_log_capacity(ToxCore* self, PyObject* args)
+{
+  unsigned int capacity = 0;
+
+  if (!PyArg_ParseTuple(args, "I", &capacity)) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&self->log_lock);
+  log_state_set_capacity(&self->log, capacity);
+  pthread_mutex_unlock(&self->log_lock);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_set_log_logger(ToxCore* self, PyObject* args)
+{
+  PyObject* logger = NULL;
+
+  if (!PyArg_ParseTuple(args, "O", &logger)) {
+    return NULL;
+  }
+
+  if (logger == Py_None) {
+    logger = NULL;
+  } else if (!PyObject_HasAttrString(logger, "log")) {
+    PyErr_SetString(PyExc_TypeError, "logger must have a log() method");
+    return NULL;
+  }
+
+  PyObject* old = self->log_logger;
+  Py_XINCREF(logger);
+  self->log_logger = logger;
+  Py_XDECREF(old);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_get_log_records(ToxCore* self, PyObject* args, PyObject* kwds)
+{
+  static char* kwlist[] = {"clear", NULL};
+  int clear = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &clear)) {
+    return NULL;
+  }
+
+  /* copied out, as building the list may run Python code */
+  log_record* records = NULL;
+  size_t count = 0;
+  int ret = 0;
+
+  pthread_mutex_lock(&self->log_lock);
+  count = self->log.count;
+  if (count > 0) {
+    records = (log_record*)malloc(count * sizeof(log_record));
+    ret = records == NULL ? -1 : log_copy(&self->log, records, clear);
+  }
+  pthread_mutex_unlock(&self->log_lock);
+
+  if (ret == -1) {
+    free(records);
+    return PyErr_NoMemory();
+  }
+
+  PyObject* list = PyList_New(count);
+
+  size_t i;
+  for (i = 0; i < count; i++) {
+    const log_record* record = &records[i];
+    PyObject* item = list == NULL ? NULL : Py_BuildValue("(disIssI)",
+        record->time, record->level, record->file, record->line,
+        record->func, record->message, record->suppressed);
+    if (item == NULL) {
+      Py_CLEAR(list);
+    } else {
+      PyList_SET_ITEM(list, i, item);
+    }
+    free(record->file);
+  }
+  free(records);
+
+  return list;
+}
+
+static PyObject*
+ToxCore_kill(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  /* iterate() would go on with the freed instance */
+  if (ToxCore_check_iterating(self, "kill()") == -1) {
+    return NULL;
+  }
+
+  autosave_stop(self);
+  bootstrap_stop(self);
+
+  /* refuse new calls, then wait for the ToxAV calls made without the GIL
+   * and for iterate() on other threads */
+  Tox* tox = self->tox;
+  self->tox = NULL;
+  self->killed = 1;
+
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&self->calls_lock);
+  while (self->calls > 0) {
+    pthread_cond_wait(&self->calls_cond, &self->calls_lock);
+  }
+  pthread_mutex_unlock(&self->calls_lock);
+  pthread_mutex_lock(&self->iterate_lock);
+  Py_END_ALLOW_THREADS
+
+  tox_kill(tox);
+  pthread_mutex_unlock(&self->iterate_lock);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_iteration_interval(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  uint32_t interval = tox_iteration_interval(self->tox);
+
+  return PyLong_FromUnsignedLongLong(interval);
+}
+
+static PyObject*
+ToxCore_iterate(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  /* iterate_lock is held by the iterate() this was called from */
+  if (ToxCore_check_iterating(self, "iterate()") == -1) {
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&self->iterate_lock);
+  Py_END_ALLOW_THREADS
+
+  /* the instance may have been killed while waiting */
+  if (self->tox == NULL) {
+    pthread_mutex_unlock(&self->iterate_lock);
+    PyErr_SetString(ToxOpError, "toxcore object killed.");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&self->log_lock);
+  self->iterate_thread = pthread_self();
+  self->iterating = 1;
+  self->log_iterating = 1;
+  pthread_mutex_unlock(&self->log_lock);
+
+  tox_iterate(self->tox, self);
+
+  pthread_mutex_lock(&self->log_lock);
+  self->iterating = 0;
+  self->log_iterating = 0;
+  pthread_mutex_unlock(&self->log_lock);
+
+  pthread_mutex_unlock(&self->iterate_lock);
+
+  if (self->bootstrap != NULL && self->tox != NULL &&
+      bootstrap_manager_due(self->bootstrap, current_time_monotonic_ms())) {
+    /* a failing resolver must not leave its error set for later */
+    if (bootstrap_resolve_missing(self) == -1) {
+      PyErr_Print();
+    }
+  }
+
+  if (self->bootstrap != NULL && self->tox != NULL) {
+    bootstrap_manager_tick(self->bootstrap, self->tox,
+        current_time_monotonic_ms());
+    bootstrap_persist(self);
+  }
+
+  log_emit_pending(self);
+
+  if (PyErr_Occurred()) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_get_savedata_size(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  uint32_t size = tox_get_savedata_size(self->tox);
+
+  return PyLong_FromUnsignedLong(size);
+}
+
+static PyObject*
+ToxCore_get_savedata(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  uint32_t size = tox_get_savedata_size(self->tox);
+  uint8_t* buf = (uint8_t*)malloc(size);
+  tox_get_savedata(self->tox, buf);
+
+  PyObject* res = PYBYTES_FromStringAndSize((const char*)buf, size);
+  free(buf);
+
+  return res;
+}
+
+static PyObject*
+ToxCore_friends(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  ToxFriendIter* iter = PyObject_New(ToxFriendIter, &ToxFriendIterType);
+  if (iter == NULL) {
+    return NULL;
+  }
+
+  iter->count = tox_self_get_friend_list_size(self->tox);
+  iter->pos = 0;
+  iter->list = (uint32_t*)malloc((iter->count ? iter->count : 1) *
+      sizeof(uint32_t));
+  if (iter->list == NULL) {
+    iter->core = NULL;
+    Py_DECREF(iter);
+    return PyErr_NoMemory();
+  }
+
+  tox_self_get_friend_list(self->tox, iter->list);
+
+  Py_INCREF(self);
+  iter->core = self;
+
+  return (PyObject*)iter;
+}
+
+/* Serialize the savedata and write it to *path* atomically. Must be called
+ * with the GIL held, which is released for the file I/O. Returns the number
+ * of bytes written, or -1 with errno set. */
+static Py_ssize_t save_savedata(ToxCore* self, const char* path)
+{
+  Py_BEGIN_ALLOW_THREADS
+  pthread_mutex_lock(&self->save_lock);
+  Py_END_ALLOW_THREADS
+
+  if (self->tox == NULL) {
+    pthread_mutex_unlock(&self->save_lock);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* toxcore is only ever touched with the GIL held, so serialize here and
+   * release the GIL for encryption and file I/O only. When encrypting, the
+   * ciphertext goes right after the plaintext in the same buffer. */
+  size_t size = tox_get_savedata_size(self->tox);
+  size_t buf_size = size;
+  if (self->pass_key != NULL) {
+    buf_size = size * 2 + TOX_PASS_ENCRYPTION_EXTRA_LENGTH;
+  }
+
+  if (buf_size > self->save_buf_size) {
+    uint8_t* buf = (uint8_t*)realloc(self->save_buf, buf_size);
+    if (buf == NULL) {
+      pthread_mutex_unlock(&self->save_lock);
+      errno = ENOMEM;
+      return -1;
+    }
+    self->save_buf = buf;
+    self->save_buf_size = buf_size;
+  }
+  tox_get_savedata(self->tox, self->save_buf);
+  uint64_t mutations = self->mutations;
+
+  int ret = 0;
+  int saved_errno = 0;
+  Py_BEGIN_ALLOW_THREADS
+  const uint8_t* out = self->save_buf;
+  if (self->pass_key != NULL) {
+    uint8_t* ciphertext = self->save_buf + size;
+    if (tox_pass_key_encrypt(self->pass_key, self->save_buf, size, ciphertext,
+          NULL)) {
+      out = ciphertext;
+      size += TOX_PASS_ENCRYPTION_EXTRA_LENGTH;
+    } else {
+      ret = -1;
+      errno = EIO;
+    }
+  }
+
+  if (ret == 0) {
+    ret = write_file_atomic(path, out, size);
+  }
+  saved_errno = errno;
+  pthread_mutex_unlock(&self->save_lock);
+  Py_END_ALLOW_THREADS
+
+  if (ret == -1) {
+    self->save_errors++;
+    errno = saved_errno;
+    return -1;
+  }
+
+  self->saved_mutations = mutations;
+  self->saves++;
+  self->last_saved = time(NULL);
+
+  return size;
+}
+
+static PyObject*
+ToxCore_save_to_path(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  char* path = NULL;
+
+  if (!PyArg_ParseTuple(args, "s", &path)) {
+    return NULL;
+  }
+
+  Py_ssize_t size = save_savedata(self, path);
+  if (size == -1) {
+    return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+  }
+
+  return PyLong_FromSsize_t(size);
+}
+
+static void* autosave_thread(void* arg)
+{
+  ToxCore* self = (ToxCore*)arg;
+
+  pthread_mutex_lock(&self->autosave_lock);
+  while (!self->autosave_stop) {
+    uint32_t wait_ms = self->autosave_interval_ms / 2;
+    if (wait_ms < 10) {
+      wait_ms = 10;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_ms / 1000;
+    deadline.tv_nsec += (wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&self->autosave_cond, &self->autosave_lock,
+        &deadline);
+    if (self->autosave_stop) {
+      break;
+    }
+    pthread_mutex_unlock(&self->autosave_lock);
+
+    PyGILState_STATE gstate = PyGILState_Ensure();
+
+    /* Save once the state has been quiet for a full interval, but don't let
+     * a steady stream of changes postpone the save indefinitely. */
+    uint64_t now = current_time_monotonic_ms();
+    uint64_t interval = self->autosave_interval_ms;
+    if (self->tox != NULL && self->mutations != self->saved_mutations &&
+        (now - self->last_mutation_ms >= interval ||
+         now - self->first_unsaved_ms >= interval * 10)) {
+      save_savedata(self, self->autosave_path);
+    }
+
+    PyGILState_Release(gstate);
+
+    pthread_mutex_lock(&self->autosave_lock);
+  }
+  pthread_mutex_unlock(&self->autosave_lock);
+
+  return NULL;
+}
+
+/* Stop the autosave thread, if any. Must be called with the GIL held. */
+static void autosave_stop(ToxCore* self)
+{
+  if (!self->autosave_running) {
+    return;
+  }
+
+  pthread_mutex_lock(&self->autosave_lock);
+  self->autosave_stop = 1;
+  pthread_cond_signal(&self->autosave_cond);
+  pthread_mutex_unlock(&self->autosave_lock);
+
+  /* the thread may be waiting for the GIL */
+  Py_BEGIN_ALLOW_THREADS
+  pthread_join(self->autosave_thread, NULL);
+  Py_END_ALLOW_THREADS
+
+  self->autosave_running = 0;
+  free(self->autosave_path);
+  self->autosave_path = NULL;
+}
+
+static PyObject*
+ToxCore_autosave_start(ToxCore* self, PyObject* args)
+{
+  CHECK_TOX(self);
+
+  char* path = NULL;
+  double interval = 5.0;
+
+  if (!PyArg_ParseTuple(args, "s|d", &path, &interval)) {
+    return NULL;
+  }
+
+  if (interval <= 0) {
+    PyErr_SetString(PyExc_ValueError, "interval must be positive");
+    return NULL;
+  }
+
+  autosave_stop(self);
+
+  self->autosave_path = strdup(path);
+  if (self->autosave_path == NULL) {
+    return PyErr_NoMemory();
+  }
+  self->autosave_interval_ms = (uint32_t)(interval * 1000);
+  self->autosave_stop = 0;
+
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads();
+#endif
+
+  if (pthread_create(&self->autosave_thread, NULL, autosave_thread, self) != 0) {
+    free(self->autosave_path);
+    self->autosave_path = NULL;
+    PyErr_SetString(ToxOpError, "failed to start autosave thread");
+    return NULL;
+  }
+  self->autosave_running = 1;
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_autosave_stop(ToxCore* self, PyObject* args)
+{
+  autosave_stop(self);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_mark_dirty(ToxCore* self, PyObject* args)
+{
+  mark_dirty(self);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_set_savedata_passphrase(ToxCore* self, PyObject* args)
+{
+  PyObject* p = NULL;
+
+  if (!PyArg_ParseTuple(args, "O", &p)) {
+    return NULL;
+  }
+
+  char* passphrase = NULL;
+  Py_ssize_t length = 0;
+
+  if (p != Py_None) {
+    PyStringUnicode_AsStringAndSize(p, &passphrase, &length);
+    if (passphrase == NULL) {
+      return NULL;
+    }
+  }
+
+  Tox_Pass_Key* key = NULL;
+  if (length > 0) {
+    key = derive_pass_key((uint8_t*)passphrase, length, NULL);
+    if (key == NULL) {
+      return NULL;
+    }
+  }
+
+  set_pass_key(self, key);
+  mark_dirty(self);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject*
+ToxCore_get_save_stats(ToxCore* self, PyObject* args)
+{
+  PyObject* last_saved = NULL;
+  if (self->saves > 0) {
+    last_saved = PyFloat_FromDouble((double)self->last_saved);
+  } else {
+    Py_INCREF(Py_None);
+    last_saved = Py_None;
+  }
+
+  return Py_BuildValue("{s:O,s:K,s:K,s:K,s:K,s:N,s:O,s:O}",
+      "dirty", self->mutations != self->saved_mutations ? Py_True : Py_False,
+      "mutations", (unsigned PY_LONG_LONG)self->mutations,
+      "unsaved_mutations",
+      (unsigned PY_LONG_LONG)(self->mutations - self->saved_mutations),
+      "saves", (unsigned PY_LONG_LONG)self->saves,
+      "save_errors", (unsigned PY_LONG_LONG)self->save_errors,
+      "last_saved", last_saved,
+      "autosave", self->autosave_running ? Py_True : Py_False,
+      "encrypted", self->pass_key != NULL ? Py_True : Py_False);
+}
+
+static PyMethodDef Tox_methods[] = {
+  {
+    "on_log", (PyCFunction)ToxCore_callback_stub, METH_VARARGS,
+    "on_log(level, file, line, func, message)\n"
+    "Callback for internal log messages, default implementation does "
+    "nothing."
+  },
+  {
+    "set_log_level", (PyCFunction)ToxCore_set_log_level, METH_VARARGS,
+    "set_log_level(level)\n"
+    "Drop toxcore log records below *level*, one of the LOG_LEVEL_* "
+    "constants, before they reach Python. LOG_LEVEL_ERROR + 1 drops all. "
+    "Defaults to LOG_LEVEL_TRACE."
+  },
+  {
+    "set_log_rate_limit", (PyCFunction)ToxCore_set_log_rate_limit,
+    METH_VARARGS,
+    "set_log_rate_limit(rate, burst=rate)\n"
+    "Keep at most *rate* records per second from each source line, allowing "
+    "bursts of *burst*. The next record kept reports how many were "
+    "suppressed. 0 disables the limit, the default is 50."
+  },
+  {
+    "set_log_capacity", (PyCFunction)ToxCore_set_log_capacity, METH_VARARGS,
+    "set_log_capacity(records)\n"
+    "Resize the buffer of recent log records, see :meth:`get_log_records`, "
+    "clearing it. 0 disables buffering, the default is 128."
+  },
+  {
+    "set_log_logger", (PyCFunction)ToxCore_set_log_logger, METH_VARARGS,
+    "set_log_logger(logger)\n"
+    "Forward log records to a logging.Logger, or None to stop. Messages are "
+    "passed as arguments, so they are only formatted when emitted. Records "
+    "still go to :meth:`on_log` if it is overridden. Records logged outside "
+    ":meth:`iterate`, such as by ToxAV calls, reach both at the end of the "
+    "next iterate()."
+  },
+  {
+    "get_log_records", (PyCFunction)ToxCore_get_log_records,
+    METH_VARARGS | METH_KEYWORDS,
+    "get_log_records(clear=False)\n"
+    "Return the buffered log records, oldest first, as (time, level, file, "
+    "line, func, message, suppressed) tuples, then empty the buffer if "
+    "*clear* is true."
+  },
   {
     "on_self_connection_status", (PyCFunction)ToxCore_callback_stub, METH_VARARGS,
     "on_self_connection_status(friend_number, status)\n"
@@ -1695,9 +3500,16 @@ static PyMethodDef Tox_methods[] = {
   },
   {
     "self_get_friend_list", (PyCFunction)ToxCore_self_get_friend_list,
-    METH_NOARGS,
-    "self_get_friend_list()\n"
-    "Get a list of valid friend numbers."
+    METH_VARARGS | METH_KEYWORDS,
+    "self_get_friend_list(as_array=False)\n"
+    "Get a list of valid friend numbers. If *as_array* is True, return an "
+    "array.array('I') filled directly by toxcore instead of a list."
+  },
+  {
+    "friends", (PyCFunction)ToxCore_friends, METH_NOARGS,
+    "friends()\n"
+    "Return an iterator over the friend list yielding :class:`Friend` "
+    "views. Attributes of a view are fetched from toxcore on access."
   },
   {
     "conference_get_title", (PyCFunction)ToxCore_conference_get_title, METH_VARARGS,
@@ -1768,9 +3580,11 @@ static PyMethodDef Tox_methods[] = {
     "Check if the current peer number corresponds to ours."
   },
   {
-    "conference_get_chatlist", (PyCFunction)ToxCore_conference_get_chatlist, METH_VARARGS,
-    "conference_get_chatlist()\n"
-    "Return a list of valid conference numbers."
+    "conference_get_chatlist", (PyCFunction)ToxCore_conference_get_chatlist,
+    METH_VARARGS | METH_KEYWORDS,
+    "conference_get_chatlist(as_array=False)\n"
+    "Return a list of valid conference numbers. If *as_array* is True, return "
+    "an array.array('I') instead of a list."
   },
   {
     "file_send", (PyCFunction)ToxCore_file_send, METH_VARARGS,
@@ -1826,15 +3640,73 @@ static PyMethodDef Tox_methods[] = {
     "add_tcp_relay(address, port, public_key)\n"
     ""
   },
+  {
+    "bootstrap_many", (PyCFunction)ToxCore_bootstrap_many,
+    METH_VARARGS | METH_KEYWORDS,
+    "bootstrap_many(nodes, resolver=None, tcp_relay=True, threads=8)\n"
+    "Bootstrap from a list of (address, port, public_key) nodes. Addresses "
+    "are resolved in parallel on up to *threads* native threads without "
+    "holding the GIL, or by calling resolver(address), which returns an IP "
+    "address string or None, if given. Each resolved node is then "
+    "bootstrapped from and, if tcp_relay is true, added as a TCP relay. "
+    "Returns a list of (ip, bootstrapped, tcp_relay_added) tuples in node "
+    "order, ip being None if the address did not resolve."
+  },
+  {
+    "bootstrap_start", (PyCFunction)ToxCore_bootstrap_start,
+    METH_VARARGS | METH_KEYWORDS,
+    "bootstrap_start(nodes, path=None, batch=4, timeout=10.0, resolver=None, "
+    "threads=8)\n"
+    "Keep the instance connected using a list of (address, port, public_key) "
+    "nodes, resolved as by :meth:`bootstrap_many`. Nodes are bootstrapped "
+    "from *batch* at a time, healthiest first. Each node in a batch is "
+    "credited with the time it took to get connected, and penalized if that "
+    "did not happen within *timeout* seconds, in which case the next batch "
+    "is tried. The connection dropping starts a new batch. Scores are kept "
+    "in the file at *path*, if given, for the next start. Driven by "
+    ":meth:`iterate`, which also resolves nodes that failed to resolve again "
+    "before each new batch. Returns the number of nodes resolved."
+  },
+  {
+    "bootstrap_stop", (PyCFunction)ToxCore_bootstrap_stop, METH_NOARGS,
+    "bootstrap_stop()\n"
+    "Stop bootstrapping started by :meth:`bootstrap_start`, saving scores."
+  },
+  {
+    "get_bootstrap_nodes", (PyCFunction)ToxCore_get_bootstrap_nodes,
+    METH_NOARGS,
+    "get_bootstrap_nodes()\n"
+    "Return the nodes given to :meth:`bootstrap_start`, healthiest first, as "
+    "dicts with address, port, public_key, ip, attempts, successes, failures "
+    "and connect_time, the average seconds to connect or None."
+  },
   {
     "self_get_connection_status", (PyCFunction)ToxCore_self_get_connection_status, METH_NOARGS,
     "self_get_connection_status()\n"
     "Return False if we are not connected to the DHT."
   },
+  {
+    "get_stats", (PyCFunction)ToxCore_get_stats, METH_NOARGS,
+    "get_stats()\n"
+    "Return connection statistics as a dict. *self* and each entry of "
+    "*friends*, keyed by friend number and only present for friends seen "
+    "online, hold the current connection (one of CONNECTION_NONE, "
+    "CONNECTION_TCP and CONNECTION_UDP), its age in seconds and the "
+    "numbers of connects, disconnects and TCP/UDP flaps. connect_time, "
+    "session_time and friend_session_time are histograms of time spent "
+    "disconnected before connecting, connected, and friends online, as "
+    "dicts of buckets ((upper bound in seconds, count) pairs, None being "
+    "unbounded), count and mean. Also has uptime, time_to_first_connect, "
+    "friend_connects, friend_disconnects and friend_flaps totals, and the "
+    "numbers of log records dropped by level and by rate limit, "
+    "log_filtered and log_suppressed."
+  },
   {
     "kill", (PyCFunction)ToxCore_kill, METH_NOARGS,
     "kill()\n"
-    "Run this before closing shop."
+    "Run this before closing shop. Waits for iterate() and ToxAV calls on "
+    "other threads to return. Raises OperationFailedError when called "
+    "from a callback of Tox.iterate() or ToxAV.iterate()."
   },
   {
     "iteration_interval", (PyCFunction)ToxCore_iteration_interval, METH_NOARGS,
@@ -1844,7 +3716,9 @@ static PyMethodDef Tox_methods[] = {
   {
     "iterate", (PyCFunction)ToxCore_iterate, METH_NOARGS,
     "iterate()\n"
-    "The main loop that needs to be run at least 20 times per second."
+    "The main loop that needs to be run at least 20 times per second. "
+    "Raises OperationFailedError when called from a callback of "
+    "Tox.iterate() or ToxAV.iterate()."
   },
   {
     "get_savedata_size", (PyCFunction)ToxCore_get_savedata_size, METH_NOARGS,
@@ -1856,6 +3730,48 @@ static PyMethodDef Tox_methods[] = {
     "get_savedata()\n"
     "Return messenger blob in str."
   },
+  {
+    "save_to_path", (PyCFunction)ToxCore_save_to_path, METH_VARARGS,
+    "save_to_path(path)\n"
+    "Write messenger blob to *path* atomically: the data goes to a temporary "
+    "file which is fsync()ed and renamed over *path*. The file I/O runs with "
+    "the GIL released. Return the number of bytes written."
+  },
+  {
+    "autosave_start", (PyCFunction)ToxCore_autosave_start, METH_VARARGS,
+    "autosave_start(path, interval=5.0)\n"
+    "Start a background thread saving to *path* with :meth:`.save_to_path` "
+    "whenever the state is dirty and has not changed for *interval* seconds. "
+    "A state that keeps changing is saved at least every 10 * *interval* "
+    "seconds."
+  },
+  {
+    "autosave_stop", (PyCFunction)ToxCore_autosave_stop, METH_NOARGS,
+    "autosave_stop()\n"
+    "Stop the autosave thread started by :meth:`.autosave_start`."
+  },
+  {
+    "mark_dirty", (PyCFunction)ToxCore_mark_dirty, METH_NOARGS,
+    "mark_dirty()\n"
+    "Flag the savedata as changed so the next autosave writes it."
+  },
+  {
+    "get_save_stats", (PyCFunction)ToxCore_get_save_stats, METH_NOARGS,
+    "get_save_stats()\n"
+    "Return a dict with the keys *dirty*, *mutations*, *unsaved_mutations*, "
+    "*saves*, *save_errors*, *last_saved* (unix time or None), *autosave* "
+    "and *encrypted*."
+  },
+  {
+    "set_savedata_passphrase", (PyCFunction)ToxCore_set_savedata_passphrase,
+    METH_VARARGS,
+    "set_savedata_passphrase(passphrase)\n"
+    "Derive a pass-key from *passphrase* and encrypt every later "
+    ":meth:`.save_to_path` and autosave with it. The key is derived once and "
+    "cached. None turns encryption off.\n\n"
+    "To load an encrypted profile, set *savedata_passphrase* on the options "
+    "passed to Tox(); the key derived there is cached the same way."
+  },
   {
     NULL, NULL, 0,
     NULL,
@@ -1908,6 +3824,319 @@ PyTypeObject ToxCoreType = {
   ToxCore_new,               /* tp_new */
 };
 
+/* Friend view */
+
+#define CHECK_FRIEND(self)                                                  \
+  if ((self)->core->tox == NULL) {                                          \
+    PyErr_SetString(ToxOpError, "toxcore object killed.");                  \
+    return NULL;                                                            \
+  }
+
+static void
+ToxFriend_dealloc(ToxFriend* self)
+{
+  Py_XDECREF(self->core);
+  PyObject_Del(self);
+}
+
+static PyObject*
+ToxFriend_repr(ToxFriend* self)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "<Friend %u>", self->friend_number);
+  return PYSTRING_FromString(buf);
+}
+
+static PyObject*
+ToxFriend_get_number(ToxFriend* self, void* closure)
+{
+  return PyLong_FromUnsignedLong(self->friend_number);
+}
+
+static PyObject*
+ToxFriend_get_public_key(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  uint8_t pk[TOX_PUBLIC_KEY_SIZE];
+  uint8_t hex[TOX_PUBLIC_KEY_SIZE * 2 + 1];
+
+  if (!tox_friend_get_public_key(self->core->tox, self->friend_number, pk,
+        NULL)) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+  bytes_to_hex_string(pk, TOX_PUBLIC_KEY_SIZE, hex);
+
+  return PYSTRING_FromString((const char*)hex);
+}
+
+static PyObject*
+ToxFriend_get_name(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  uint8_t buf[TOX_MAX_NAME_LENGTH];
+  TOX_ERR_FRIEND_QUERY err = 0;
+
+  size_t size = tox_friend_get_name_size(self->core->tox, self->friend_number,
+      &err);
+  if (err != TOX_ERR_FRIEND_QUERY_OK ||
+      !tox_friend_get_name(self->core->tox, self->friend_number, buf, NULL)) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+
+  return PYSTRING_FromStringAndSize((const char*)buf, size);
+}
+
+static PyObject*
+ToxFriend_get_status_message(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  uint8_t buf[TOX_MAX_STATUS_MESSAGE_LENGTH];
+  TOX_ERR_FRIEND_QUERY err = 0;
+
+  size_t size = tox_friend_get_status_message_size(self->core->tox,
+      self->friend_number, &err);
+  if (err != TOX_ERR_FRIEND_QUERY_OK ||
+      !tox_friend_get_status_message(self->core->tox, self->friend_number,
+        buf, NULL)) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+
+  return PYSTRING_FromStringAndSize((const char*)buf, size);
+}
+
+static PyObject*
+ToxFriend_get_status(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  TOX_ERR_FRIEND_QUERY err = 0;
+  TOX_USER_STATUS status = tox_friend_get_status(self->core->tox,
+      self->friend_number, &err);
+  if (err != TOX_ERR_FRIEND_QUERY_OK) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+
+  return PyLong_FromLong(status);
+}
+
+static PyObject*
+ToxFriend_get_connection_status(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  TOX_ERR_FRIEND_QUERY err = 0;
+  TOX_CONNECTION conn = tox_friend_get_connection_status(self->core->tox,
+      self->friend_number, &err);
+  if (err != TOX_ERR_FRIEND_QUERY_OK) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+
+  return PyLong_FromLong(conn);
+}
+
+static PyObject*
+ToxFriend_get_typing(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  TOX_ERR_FRIEND_QUERY err = 0;
+  bool typing = tox_friend_get_typing(self->core->tox, self->friend_number,
+      &err);
+  if (err != TOX_ERR_FRIEND_QUERY_OK) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+
+  return PyBool_FromLong(typing);
+}
+
+static PyObject*
+ToxFriend_get_last_online(ToxFriend* self, void* closure)
+{
+  CHECK_FRIEND(self);
+
+  TOX_ERR_FRIEND_GET_LAST_ONLINE err = 0;
+  uint64_t timestamp = tox_friend_get_last_online(self->core->tox,
+      self->friend_number, &err);
+  if (err != TOX_ERR_FRIEND_GET_LAST_ONLINE_OK) {
+    PyErr_SetString(ToxOpError, "no such friend");
+    return NULL;
+  }
+
+  return last_online_to_datetime(timestamp);
+}
+
+#undef CHECK_FRIEND
+
+static PyGetSetDef ToxFriend_getset[] = {
+  {
+    "number", (getter)ToxFriend_get_number, NULL,
+    "Friend number.", NULL
+  },
+  {
+    "public_key", (getter)ToxFriend_get_public_key, NULL,
+    "Public key of the friend, see :meth:`Tox.friend_get_public_key`.", NULL
+  },
+  {
+    "name", (getter)ToxFriend_get_name, NULL,
+    "Nickname of the friend, see :meth:`Tox.friend_get_name`.", NULL
+  },
+  {
+    "status_message", (getter)ToxFriend_get_status_message, NULL,
+    "Status message of the friend, see :meth:`Tox.friend_get_status_message`.",
+    NULL
+  },
+  {
+    "status", (getter)ToxFriend_get_status, NULL,
+    "User status of the friend, see :meth:`Tox.friend_get_status`.", NULL
+  },
+  {
+    "connection", (getter)ToxFriend_get_connection_status, NULL,
+    "Connection status of the friend, one of Tox.CONNECTION_NONE, "
+    "Tox.CONNECTION_TCP or Tox.CONNECTION_UDP.", NULL
+  },
+  {
+    "typing", (getter)ToxFriend_get_typing, NULL,
+    "True if the friend is typing.", NULL
+  },
+  {
+    "last_online", (getter)ToxFriend_get_last_online, NULL,
+    "datetime.datetime of the last time the friend was seen online, or None.",
+    NULL
+  },
+  {
+    NULL
+  }
+};
+
+PyTypeObject ToxFriendType = {
+#if PY_MAJOR_VERSION >= 3
+  PyVarObject_HEAD_INIT(NULL, 0)
+#else
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+#endif
+  "Friend",                  /*tp_name*/
+  sizeof(ToxFriend),         /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)ToxFriend_dealloc, /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  (reprfunc)ToxFriend_repr,  /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  0,                         /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT,        /*tp_flags*/
+  "Lazy view of a friend, yielded by Tox.friends()", /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  0,                         /* tp_iter */
+  0,                         /* tp_iternext */
+  0,                         /* tp_methods */
+  0,                         /* tp_members */
+  ToxFriend_getset,          /* tp_getset */
+};
+
+/* Friend iterator */
+
+static void
+ToxFriendIter_dealloc(ToxFriendIter* self)
+{
+  Py_XDECREF(self->core);
+  free(self->list);
+  PyObject_Del(self);
+}
+
+static PyObject*
+ToxFriendIter_next(ToxFriendIter* self)
+{
+  if (self->pos >= self->count) {
+    return NULL;
+  }
+
+  ToxFriend* friend = PyObject_New(ToxFriend, &ToxFriendType);
+  if (friend == NULL) {
+    return NULL;
+  }
+
+  Py_INCREF(self->core);
+  friend->core = self->core;
+  friend->friend_number = self->list[self->pos++];
+
+  return (PyObject*)friend;
+}
+
+static PyObject*
+ToxFriendIter_length_hint(ToxFriendIter* self, PyObject* args)
+{
+  return PyLong_FromSize_t(self->count - self->pos);
+}
+
+static PyMethodDef ToxFriendIter_methods[] = {
+  {
+    "__length_hint__", (PyCFunction)ToxFriendIter_length_hint, METH_NOARGS,
+    "Number of friends left."
+  },
+  {
+    NULL, NULL, 0,
+    NULL,
+  }
+};
+
+PyTypeObject ToxFriendIterType = {
+#if PY_MAJOR_VERSION >= 3
+  PyVarObject_HEAD_INIT(NULL, 0)
+#else
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+#endif
+  "FriendIterator",          /*tp_name*/
+  sizeof(ToxFriendIter),     /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)ToxFriendIter_dealloc, /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  0,                         /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  0,                         /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT,        /*tp_flags*/
+  "Iterator over the friend list", /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  PyObject_SelfIter,         /* tp_iter */
+  (iternextfunc)ToxFriendIter_next, /* tp_iternext */
+  ToxFriendIter_methods,     /* tp_methods */
+};
+
 void ToxCore_install_dict()
 {
 #define SET(name)                                            \
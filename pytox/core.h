@@ -24,16 +24,135 @@
 #define PYTOX_CORE_H
 
 #include <Python.h>
+#include <pthread.h>
+#include <time.h>
 #include <tox/tox.h>
+#include <tox/toxencryptsave.h>
 
-/* ToxAV definition */
+#include "bootstrap.h"
+#include "log.h"
+#include "stats.h"
+
+/* ToxCore definition */
 typedef struct {
   PyObject_HEAD
   Tox* tox;
+  /* set by kill(), tells a killed instance from one never initialized */
+  int killed;
+  /* set once __init__ ran, so that a failed one is not replaced by a
+   * default identity */
+  int init_called;
+
+  /* savedata serialization buffer, reused across saves */
+  pthread_mutex_t save_lock;
+  uint8_t* save_buf;
+  size_t save_buf_size;
+
+  /* held across tox_iterate() and toxav_iterate(), which must not overlap
+   * since toxav calls back into Python holding call locks that
+   * tox_iterate() may wait for with the GIL held */
+  pthread_mutex_t iterate_lock;
+
+  /* calls made without the GIL, see ToxCore_begin_call(), which kill()
+   * waits for */
+  pthread_mutex_t calls_lock;
+  pthread_cond_t calls_cond;
+  unsigned int calls;
+
+  /* pass-key used to encrypt saves, derived once from the passphrase */
+  Tox_Pass_Key* pass_key;
+
+  /* dirty tracking: mutations counts changes to persistent state,
+   * saved_mutations is its value at the last successful save. */
+  uint64_t mutations;
+  uint64_t saved_mutations;
+  uint64_t first_unsaved_ms;
+  uint64_t last_mutation_ms;
+  uint64_t saves;
+  uint64_t save_errors;
+  time_t last_saved;
+
+  /* background autosave */
+  int autosave_running;
+  int autosave_stop;
+  char* autosave_path;
+  uint32_t autosave_interval_ms;
+  pthread_t autosave_thread;
+  pthread_mutex_t autosave_lock;
+  pthread_cond_t autosave_cond;
+
+  /* see Tox.bootstrap_start(), with how its nodes are resolved again */
+  bootstrap_manager* bootstrap;
+  PyObject* bootstrap_resolver;
+  int bootstrap_threads;
+
+  /* see Tox.get_stats() */
+  conn_stats stats;
+
+  /* log capture, see Tox.set_log_level(). log_lock guards the log states
+   * and the iterate flags below, as toxav logs from calls made without the
+   * GIL; it is never held while touching Python */
+  pthread_mutex_t log_lock;
+  log_state log;
+  /* records to hand to Python at the end of the next Tox.iterate(), as
+   * they were logged outside it */
+  log_state log_pending;
+  /* set while iterate_thread runs Tox.iterate() or ToxAV.iterate(), whose
+   * callbacks must neither iterate again nor kill the instance */
+  pthread_t iterate_thread;
+  int iterating;
+  /* set while iterate_thread runs tox_iterate() holding the GIL */
+  int log_iterating;
+  PyObject* log_logger;
+  /* whether on_log is overridden, for the type and version tag it was
+   * worked out for */
+  PyTypeObject* log_type;
+  unsigned int log_type_version;
+  int log_overridden;
 } ToxCore;
 
+/* Lazy friend view, see Tox.friends() */
+typedef struct {
+  PyObject_HEAD
+  ToxCore* core;
+  uint32_t friend_number;
+} ToxFriend;
+
+typedef struct {
+  PyObject_HEAD
+  ToxCore* core;
+  uint32_t* list;
+  size_t count;
+  size_t pos;
+} ToxFriendIter;
+
 /* This needs to be extern as it's dynamically loaded by the Python interpreter. */
 extern PyTypeObject ToxCoreType;
+extern PyTypeObject ToxFriendType;
+extern PyTypeObject ToxFriendIterType;
+
+/* Make sure self->tox exists, creating it with default options if __init__
+ * was skipped. Returns -1 with an exception set if the instance was
+ * killed or toxcore failed to start. */
+int ToxCore_ensure_tox(ToxCore* self);
+
+/* Call around tox and toxav calls made with the GIL released, passing the
+ * state ToxCore_begin_call() returns on to ToxCore_end_call(). kill() waits
+ * for the call to return, and records logged meanwhile are queued for
+ * Tox.iterate() rather than handed to Python. Returns -1 with an exception
+ * set if the instance has been killed. */
+int ToxCore_begin_call(ToxCore* self);
+
+void ToxCore_end_call(ToxCore* self, int state);
+
+/* Raise ToxOpError and return -1 if this thread runs a callback of
+ * Tox.iterate() or ToxAV.iterate(), where *name* would wait for the
+ * iterate() it was called from. */
+int ToxCore_check_iterating(ToxCore* self, const char* name);
+
+/* Mark this thread as running iterate(), with iterate_lock held, or clear
+ * the mark. */
+void ToxCore_set_iterating(ToxCore* self, int iterating);
 
 void ToxCore_install_dict(void);
 
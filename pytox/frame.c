@@ -0,0 +1,495 @@
+/**
+ * @file   frame.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert.h"
+#include "frame.h"
+
+frame_pool* frame_pool_new(void)
+{
+  frame_pool* pool = (frame_pool*)calloc(1, sizeof(frame_pool));
+  if (pool != NULL) {
+    pool->refs = 1;
+  }
+
+  return pool;
+}
+
+void frame_pool_unref(frame_pool* pool)
+{
+  if (pool == NULL || --pool->refs > 0) {
+    return;
+  }
+
+  while (pool->free_list != NULL) {
+    frame_buffer* next = pool->free_list->next;
+    free(pool->free_list);
+    pool->free_list = next;
+  }
+  free(pool);
+}
+
+frame_buffer* frame_pool_get(frame_pool* pool, size_t size)
+{
+  frame_buffer** link;
+
+  for (link = &pool->free_list; *link != NULL; link = &(*link)->next) {
+    if ((*link)->size == size) {
+      frame_buffer* buffer = *link;
+      *link = buffer->next;
+      pool->free_count--;
+      return buffer;
+    }
+  }
+
+  frame_buffer* buffer = (frame_buffer*)malloc(sizeof(frame_buffer) + size);
+  if (buffer != NULL) {
+    buffer->size = size;
+  }
+
+  return buffer;
+}
+
+void frame_pool_put(frame_pool* pool, frame_buffer* buffer)
+{
+  buffer->next = pool->free_list;
+  pool->free_list = buffer;
+
+  /* buffers of a resolution no longer in use age out at the tail */
+  if (++pool->free_count > FRAME_POOL_MAX_FREE) {
+    frame_buffer** link = &pool->free_list;
+    while ((*link)->next != NULL) {
+      link = &(*link)->next;
+    }
+    free(*link);
+    *link = NULL;
+    pool->free_count--;
+  }
+}
+
+/* Take a buffer of *size* bytes for a new frame of *type*. */
+static ToxFrame*
+frame_new(PyTypeObject* type, frame_pool* pool, size_t size)
+{
+  ToxFrame* self = (ToxFrame*)type->tp_alloc(type, 0);
+  if (self == NULL) {
+    return NULL;
+  }
+
+  self->buffer = frame_pool_get(pool, size);
+  if (self->buffer == NULL) {
+    Py_DECREF(self);
+    PyErr_NoMemory();
+    return NULL;
+  }
+
+  pool->refs++;
+  self->pool = pool;
+  self->exports = 0;
+
+  return self;
+}
+
+/* Describe the buffer as C-contiguous items of *itemsize* bytes, the last
+ * dimension varying fastest. */
+static void
+frame_set_shape(ToxFrame* self, int ndim, const Py_ssize_t* shape,
+    Py_ssize_t itemsize, char* typecode)
+{
+  int i;
+
+  self->ndim = ndim;
+  self->itemsize = itemsize;
+  self->typecode = typecode;
+  for (i = ndim - 1; i >= 0; i--) {
+    self->shape[i] = shape[i];
+    self->strides[i] = i == ndim - 1 ? itemsize :
+      self->strides[i + 1] * shape[i + 1];
+  }
+}
+
+ToxVideoFrame*
+ToxVideoFrame_new(frame_pool* pool, int format, int width, int height)
+{
+  ToxVideoFrame* self = (ToxVideoFrame*)frame_new(&ToxVideoFrameType, pool,
+      convert_frame_size(format, width, height));
+  if (self == NULL) {
+    return NULL;
+  }
+
+  self->format = format;
+  self->width = width;
+  self->height = height;
+
+  if (format == CONVERT_FORMAT_I420 || format == CONVERT_FORMAT_NV12) {
+    Py_ssize_t shape[1] = {self->base.buffer->size};
+    frame_set_shape(&self->base, 1, shape, 1, "B");
+  } else {
+    Py_ssize_t shape[3] = {height, width,
+      format == CONVERT_FORMAT_RGBA ? 4 : 3};
+    frame_set_shape(&self->base, 3, shape, 1, "B");
+  }
+
+  return self;
+}
+
+ToxAudioFrame*
+ToxAudioFrame_new(frame_pool* pool, const int16_t* pcm, int sample_count,
+    int channels, int sampling_rate)
+{
+  size_t size = (size_t)sample_count * channels * sizeof(int16_t);
+  ToxAudioFrame* self = (ToxAudioFrame*)frame_new(&ToxAudioFrameType, pool,
+      size);
+  if (self == NULL) {
+    return NULL;
+  }
+
+  Py_ssize_t shape[2] = {sample_count, channels};
+  frame_set_shape(&self->base, 2, shape, sizeof(int16_t), "h");
+  if (pcm != NULL) {
+    memcpy(self->base.buffer->data, pcm, size);
+  }
+
+  self->sample_count = sample_count;
+  self->channels = channels;
+  self->sampling_rate = sampling_rate;
+
+  return self;
+}
+
+static void
+release_buffer(ToxFrame* self)
+{
+  if (self->buffer != NULL) {
+    frame_pool_put(self->pool, self->buffer);
+    self->buffer = NULL;
+  }
+}
+
+static void
+ToxFrame_dealloc(ToxFrame* self)
+{
+  if (self->pool != NULL) {
+    release_buffer(self);
+    frame_pool_unref(self->pool);
+  }
+
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+check_released(ToxFrame* self)
+{
+  if (self->buffer == NULL) {
+    PyErr_SetString(PyExc_ValueError, "operation on a released frame");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+ToxFrame_getbuffer(ToxFrame* self, Py_buffer* view, int flags)
+{
+  if (check_released(self) == -1) {
+    return -1;
+  }
+
+  if (PyBuffer_FillInfo(view, (PyObject*)self, self->buffer->data,
+        self->buffer->size, 0, flags) == -1) {
+    return -1;
+  }
+
+  /* consumers not asking for a shape get plain bytes, and so do those
+   * that could not be told what a wider item holds */
+  if ((flags & PyBUF_ND) == PyBUF_ND &&
+      (self->itemsize == 1 || (flags & PyBUF_FORMAT) == PyBUF_FORMAT)) {
+    view->ndim = self->ndim;
+    view->shape = self->shape;
+    view->itemsize = self->itemsize;
+    if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) {
+      view->strides = self->strides;
+    }
+    if ((flags & PyBUF_FORMAT) == PyBUF_FORMAT) {
+      view->format = self->typecode;
+    }
+  }
+
+  self->exports++;
+
+  return 0;
+}
+
+static void
+ToxFrame_releasebuffer(ToxFrame* self, Py_buffer* view)
+{
+  self->exports--;
+}
+
+static PyObject*
+ToxFrame_release(ToxFrame* self, PyObject* args)
+{
+  if (self->exports > 0) {
+    PyErr_SetString(PyExc_BufferError, "frame has views of its buffer");
+    return NULL;
+  }
+
+  release_buffer(self);
+
+  Py_RETURN_NONE;
+}
+
+/* A view of *length* bytes at *offset* into *view*, shaped rows x cols x
+ * depth where python supports it. */
+static PyObject*
+plane_view(PyObject* view, Py_ssize_t offset, Py_ssize_t rows,
+    Py_ssize_t cols, Py_ssize_t depth)
+{
+  PyObject* plane = PySequence_GetSlice(view, offset,
+      offset + rows * cols * depth);
+#if PY_MAJOR_VERSION >= 3
+  if (plane != NULL) {
+    PyObject* shaped = depth > 1 ?
+      PyObject_CallMethod(plane, "cast", "s(nnn)", "B", rows, cols, depth) :
+      PyObject_CallMethod(plane, "cast", "s(nn)", "B", rows, cols);
+    Py_DECREF(plane);
+    plane = shaped;
+  }
+#endif
+
+  return plane;
+}
+
+static PyObject*
+ToxVideoFrame_planes(ToxVideoFrame* self, PyObject* args)
+{
+  if (check_released(&self->base) == -1) {
+    return NULL;
+  }
+
+  PyObject* view = PyMemoryView_FromObject((PyObject*)self);
+  if (view == NULL) {
+    return NULL;
+  }
+
+  if (self->format != CONVERT_FORMAT_I420 &&
+      self->format != CONVERT_FORMAT_NV12) {
+    return Py_BuildValue("(N)", view);
+  }
+
+  Py_ssize_t luma = (Py_ssize_t)self->width * self->height;
+  Py_ssize_t chroma_width = (self->width + 1) / 2;
+  Py_ssize_t chroma_height = (self->height + 1) / 2;
+  PyObject* planes = NULL;
+
+  if (self->format == CONVERT_FORMAT_I420) {
+    planes = Py_BuildValue("(NNN)",
+        plane_view(view, 0, self->height, self->width, 1),
+        plane_view(view, luma, chroma_height, chroma_width, 1),
+        plane_view(view, luma + chroma_width * chroma_height, chroma_height,
+          chroma_width, 1));
+  } else {
+    planes = Py_BuildValue("(NN)",
+        plane_view(view, 0, self->height, self->width, 1),
+        plane_view(view, luma, chroma_height, chroma_width, 2));
+  }
+
+  Py_DECREF(view);
+
+  return planes;
+}
+
+static PyObject*
+ToxFrame_get_int(PyObject* self, void* closure)
+{
+  return PyLong_FromLong(*(int*)((char*)self + (size_t)closure));
+}
+
+static PyObject*
+ToxFrame_get_nbytes(ToxFrame* self, void* closure)
+{
+  return PyLong_FromSize_t(self->buffer ? self->buffer->size : 0);
+}
+
+static PyObject*
+ToxFrame_get_released(ToxFrame* self, void* closure)
+{
+  return PyBool_FromLong(self->buffer == NULL);
+}
+
+#define INT_GETSET(type, name, doc)                                     \
+  {                                                                     \
+    #name, (getter)ToxFrame_get_int, NULL,                              \
+    doc, (void*)offsetof(type, name)                                    \
+  }
+
+#define FRAME_GETSETS                                                   \
+  {                                                                     \
+    "nbytes", (getter)ToxFrame_get_nbytes, NULL,                        \
+    "Size of the buffer, 0 once released.", NULL                        \
+  },                                                                    \
+  {                                                                     \
+    "released", (getter)ToxFrame_get_released, NULL,                    \
+    "True once the buffer went back to the pool.", NULL                 \
+  }
+
+#define RELEASE_METHOD                                                  \
+  {                                                                     \
+    "release", (PyCFunction)ToxFrame_release, METH_NOARGS,              \
+    "release()\n"                                                       \
+    "Give the buffer back to the pool for the next frame, without "     \
+    "waiting for the frame to be collected. Raises BufferError while "  \
+    "views of it are held."                                             \
+  }
+
+static PyGetSetDef ToxVideoFrame_getset[] = {
+  INT_GETSET(ToxVideoFrame, format,
+      "VIDEO_FORMAT_* constant of the pixel layout."),
+  INT_GETSET(ToxVideoFrame, width, "Width in pixels."),
+  INT_GETSET(ToxVideoFrame, height, "Height in pixels."),
+  FRAME_GETSETS,
+  {NULL}
+};
+
+static PyMethodDef ToxVideoFrame_methods[] = {
+  {
+    "planes", (PyCFunction)ToxVideoFrame_planes, METH_NOARGS,
+    "planes()\n"
+    "Return memoryviews of the (y, u, v) planes of an I420 frame or the "
+    "(y, uv) planes of an NV12 frame, shaped rows x columns, with a third "
+    "dimension of 2 for interleaved UV. Packed pixel formats have a single "
+    "plane. Views are flat on python 2."
+  },
+  RELEASE_METHOD,
+  {NULL}
+};
+
+static PyGetSetDef ToxAudioFrame_getset[] = {
+  INT_GETSET(ToxAudioFrame, sample_count, "Samples per channel."),
+  INT_GETSET(ToxAudioFrame, channels, "Number of interleaved channels."),
+  INT_GETSET(ToxAudioFrame, sampling_rate, "Sampling rate in Hz."),
+  FRAME_GETSETS,
+  {NULL}
+};
+
+static PyMethodDef ToxAudioFrame_methods[] = {
+  RELEASE_METHOD,
+  {NULL}
+};
+
+static PyBufferProcs ToxFrame_as_buffer = {
+#if PY_MAJOR_VERSION < 3
+  0,                         /* bf_getreadbuffer */
+  0,                         /* bf_getwritebuffer */
+  0,                         /* bf_getsegcount */
+  0,                         /* bf_getcharbuffer */
+#endif
+  (getbufferproc)ToxFrame_getbuffer,         /* bf_getbuffer */
+  (releasebufferproc)ToxFrame_releasebuffer, /* bf_releasebuffer */
+};
+
+#if PY_MAJOR_VERSION >= 3
+# define FRAME_TPFLAGS Py_TPFLAGS_DEFAULT
+#else
+# define FRAME_TPFLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER)
+#endif
+
+PyTypeObject ToxVideoFrameType = {
+#if PY_MAJOR_VERSION >= 3
+  PyVarObject_HEAD_INIT(NULL, 0)
+#else
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+#endif
+  "VideoFrame",              /*tp_name*/
+  sizeof(ToxVideoFrame),     /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)ToxFrame_dealloc, /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  0,                         /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  &ToxFrame_as_buffer,       /*tp_as_buffer*/
+  FRAME_TPFLAGS,             /*tp_flags*/
+  "Received video frame, valid until released. Its buffer is recycled for "
+  "later frames once the frame is released or collected.", /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  0,                         /* tp_iter */
+  0,                         /* tp_iternext */
+  ToxVideoFrame_methods,     /* tp_methods */
+  0,                         /* tp_members */
+  ToxVideoFrame_getset,      /* tp_getset */
+};
+
+PyTypeObject ToxAudioFrameType = {
+#if PY_MAJOR_VERSION >= 3
+  PyVarObject_HEAD_INIT(NULL, 0)
+#else
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+#endif
+  "AudioFrame",              /*tp_name*/
+  sizeof(ToxAudioFrame),     /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)ToxFrame_dealloc, /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  0,                         /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  &ToxFrame_as_buffer,       /*tp_as_buffer*/
+  FRAME_TPFLAGS,             /*tp_flags*/
+  "Received PCM, valid until released. Its buffer is recycled for later "
+  "frames once the frame is released or collected.", /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  0,                         /* tp_iter */
+  0,                         /* tp_iternext */
+  ToxAudioFrame_methods,     /* tp_methods */
+  0,                         /* tp_members */
+  ToxAudioFrame_getset,      /* tp_getset */
+};
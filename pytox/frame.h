@@ -0,0 +1,105 @@
+/**
+ * @file   frame.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_FRAME_H
+#define PYTOX_FRAME_H
+
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Free buffers a pool keeps for reuse, the least recently returned are
+ * dropped first. */
+#define FRAME_POOL_MAX_FREE 8
+
+typedef struct frame_buffer {
+  struct frame_buffer* next;
+  size_t size;
+  uint8_t data[];
+} frame_buffer;
+
+/* Recycles the buffers of received frames. A pool is shared by its ToxAV
+ * and every frame still alive, and freed with the last of them. Only
+ * used with the GIL held. */
+typedef struct {
+  int refs;
+  frame_buffer* free_list;
+  int free_count;
+} frame_pool;
+
+frame_pool* frame_pool_new(void);
+
+void frame_pool_unref(frame_pool* pool);
+
+/* Return a buffer of *size* bytes, reused if one is free. NULL if out of
+ * memory. */
+frame_buffer* frame_pool_get(frame_pool* pool, size_t size);
+
+void frame_pool_put(frame_pool* pool, frame_buffer* buffer);
+
+/* Fields shared by VideoFrame and AudioFrame: a pooled buffer exported
+ * through the buffer protocol with the shape and strides below, so that
+ * array libraries can wrap it without copying. */
+typedef struct {
+  PyObject_HEAD
+  frame_pool* pool;
+  frame_buffer* buffer;   /* NULL once released */
+  Py_ssize_t exports;     /* buffer views still held */
+  int ndim;
+  Py_ssize_t shape[3];
+  Py_ssize_t strides[3];
+  Py_ssize_t itemsize;
+  char* typecode;         /* struct module format of one item */
+} ToxFrame;
+
+/* ToxVideoFrame definition: packed pixel formats are exported as height x
+ * width x bytes per pixel, planar formats as a flat run of planes. */
+typedef struct {
+  ToxFrame base;
+  int format;             /* convert_format */
+  int width;
+  int height;
+} ToxVideoFrame;
+
+/* ToxAudioFrame definition: signed 16 bit PCM exported as sample_count x
+ * channels. */
+typedef struct {
+  ToxFrame base;
+  int sample_count;
+  int channels;
+  int sampling_rate;
+} ToxAudioFrame;
+
+extern PyTypeObject ToxVideoFrameType;
+extern PyTypeObject ToxAudioFrameType;
+
+/* A new frame of *format* with a buffer from *pool*, left for the caller to
+ * fill. */
+ToxVideoFrame* ToxVideoFrame_new(frame_pool* pool, int format, int width,
+    int height);
+
+/* A new frame holding a copy of *pcm*, or left for the caller to fill if
+ * *pcm* is NULL. */
+ToxAudioFrame* ToxAudioFrame_new(frame_pool* pool, const int16_t* pcm,
+    int sample_count, int channels, int sampling_rate);
+
+#endif /* PYTOX_FRAME_H */
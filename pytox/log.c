@@ -0,0 +1,191 @@
+/**
+ * @file   log.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+void log_state_init(log_state* state)
+{
+  memset(state, 0, sizeof(log_state));
+  state->min_level = TOX_LOG_LEVEL_TRACE;
+  state->capacity = LOG_DEFAULT_CAPACITY;
+  state->rate = LOG_DEFAULT_RATE;
+  state->burst = LOG_DEFAULT_RATE;
+}
+
+void log_state_clear(log_state* state)
+{
+  size_t i;
+
+  for (i = 0; i < state->count; i++) {
+    log_record* record = &state->records[(state->start + i) % state->capacity];
+    free(record->file);
+    record->file = record->func = record->message = NULL;
+  }
+
+  state->start = 0;
+  state->count = 0;
+}
+
+void log_state_free(log_state* state)
+{
+  log_state_clear(state);
+  free(state->records);
+  state->records = NULL;
+}
+
+void log_state_set_capacity(log_state* state, size_t capacity)
+{
+  log_state_free(state);
+  state->capacity = capacity;
+}
+
+int log_rate_check(log_state* state, const char* file, uint32_t line,
+    uint64_t now_ms, uint32_t* suppressed)
+{
+  *suppressed = 0;
+
+  if (state->rate == 0) {
+    return 1;
+  }
+
+  /* direct mapped: a call site hashing to a taken slot starts afresh */
+  size_t slot = (((uintptr_t)file >> 3) * 31 + line) % LOG_SITES;
+  log_site* site = &state->sites[slot];
+  uint64_t burst = (uint64_t)(state->burst ? state->burst : 1) * 1000;
+
+  if (site->file != file || site->line != line) {
+    site->file = file;
+    site->line = line;
+    site->last_ms = now_ms;
+    site->tokens = burst;
+    site->suppressed = 0;
+  }
+
+  site->tokens += (now_ms - site->last_ms) * state->rate;
+  if (site->tokens > burst) {
+    site->tokens = burst;
+  }
+  site->last_ms = now_ms;
+
+  if (site->tokens < 1000) {
+    site->suppressed++;
+    state->suppressed++;
+    return 0;
+  }
+
+  site->tokens -= 1000;
+  *suppressed = site->suppressed;
+  site->suppressed = 0;
+
+  return 1;
+}
+
+void log_push(log_state* state, double time, TOX_LOG_LEVEL level,
+    const char* file, uint32_t line, const char* func, const char* message,
+    uint32_t suppressed)
+{
+  if (state->capacity == 0) {
+    return;
+  }
+
+  /* allocated on first use, as most instances never log */
+  if (state->records == NULL) {
+    state->records = (log_record*)calloc(state->capacity, sizeof(log_record));
+    if (state->records == NULL) {
+      return;
+    }
+  }
+
+  file = file ? file : "";
+  func = func ? func : "";
+  message = message ? message : "";
+
+  size_t file_length = strlen(file) + 1;
+  size_t func_length = strlen(func) + 1;
+  size_t message_length = strlen(message) + 1;
+  char* text = (char*)malloc(file_length + func_length + message_length);
+  if (text == NULL) {
+    return;
+  }
+
+  log_record* record = NULL;
+  if (state->count < state->capacity) {
+    record = &state->records[(state->start + state->count) % state->capacity];
+    state->count++;
+  } else {
+    record = &state->records[state->start];
+    state->start = (state->start + 1) % state->capacity;
+    free(record->file);
+  }
+
+  record->time = time;
+  record->level = level;
+  record->line = line;
+  record->suppressed = suppressed;
+  record->file = text;
+  record->func = text + file_length;
+  record->message = record->func + func_length;
+  memcpy(record->file, file, file_length);
+  memcpy(record->func, func, func_length);
+  memcpy(record->message, message, message_length);
+}
+
+const log_record* log_get(const log_state* state, size_t i)
+{
+  return &state->records[(state->start + i) % state->capacity];
+}
+
+int log_copy(log_state* state, log_record* records, int take)
+{
+  size_t i;
+
+  for (i = 0; i < state->count; i++) {
+    log_record* record = &state->records[(state->start + i) % state->capacity];
+    records[i] = *record;
+    if (take) {
+      record->file = record->func = record->message = NULL;
+      continue;
+    }
+
+    size_t length = (record->message - record->file) + strlen(record->message) + 1;
+    records[i].file = (char*)malloc(length);
+    if (records[i].file == NULL) {
+      while (i-- > 0) {
+        free(records[i].file);
+      }
+      return -1;
+    }
+    memcpy(records[i].file, record->file, length);
+    records[i].func = records[i].file + (record->func - record->file);
+    records[i].message = records[i].file + (record->message - record->file);
+  }
+
+  if (take) {
+    state->start = 0;
+    state->count = 0;
+  }
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file   log.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_LOG_H
+#define PYTOX_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tox/tox.h>
+
+#define LOG_DEFAULT_CAPACITY 128
+#define LOG_DEFAULT_RATE 50
+#define LOG_SITES 256
+
+typedef struct {
+  double time;          /* seconds since the epoch */
+  TOX_LOG_LEVEL level;
+  uint32_t line;
+  uint32_t suppressed;  /* records from the same call site dropped before */
+  char* file;           /* file, func and message share one allocation */
+  char* func;
+  char* message;
+} log_record;
+
+/* Token bucket of one call site, in thousandths of a record. */
+typedef struct {
+  const char* file;
+  uint32_t line;
+  uint64_t last_ms;
+  uint64_t tokens;
+  uint32_t suppressed;
+} log_site;
+
+/* Native log capture: level filter, per call site rate limit and a ring
+ * buffer of recent records. Nothing here touches Python. */
+typedef struct {
+  TOX_LOG_LEVEL min_level;
+
+  log_record* records;
+  size_t capacity;
+  size_t start;
+  size_t count;
+
+  /* records per second and burst per call site, 0 for no limit */
+  uint32_t rate;
+  uint32_t burst;
+  log_site sites[LOG_SITES];
+
+  uint64_t filtered;
+  uint64_t suppressed;
+} log_state;
+
+void log_state_init(log_state* state);
+
+void log_state_free(log_state* state);
+
+/* Resize the ring buffer, dropping buffered records. */
+void log_state_set_capacity(log_state* state, size_t capacity);
+
+void log_state_clear(log_state* state);
+
+/* Return 0 if a record from file:line has to be dropped by the rate limit,
+ * otherwise 1 with the number of records dropped since the last one from
+ * the call site in *suppressed*. */
+int log_rate_check(log_state* state, const char* file, uint32_t line,
+    uint64_t now_ms, uint32_t* suppressed);
+
+/* Append a record to the ring buffer, overwriting the oldest when full. */
+void log_push(log_state* state, double time, TOX_LOG_LEVEL level,
+    const char* file, uint32_t line, const char* func, const char* message,
+    uint32_t suppressed);
+
+/* The i-th oldest buffered record, i < state->count. */
+const log_record* log_get(const log_state* state, size_t i);
+
+/* Copy the buffered records, oldest first, to *records*, which has room for
+ * state->count of them, emptying the buffer if *take*. The copies own their
+ * text, freed with free(record->file). Returns -1 if out of memory. */
+int log_copy(log_state* state, log_record* records, int take);
+
+#endif /* PYTOX_LOG_H */
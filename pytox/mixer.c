@@ -0,0 +1,399 @@
+/**
+ * @file   mixer.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mixer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define MIXER_X86
+# include <immintrin.h>
+# define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define MIXER_NEON
+# include <arm_neon.h>
+#endif
+
+typedef void (*accumulate_fn)(int16_t* mix, const int16_t* in, size_t count,
+    int gain);
+
+typedef struct {
+  const char* name;
+  accumulate_fn accumulate;
+  int (*supported)(void);
+} kernel;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static const kernel* selected;
+
+static int16_t saturate(int32_t v)
+{
+  return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)v;
+}
+
+static void accumulate_tail(int16_t* mix, const int16_t* in, size_t count,
+    int gain, size_t i)
+{
+  if (gain == MIXER_UNITY_GAIN) {
+    for (; i < count; i++) {
+      mix[i] = saturate((int32_t)mix[i] + in[i]);
+    }
+    return;
+  }
+
+  for (; i < count; i++) {
+    int16_t scaled = saturate(((int32_t)in[i] * gain + (1 << 11)) >> 12);
+    mix[i] = saturate((int32_t)mix[i] + scaled);
+  }
+}
+
+static void accumulate_scalar(int16_t* mix, const int16_t* in, size_t count,
+    int gain)
+{
+  accumulate_tail(mix, in, count, gain, 0);
+}
+
+static int always(void)
+{
+  return 1;
+}
+
+#ifdef MIXER_X86
+TARGET("sse2")
+static void accumulate_sse2(int16_t* mix, const int16_t* in, size_t count,
+    int gain)
+{
+  size_t i = 0;
+
+  if (gain == MIXER_UNITY_GAIN) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i m = _mm_loadu_si128((const __m128i*)(mix + i));
+      __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+      _mm_storeu_si128((__m128i*)(mix + i), _mm_adds_epi16(m, x));
+    }
+  } else {
+    /* 32 bit products from their low and high halves */
+    __m128i g = _mm_set1_epi16((int16_t)gain);
+    __m128i round = _mm_set1_epi32(1 << 11);
+    for (; i + 8 <= count; i += 8) {
+      __m128i m = _mm_loadu_si128((const __m128i*)(mix + i));
+      __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+      __m128i low = _mm_mullo_epi16(x, g);
+      __m128i high = _mm_mulhi_epi16(x, g);
+      __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(low, high),
+            round), 12);
+      __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(low, high),
+            round), 12);
+      _mm_storeu_si128((__m128i*)(mix + i),
+          _mm_adds_epi16(m, _mm_packs_epi32(p0, p1)));
+    }
+  }
+
+  accumulate_tail(mix, in, count, gain, i);
+}
+
+static int has_sse2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+TARGET("avx2")
+static void accumulate_avx2(int16_t* mix, const int16_t* in, size_t count,
+    int gain)
+{
+  size_t i = 0;
+
+  if (gain == MIXER_UNITY_GAIN) {
+    for (; i + 16 <= count; i += 16) {
+      __m256i m = _mm256_loadu_si256((const __m256i*)(mix + i));
+      __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+      _mm256_storeu_si256((__m256i*)(mix + i), _mm256_adds_epi16(m, x));
+    }
+  } else {
+    /* unpacking and packing both work within 128 bit lanes, so the order
+     * comes out as it went in */
+    __m256i g = _mm256_set1_epi16((int16_t)gain);
+    __m256i round = _mm256_set1_epi32(1 << 11);
+    for (; i + 16 <= count; i += 16) {
+      __m256i m = _mm256_loadu_si256((const __m256i*)(mix + i));
+      __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+      __m256i low = _mm256_mullo_epi16(x, g);
+      __m256i high = _mm256_mulhi_epi16(x, g);
+      __m256i p0 = _mm256_srai_epi32(_mm256_add_epi32(
+            _mm256_unpacklo_epi16(low, high), round), 12);
+      __m256i p1 = _mm256_srai_epi32(_mm256_add_epi32(
+            _mm256_unpackhi_epi16(low, high), round), 12);
+      _mm256_storeu_si256((__m256i*)(mix + i),
+          _mm256_adds_epi16(m, _mm256_packs_epi32(p0, p1)));
+    }
+  }
+
+  accumulate_tail(mix, in, count, gain, i);
+}
+
+static int has_avx2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif /* MIXER_X86 */
+
+#ifdef MIXER_NEON
+static void accumulate_neon(int16_t* mix, const int16_t* in, size_t count,
+    int gain)
+{
+  size_t i = 0;
+
+  if (gain == MIXER_UNITY_GAIN) {
+    for (; i + 8 <= count; i += 8) {
+      vst1q_s16(mix + i, vqaddq_s16(vld1q_s16(mix + i), vld1q_s16(in + i)));
+    }
+  } else {
+    for (; i + 8 <= count; i += 8) {
+      int16x8_t x = vld1q_s16(in + i);
+      int32x4_t p0 = vmull_n_s16(vget_low_s16(x), (int16_t)gain);
+      int32x4_t p1 = vmull_n_s16(vget_high_s16(x), (int16_t)gain);
+      int16x8_t scaled = vcombine_s16(vqrshrn_n_s32(p0, 12),
+          vqrshrn_n_s32(p1, 12));
+      vst1q_s16(mix + i, vqaddq_s16(vld1q_s16(mix + i), scaled));
+    }
+  }
+
+  accumulate_tail(mix, in, count, gain, i);
+}
+#endif /* MIXER_NEON */
+
+/* Best first. */
+static const kernel kernels[] = {
+#ifdef MIXER_X86
+  {"avx2", accumulate_avx2, has_avx2},
+  {"sse2", accumulate_sse2, has_sse2},
+#endif
+#ifdef MIXER_NEON
+  {"neon", accumulate_neon, always},
+#endif
+  {"scalar", accumulate_scalar, always},
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+static void init(void)
+{
+  size_t k;
+
+  for (k = 0; k < KERNEL_COUNT; k++) {
+    if (kernels[k].supported()) {
+      selected = &kernels[k];
+      break;
+    }
+  }
+}
+
+void mixer_accumulate(int16_t* mix, const int16_t* in, size_t count,
+    int gain)
+{
+  pthread_once(&init_once, init);
+  selected->accumulate(mix, in, count, gain);
+}
+
+const char* mixer_kernel(void)
+{
+  pthread_once(&init_once, init);
+  return selected->name;
+}
+
+int mixer_set_kernel(const char* name)
+{
+  size_t k;
+
+  pthread_once(&init_once, init);
+
+  for (k = 0; k < KERNEL_COUNT; k++) {
+    if (strcmp(kernels[k].name, name) == 0 && kernels[k].supported()) {
+      selected = &kernels[k];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+group_mixer* group_mixer_new(uint32_t rate, int channels, size_t frame_size)
+{
+  group_mixer* mixer = (group_mixer*)calloc(1, sizeof(group_mixer));
+  if (mixer == NULL) {
+    return NULL;
+  }
+
+  mixer->rate = rate;
+  mixer->channels = channels;
+  mixer->frame_size = frame_size;
+  mixer->mix = (int16_t*)malloc(frame_size * channels * sizeof(int16_t));
+  if (mixer->mix == NULL) {
+    free(mixer);
+    return NULL;
+  }
+
+  return mixer;
+}
+
+void group_mixer_free(group_mixer* mixer)
+{
+  size_t i;
+
+  if (mixer == NULL) {
+    return;
+  }
+
+  for (i = 0; i < mixer->peer_count; i++) {
+    audio_converter_free(&mixer->peers[i].converter);
+    audio_fifo_free(&mixer->peers[i].fifo);
+  }
+  free(mixer->peers);
+  free(mixer->mix);
+  free(mixer);
+}
+
+/* The queue of *peer*, added at unity gain if new. Groups are small
+ * enough for a linear search to beat hashing. */
+static mixer_peer* get_peer(group_mixer* mixer, int peer)
+{
+  size_t i;
+
+  for (i = 0; i < mixer->peer_count; i++) {
+    if (mixer->peers[i].peer == peer) {
+      return &mixer->peers[i];
+    }
+  }
+
+  if (mixer->peer_count == mixer->peer_size) {
+    size_t size = mixer->peer_size ? mixer->peer_size * 2 : 8;
+    mixer_peer* peers = (mixer_peer*)realloc(mixer->peers,
+        size * sizeof(mixer_peer));
+    if (peers == NULL) {
+      return NULL;
+    }
+    mixer->peers = peers;
+    mixer->peer_size = size;
+  }
+
+  mixer_peer* p = &mixer->peers[mixer->peer_count++];
+  p->peer = peer;
+  p->gain = MIXER_UNITY_GAIN;
+  audio_converter_init(&p->converter);
+  audio_fifo_init(&p->fifo, mixer->channels);
+
+  return p;
+}
+
+int group_mixer_set_gain(group_mixer* mixer, int peer, int gain)
+{
+  mixer_peer* p = get_peer(mixer, peer);
+  if (p == NULL) {
+    return -1;
+  }
+
+  p->gain = gain;
+
+  return 0;
+}
+
+int group_mixer_write(group_mixer* mixer, int peer, const int16_t* pcm,
+    size_t frames, int channels, uint32_t rate)
+{
+  mixer_peer* p = get_peer(mixer, peer);
+  if (p == NULL) {
+    return -1;
+  }
+
+  if (audio_converter_set(&p->converter, rate, channels, mixer->rate,
+        mixer->channels) == -1) {
+    return -1;
+  }
+
+  /* resampled peers start half a frame late, so that the resampler's delay
+   * and rounding never leave them short of a frame when mixed */
+  if (p->fifo.frames == 0 && p->converter.resampler != NULL &&
+      audio_fifo_write(&p->fifo, NULL, mixer->frame_size / 2) == -1) {
+    return -1;
+  }
+
+  long count = audio_convert(&p->converter, pcm, frames, &pcm);
+  if (count == -1 || audio_fifo_write(&p->fifo, pcm, count) == -1) {
+    return -1;
+  }
+
+  size_t max = mixer->frame_size * MIXER_MAX_QUEUE;
+  if (p->fifo.frames > max) {
+    audio_fifo_consume(&p->fifo, p->fifo.frames - max);
+  }
+
+  return 0;
+}
+
+int group_mixer_mix(group_mixer* mixer)
+{
+  size_t frame_size = mixer->frame_size;
+  int ready = 0, waiting = 0, overdue = 0;
+  size_t i;
+
+  for (i = 0; i < mixer->peer_count; i++) {
+    size_t queued = mixer->peers[i].fifo.frames;
+    if (queued >= frame_size) {
+      ready = 1;
+    } else if (queued > 0) {
+      waiting = 1;
+    }
+    if (queued >= frame_size * MIXER_MAX_WAIT) {
+      overdue = 1;
+    }
+  }
+
+  if (!ready || (waiting && !overdue)) {
+    return 0;
+  }
+
+  memset(mixer->mix, 0, frame_size * mixer->channels * sizeof(int16_t));
+  mixer->mixed_peers = 0;
+
+  for (i = 0; i < mixer->peer_count; i++) {
+    mixer_peer* p = &mixer->peers[i];
+    size_t n = p->fifo.frames < frame_size ? p->fifo.frames : frame_size;
+    if (n == 0) {
+      continue;
+    }
+
+    if (p->gain != 0) {
+      mixer_accumulate(mixer->mix, p->fifo.samples, n * mixer->channels,
+          p->gain);
+      mixer->mixed_peers++;
+    }
+    audio_fifo_consume(&p->fifo, n);
+  }
+
+  return 1;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file   mixer.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_MIXER_H
+#define PYTOX_MIXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+
+/* Mixing of group audio: every peer's PCM is converted to one format,
+ * queued, and summed a frame at a time with saturating addition. The
+ * accumulate kernel is picked once at runtime from what the CPU supports,
+ * and every kernel produces exactly the samples the scalar one does.
+ * Nothing here touches Python. */
+
+/* Gains are fixed point with 12 fractional bits, up to 4x. */
+#define MIXER_UNITY_GAIN 4096
+#define MIXER_MAX_GAIN (4 * MIXER_UNITY_GAIN)
+
+/* Frames a peer may run ahead of the mix before its oldest audio is
+ * dropped, and how far ahead one may be before the mix stops waiting for
+ * the others. */
+#define MIXER_MAX_QUEUE 5
+#define MIXER_MAX_WAIT 2
+
+/* Add *count* samples of *in* times gain / MIXER_UNITY_GAIN to *mix*,
+ * rounding the product and saturating both it and the sum to 16 bits. */
+void mixer_accumulate(int16_t* mix, const int16_t* in, size_t count,
+    int gain);
+
+/* Name of the kernel in use: "scalar", "sse2", "avx2" or "neon". */
+const char* mixer_kernel(void);
+
+/* Switch to the kernel called *name*, for tests and benchmarks. Returns -1
+ * if this build or CPU lacks it. */
+int mixer_set_kernel(const char* name);
+
+typedef struct {
+  int peer;
+  int gain;
+  audio_converter converter;
+  audio_fifo fifo;
+} mixer_peer;
+
+/* Mixer of one group, producing frame_size frames at *rate* and
+ * *channels*. */
+typedef struct {
+  uint32_t rate;
+  int channels;
+  size_t frame_size;
+  mixer_peer* peers;
+  size_t peer_count;
+  size_t peer_size;
+  int16_t* mix;                 /* the last frame mixed */
+  int mixed_peers;              /* peers heard in it */
+} group_mixer;
+
+/* Returns NULL if out of memory. */
+group_mixer* group_mixer_new(uint32_t rate, int channels, size_t frame_size);
+
+void group_mixer_free(group_mixer* mixer);
+
+/* Scale the audio of *peer* by gain / MIXER_UNITY_GAIN, 0 to mute it.
+ * Returns -1 if out of memory. */
+int group_mixer_set_gain(group_mixer* mixer, int peer, int gain);
+
+/* Queue PCM received from *peer* in any format audio_converter takes.
+ * Peers needing resampling start with half a frame of silence. Returns -1
+ * if out of memory. */
+int group_mixer_write(group_mixer* mixer, int peer, const int16_t* pcm,
+    size_t frames, int channels, uint32_t rate);
+
+/* Mix the next frame into mixer->mix. A frame is mixed once some peer has
+ * a whole frame queued and every other peer with audio queued has one
+ * too, or after waiting MIXER_MAX_WAIT frames for them, in which case they
+ * contribute what they have. Returns 1 if a frame was mixed, otherwise
+ * 0. */
+int group_mixer_mix(group_mixer* mixer);
+
+#endif /* PYTOX_MIXER_H */
@@ -0,0 +1,439 @@
+/**
+ * @file   options.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+
+#include "options.h"
+#include "util.h"
+
+/* toxcore limit on proxy host names, see TOX_ERR_NEW_PROXY_BAD_HOST */
+#define MAX_HOSTNAME_LENGTH 255
+
+static PyObject*
+ToxOptions_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+  ToxOptions* self = (ToxOptions*)type->tp_alloc(type, 0);
+  if (self == NULL) {
+    return NULL;
+  }
+
+  tox_options_default(&self->options);
+  self->options.savedata_type = TOX_SAVEDATA_TYPE_NONE;
+  self->options.savedata_data = NULL;
+  self->options.savedata_length = 0;
+  self->options.proxy_host = NULL;
+  self->options.log_callback = NULL;
+  self->options.log_user_data = NULL;
+
+  Py_INCREF(Py_None);
+  self->proxy_host = Py_None;
+  Py_INCREF(Py_None);
+  self->savedata_data = Py_None;
+  Py_INCREF(Py_None);
+  self->savedata_path = Py_None;
+  Py_INCREF(Py_None);
+  self->savedata_passphrase = Py_None;
+
+  return (PyObject*)self;
+}
+
+static int
+ToxOptions_init(ToxOptions* self, PyObject* args, PyObject* kwds)
+{
+  if (PyTuple_GET_SIZE(args) != 0) {
+    PyErr_SetString(PyExc_TypeError, "Options() takes keyword arguments only");
+    return -1;
+  }
+
+  /* keyword arguments go through the same validating setters as
+   * attribute assignment */
+  PyObject* key = NULL;
+  PyObject* value = NULL;
+  Py_ssize_t pos = 0;
+  while (kwds != NULL && PyDict_Next(kwds, &pos, &key, &value)) {
+    if (PyObject_SetAttr((PyObject*)self, key, value) == -1) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void
+ToxOptions_dealloc(ToxOptions* self)
+{
+  Py_XDECREF(self->proxy_host);
+  Py_XDECREF(self->savedata_data);
+  Py_XDECREF(self->savedata_path);
+  Py_XDECREF(self->savedata_passphrase);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject*
+ToxOptions_copy(ToxOptions* self, PyObject* args)
+{
+  ToxOptions* copy = (ToxOptions*)ToxOptionsType.tp_alloc(&ToxOptionsType, 0);
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  copy->options = self->options;
+
+  Py_INCREF(self->proxy_host);
+  copy->proxy_host = self->proxy_host;
+  Py_INCREF(self->savedata_data);
+  copy->savedata_data = self->savedata_data;
+  Py_INCREF(self->savedata_path);
+  copy->savedata_path = self->savedata_path;
+  Py_INCREF(self->savedata_passphrase);
+  copy->savedata_passphrase = self->savedata_passphrase;
+
+  return (PyObject*)copy;
+}
+
+static int
+check_delete(PyObject* value)
+{
+  if (value == NULL) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete option");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Read an integer option and check it is within [min, max]. */
+static int
+get_ranged_long(PyObject* value, long min, long max, long* result)
+{
+  if (check_delete(value) == -1) {
+    return -1;
+  }
+
+  long v = PyLong_AsLong(value);
+  if (v == -1 && PyErr_Occurred()) {
+    return -1;
+  }
+
+  if (v < min || v > max) {
+    PyErr_Format(PyExc_ValueError, "option must be in range [%ld, %ld]",
+        min, max);
+    return -1;
+  }
+
+  *result = v;
+
+  return 0;
+}
+
+/* Boolean options, closure is the offset of the field in Tox_Options. */
+
+static PyObject*
+ToxOptions_get_bool(ToxOptions* self, void* closure)
+{
+  bool* field = (bool*)((char*)&self->options + (size_t)closure);
+  return PyBool_FromLong(*field);
+}
+
+static int
+ToxOptions_set_bool(ToxOptions* self, PyObject* value, void* closure)
+{
+  if (check_delete(value) == -1) {
+    return -1;
+  }
+
+  int truth = PyObject_IsTrue(value);
+  if (truth == -1) {
+    return -1;
+  }
+
+  bool* field = (bool*)((char*)&self->options + (size_t)closure);
+  *field = truth;
+
+  return 0;
+}
+
+/* Port options, closure is the offset of the field in Tox_Options. */
+
+static PyObject*
+ToxOptions_get_port(ToxOptions* self, void* closure)
+{
+  uint16_t* field = (uint16_t*)((char*)&self->options + (size_t)closure);
+  return PyLong_FromLong(*field);
+}
+
+static int
+ToxOptions_set_port(ToxOptions* self, PyObject* value, void* closure)
+{
+  long port = 0;
+  if (get_ranged_long(value, 0, 65535, &port) == -1) {
+    return -1;
+  }
+
+  uint16_t* field = (uint16_t*)((char*)&self->options + (size_t)closure);
+  *field = port;
+
+  return 0;
+}
+
+static PyObject*
+ToxOptions_get_proxy_type(ToxOptions* self, void* closure)
+{
+  return PyLong_FromLong(self->options.proxy_type);
+}
+
+static int
+ToxOptions_set_proxy_type(ToxOptions* self, PyObject* value, void* closure)
+{
+  long type = 0;
+  if (get_ranged_long(value, TOX_PROXY_TYPE_NONE, TOX_PROXY_TYPE_SOCKS5,
+        &type) == -1) {
+    return -1;
+  }
+
+  self->options.proxy_type = type;
+
+  return 0;
+}
+
+static PyObject*
+ToxOptions_get_savedata_type(ToxOptions* self, void* closure)
+{
+  return PyLong_FromLong(self->options.savedata_type);
+}
+
+static int
+ToxOptions_set_savedata_type(ToxOptions* self, PyObject* value, void* closure)
+{
+  long type = 0;
+  if (get_ranged_long(value, TOX_SAVEDATA_TYPE_NONE,
+        TOX_SAVEDATA_TYPE_SECRET_KEY, &type) == -1) {
+    return -1;
+  }
+
+  self->options.savedata_type = type;
+
+  return 0;
+}
+
+/* Object options, closure is the offset of the field in ToxOptions. */
+
+#define OBJECT_FIELD(self, closure) \
+  ((PyObject**)((char*)(self) + (size_t)(closure)))
+
+static PyObject*
+ToxOptions_get_object(ToxOptions* self, void* closure)
+{
+  PyObject* value = *OBJECT_FIELD(self, closure);
+  Py_INCREF(value);
+  return value;
+}
+
+static void
+replace_object(ToxOptions* self, void* closure, PyObject* value)
+{
+  PyObject** field = OBJECT_FIELD(self, closure);
+  PyObject* old = *field;
+  Py_INCREF(value);
+  *field = value;
+  Py_DECREF(old);
+}
+
+static int
+ToxOptions_set_string(ToxOptions* self, PyObject* value, void* closure)
+{
+  if (check_delete(value) == -1) {
+    return -1;
+  }
+
+  if (value != Py_None && !PYSTRING_Check(value) && !PyUnicode_Check(value)) {
+    PyErr_SetString(PyExc_TypeError, "option must be a string or None");
+    return -1;
+  }
+
+  replace_object(self, closure, value);
+
+  return 0;
+}
+
+static int
+ToxOptions_set_proxy_host(ToxOptions* self, PyObject* value, void* closure)
+{
+  if (check_delete(value) == -1) {
+    return -1;
+  }
+
+  if (value != Py_None) {
+    char* host = NULL;
+    Py_ssize_t length = 0;
+
+    if (!PYSTRING_Check(value) && !PyUnicode_Check(value)) {
+      PyErr_SetString(PyExc_TypeError, "proxy_host must be a string or None");
+      return -1;
+    }
+
+    PyStringUnicode_AsStringAndSize(value, &host, &length);
+    if (host == NULL) {
+      return -1;
+    }
+
+    if (length > MAX_HOSTNAME_LENGTH) {
+      PyErr_Format(PyExc_ValueError, "proxy_host longer than %d bytes",
+          MAX_HOSTNAME_LENGTH);
+      return -1;
+    }
+  }
+
+  replace_object(self, closure, value);
+
+  return 0;
+}
+
+static int
+ToxOptions_set_savedata_data(ToxOptions* self, PyObject* value, void* closure)
+{
+  if (check_delete(value) == -1) {
+    return -1;
+  }
+
+  if (value != Py_None && !PyObject_CheckBuffer(value)) {
+    PyErr_SetString(PyExc_TypeError,
+        "savedata_data must support the buffer protocol");
+    return -1;
+  }
+
+  replace_object(self, closure, value);
+
+  return 0;
+}
+
+static PyMethodDef ToxOptions_methods[] = {
+  {
+    "copy", (PyCFunction)ToxOptions_copy, METH_NOARGS,
+    "copy()\n"
+    "Return a shallow copy of the options, without re-validating them."
+  },
+  {
+    "__copy__", (PyCFunction)ToxOptions_copy, METH_NOARGS,
+    "__copy__()\n"
+    "Same as copy()."
+  },
+  {NULL}
+};
+
+#define BOOL_GETSET(name, doc)                                          \
+  {                                                                     \
+    #name, (getter)ToxOptions_get_bool, (setter)ToxOptions_set_bool,    \
+    doc, (void*)offsetof(struct Tox_Options, name)                      \
+  }
+
+#define PORT_GETSET(name, doc)                                          \
+  {                                                                     \
+    #name, (getter)ToxOptions_get_port, (setter)ToxOptions_set_port,    \
+    doc, (void*)offsetof(struct Tox_Options, name)                      \
+  }
+
+#define OBJECT_GETSET(name, set, doc)                                   \
+  {                                                                     \
+    #name, (getter)ToxOptions_get_object, (setter)set,                  \
+    doc, (void*)offsetof(ToxOptions, name)                              \
+  }
+
+static PyGetSetDef ToxOptions_getset[] = {
+  BOOL_GETSET(ipv6_enabled, "Use IPv6, default True."),
+  BOOL_GETSET(udp_enabled, "Use UDP, default True."),
+  BOOL_GETSET(local_discovery_enabled,
+      "Look for peers on the local network, default True."),
+  BOOL_GETSET(hole_punching_enabled,
+      "Try UDP hole punching with peers, default True."),
+  {
+    "proxy_type", (getter)ToxOptions_get_proxy_type,
+    (setter)ToxOptions_set_proxy_type,
+    "Proxy type: 0 none, 1 http, 2 socks5.", NULL
+  },
+  OBJECT_GETSET(proxy_host, ToxOptions_set_proxy_host,
+      "Proxy host name or address, or None."),
+  PORT_GETSET(proxy_port, "Proxy port."),
+  PORT_GETSET(start_port, "Start of the UDP port range, 0 for default."),
+  PORT_GETSET(end_port, "End of the UDP port range, 0 for default."),
+  PORT_GETSET(tcp_port, "Port of the TCP relay server, 0 to disable."),
+  {
+    "savedata_type", (getter)ToxOptions_get_savedata_type,
+    (setter)ToxOptions_set_savedata_type,
+    "Savedata type: 0 none, 1 toxsave, 2 secret key. Defaults to toxsave "
+    "when savedata is given.", NULL
+  },
+  OBJECT_GETSET(savedata_data, ToxOptions_set_savedata_data,
+      "Savedata as any buffer object, or None."),
+  OBJECT_GETSET(savedata_path, ToxOptions_set_string,
+      "Path of a savedata file to load in place, or None."),
+  OBJECT_GETSET(savedata_passphrase, ToxOptions_set_string,
+      "Passphrase of encrypted savedata, or None."),
+  {NULL}
+};
+
+PyTypeObject ToxOptionsType = {
+#if PY_MAJOR_VERSION >= 3
+  PyVarObject_HEAD_INIT(NULL, 0)
+#else
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+#endif
+  "Options",                 /*tp_name*/
+  sizeof(ToxOptions),        /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)ToxOptions_dealloc, /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  0,                         /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  0,                         /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT,        /*tp_flags*/
+  "Options(**kwargs)\n"
+  "Options for Tox(), validated on assignment", /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  0,                         /* tp_iter */
+  0,                         /* tp_iternext */
+  ToxOptions_methods,        /* tp_methods */
+  0,                         /* tp_members */
+  ToxOptions_getset,         /* tp_getset */
+  0,                         /* tp_base */
+  0,                         /* tp_dict */
+  0,                         /* tp_descr_get */
+  0,                         /* tp_descr_set */
+  0,                         /* tp_dictoffset */
+  (initproc)ToxOptions_init, /* tp_init */
+  0,                         /* tp_alloc */
+  ToxOptions_new,            /* tp_new */
+};
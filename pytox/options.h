@@ -0,0 +1,43 @@
+/**
+ * @file   options.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_OPTIONS_H
+#define PYTOX_OPTIONS_H
+
+#include <Python.h>
+#include <tox/tox.h>
+
+/* ToxOptions definition: the scalar fields live in *options*, which is
+ * validated on assignment and copied into tox_new() as is. Pointer fields
+ * are kept as Python objects (None when unset) and resolved by Tox(). */
+typedef struct {
+  PyObject_HEAD
+  struct Tox_Options options;
+  PyObject* proxy_host;
+  PyObject* savedata_data;
+  PyObject* savedata_path;
+  PyObject* savedata_passphrase;
+} ToxOptions;
+
+extern PyTypeObject ToxOptionsType;
+
+#endif /* PYTOX_OPTIONS_H */
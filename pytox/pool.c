@@ -0,0 +1,165 @@
+/**
+ * @file   pool.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+struct pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+
+  /* serializes pool_run() callers */
+  pthread_mutex_t run_lock;
+
+  pthread_t* threads;
+  int nthreads;
+  int stop;
+
+  /* current job, protected by lock */
+  pool_task task;
+  void* arg;
+  size_t count;
+  size_t next;
+  size_t done;
+};
+
+/* Run tasks of the current job until none is left, with pool->lock held on
+ * entry and exit. */
+static void run_tasks(pool_t* pool)
+{
+  while (pool->next < pool->count) {
+    size_t index = pool->next++;
+    pool_task task = pool->task;
+    void* arg = pool->arg;
+
+    pthread_mutex_unlock(&pool->lock);
+    task(arg, index);
+    pthread_mutex_lock(&pool->lock);
+
+    if (++pool->done == pool->count) {
+      pthread_cond_broadcast(&pool->done_cond);
+    }
+  }
+}
+
+static void* pool_worker(void* arg)
+{
+  pool_t* pool = (pool_t*)arg;
+
+  pthread_mutex_lock(&pool->lock);
+  while (!pool->stop) {
+    run_tasks(pool);
+    if (!pool->stop) {
+      pthread_cond_wait(&pool->work_cond, &pool->lock);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+pool_t* pool_new(int nthreads)
+{
+  pool_t* pool = (pool_t*)calloc(1, sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  pool->threads = (pthread_t*)calloc(nthreads > 0 ? nthreads : 1,
+      sizeof(pthread_t));
+  if (pool->threads == NULL) {
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_mutex_init(&pool->run_lock, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+
+  for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++) {
+    if (pthread_create(&pool->threads[pool->nthreads], NULL, pool_worker,
+          pool) != 0) {
+      pool_free(pool);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
+
+void pool_run(pool_t* pool, size_t count, pool_task task, void* arg)
+{
+  pthread_mutex_lock(&pool->run_lock);
+  pthread_mutex_lock(&pool->lock);
+
+  pool->task = task;
+  pool->arg = arg;
+  pool->count = count;
+  pool->next = 0;
+  pool->done = 0;
+
+  if (pool->nthreads > 0 && count > 1) {
+    pthread_cond_broadcast(&pool->work_cond);
+  }
+
+  run_tasks(pool);
+  while (pool->done < pool->count) {
+    pthread_cond_wait(&pool->done_cond, &pool->lock);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->run_lock);
+}
+
+void pool_free(pool_t* pool)
+{
+  int i;
+
+  if (pool == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < pool->nthreads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_mutex_destroy(&pool->run_lock);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->threads);
+  free(pool);
+}
+
+int pool_size(const pool_t* pool)
+{
+  return pool->nthreads;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file   pool.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_POOL_H
+#define PYTOX_POOL_H
+
+#include <stddef.h>
+
+/* A fixed set of native worker threads running indexed tasks. Nothing here
+ * touches Python, so callers should release the GIL around pool_run() when
+ * their tasks do not need it either. */
+typedef struct pool pool_t;
+
+typedef void (*pool_task)(void* arg, size_t index);
+
+/* Start *nthreads* workers, which may be 0. Returns NULL on failure. */
+pool_t* pool_new(int nthreads);
+
+/* Run task(arg, i) for every i in [0, count) and return once all of them
+ * have finished. The calling thread runs tasks too. Calls on the same pool
+ * are serialized. */
+void pool_run(pool_t* pool, size_t count, pool_task task, void* arg);
+
+/* Stop and join the workers. */
+void pool_free(pool_t* pool);
+
+int pool_size(const pool_t* pool);
+
+#endif /* PYTOX_POOL_H */
@@ -24,6 +24,7 @@
 #include <stdio.h>
 
 #include "core.h"
+#include "options.h"
 #include "util.h"
 
 #ifdef ENABLE_AV
@@ -73,6 +74,27 @@ PyMODINIT_FUNC initpytox(void)
   Py_INCREF(&ToxCoreType);
   PyModule_AddObject(m, "Tox", (PyObject*)&ToxCoreType);
 
+  if (PyType_Ready(&ToxFriendType) < 0) {
+    fprintf(stderr, "Invalid PyTypeObject `ToxFriendType'\n");
+    goto error;
+  }
+
+  Py_INCREF(&ToxFriendType);
+  PyModule_AddObject(m, "Friend", (PyObject*)&ToxFriendType);
+
+  if (PyType_Ready(&ToxFriendIterType) < 0) {
+    fprintf(stderr, "Invalid PyTypeObject `ToxFriendIterType'\n");
+    goto error;
+  }
+
+  if (PyType_Ready(&ToxOptionsType) < 0) {
+    fprintf(stderr, "Invalid PyTypeObject `ToxOptionsType'\n");
+    goto error;
+  }
+
+  Py_INCREF(&ToxOptionsType);
+  PyModule_AddObject(m, "Options", (PyObject*)&ToxOptionsType);
+
   ToxOpError = PyErr_NewException("pytox.OperationFailedError", NULL, NULL);
   PyModule_AddObject(m, "OperationFailedError", (PyObject*)ToxOpError);
 
@@ -85,6 +107,22 @@ PyMODINIT_FUNC initpytox(void)
 
   Py_INCREF(&ToxAVCoreType);
   PyModule_AddObject(m, "ToxAV", (PyObject*)&ToxAVCoreType);
+
+  if (PyType_Ready(&ToxVideoFrameType) < 0) {
+    fprintf(stderr, "Invalid PyTypeObject `ToxVideoFrameType'\n");
+    goto error;
+  }
+
+  Py_INCREF(&ToxVideoFrameType);
+  PyModule_AddObject(m, "VideoFrame", (PyObject*)&ToxVideoFrameType);
+
+  if (PyType_Ready(&ToxAudioFrameType) < 0) {
+    fprintf(stderr, "Invalid PyTypeObject `ToxAudioFrameType'\n");
+    goto error;
+  }
+
+  Py_INCREF(&ToxAudioFrameType);
+  PyModule_AddObject(m, "AudioFrame", (PyObject*)&ToxAudioFrameType);
 #endif
 
 #if PY_MAJOR_VERSION >= 3
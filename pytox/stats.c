@@ -0,0 +1,161 @@
+/**
+ * @file   stats.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+const uint32_t stats_histogram_bounds[STATS_HISTOGRAM_BUCKETS - 1] = {
+  100, 250, 500, 1000, 2000, 5000, 10000, 30000, 60000
+};
+
+void stats_histogram_add(stats_histogram* histogram, uint64_t ms)
+{
+  int i;
+
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; i++) {
+    if (ms < stats_histogram_bounds[i]) {
+      break;
+    }
+  }
+
+  histogram->counts[i]++;
+  histogram->total_ms += ms;
+  histogram->samples++;
+}
+
+void conn_stats_reset(conn_stats* stats, uint64_t now_ms)
+{
+  free(stats->friends);
+  memset(stats, 0, sizeof(conn_stats));
+  stats->start_ms = now_ms;
+  stats->self.since_ms = now_ms;
+}
+
+void conn_stats_free(conn_stats* stats)
+{
+  free(stats->friends);
+  stats->friends = NULL;
+  stats->friends_size = 0;
+}
+
+/* Apply a transition to *conn*, returning how long the previous state
+ * lasted. */
+static uint64_t transition(stats_connection* conn, TOX_CONNECTION status,
+    uint64_t now_ms)
+{
+  uint64_t duration = now_ms - conn->since_ms;
+
+  if (conn->status == TOX_CONNECTION_NONE) {
+    conn->connects++;
+  } else if (status == TOX_CONNECTION_NONE) {
+    conn->disconnects++;
+  } else {
+    conn->flaps++;
+  }
+
+  conn->status = status;
+  conn->since_ms = now_ms;
+
+  return duration;
+}
+
+void conn_stats_self(conn_stats* stats, TOX_CONNECTION status,
+    uint64_t now_ms)
+{
+  TOX_CONNECTION old = stats->self.status;
+  if (status == old) {
+    return;
+  }
+
+  uint64_t duration = transition(&stats->self, status, now_ms);
+
+  if (old == TOX_CONNECTION_NONE) {
+    stats_histogram_add(&stats->self_connect, duration);
+    if (stats->first_connected_ms == 0) {
+      stats->first_connected_ms = now_ms;
+    }
+  } else if (status == TOX_CONNECTION_NONE) {
+    stats_histogram_add(&stats->self_session, duration);
+  }
+}
+
+int conn_stats_friend(conn_stats* stats, uint32_t friend_number,
+    TOX_CONNECTION status, uint64_t now_ms)
+{
+  if (friend_number >= stats->friends_size) {
+    uint32_t size = stats->friends_size ? stats->friends_size : 16;
+    while (size <= friend_number) {
+      size *= 2;
+    }
+
+    stats_connection* friends = (stats_connection*)realloc(stats->friends,
+        size * sizeof(stats_connection));
+    if (friends == NULL) {
+      if (status == TOX_CONNECTION_NONE) {
+        stats->friend_disconnects++;
+      } else {
+        stats->friend_connects++;
+      }
+      return -1;
+    }
+
+    /* friends not seen yet count as offline since the start */
+    uint32_t i;
+    for (i = stats->friends_size; i < size; i++) {
+      memset(&friends[i], 0, sizeof(stats_connection));
+      friends[i].since_ms = stats->start_ms;
+    }
+
+    stats->friends = friends;
+    stats->friends_size = size;
+  }
+
+  stats_connection* conn = &stats->friends[friend_number];
+  TOX_CONNECTION old = conn->status;
+  if (status == old) {
+    return 0;
+  }
+
+  uint64_t duration = transition(conn, status, now_ms);
+
+  if (old == TOX_CONNECTION_NONE) {
+    stats->friend_connects++;
+  } else if (status == TOX_CONNECTION_NONE) {
+    stats->friend_disconnects++;
+    stats_histogram_add(&stats->friend_session, duration);
+  } else {
+    stats->friend_flaps++;
+  }
+
+  return 0;
+}
+
+void conn_stats_friend_removed(conn_stats* stats, uint32_t friend_number,
+    uint64_t now_ms)
+{
+  if (friend_number < stats->friends_size) {
+    memset(&stats->friends[friend_number], 0, sizeof(stats_connection));
+    stats->friends[friend_number].since_ms = now_ms;
+  }
+}
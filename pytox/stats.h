@@ -0,0 +1,84 @@
+/**
+ * @file   stats.h
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PYTOX_STATS_H
+#define PYTOX_STATS_H
+
+#include <stdint.h>
+#include <tox/tox.h>
+
+/* Upper bounds of the duration histogram buckets in milliseconds, the last
+ * bucket counts everything longer. */
+#define STATS_HISTOGRAM_BUCKETS 10
+extern const uint32_t stats_histogram_bounds[STATS_HISTOGRAM_BUCKETS - 1];
+
+typedef struct {
+  uint64_t counts[STATS_HISTOGRAM_BUCKETS];
+  uint64_t total_ms;
+  uint64_t samples;
+} stats_histogram;
+
+void stats_histogram_add(stats_histogram* histogram, uint64_t ms);
+
+/* Connection state of one peer, self or a friend. */
+typedef struct {
+  TOX_CONNECTION status;
+  uint64_t since_ms;     /* last transition, or start */
+  uint64_t connects;     /* NONE -> TCP/UDP */
+  uint64_t disconnects;  /* TCP/UDP -> NONE */
+  uint64_t flaps;        /* TCP <-> UDP */
+} stats_connection;
+
+/* Connection instrumentation of a Tox instance, fed from the toxcore
+ * connection callbacks. Timestamps are current_time_monotonic_ms(). */
+typedef struct {
+  uint64_t start_ms;
+  uint64_t first_connected_ms;  /* 0 until connected once */
+  stats_connection self;
+  stats_histogram self_connect;     /* time spent disconnected */
+  stats_histogram self_session;     /* time spent connected */
+
+  stats_connection* friends;        /* indexed by friend number */
+  uint32_t friends_size;
+  uint64_t friend_connects;
+  uint64_t friend_disconnects;
+  uint64_t friend_flaps;
+  stats_histogram friend_session;   /* time friends stayed online */
+} conn_stats;
+
+/* Reset *stats*, freeing per friend state. */
+void conn_stats_reset(conn_stats* stats, uint64_t now_ms);
+
+void conn_stats_free(conn_stats* stats);
+
+void conn_stats_self(conn_stats* stats, TOX_CONNECTION status,
+    uint64_t now_ms);
+
+/* Returns -1 if out of memory, in which case the change is only counted. */
+int conn_stats_friend(conn_stats* stats, uint32_t friend_number,
+    TOX_CONNECTION status, uint64_t now_ms);
+
+/* Forget a deleted friend. */
+void conn_stats_friend_removed(conn_stats* stats, uint32_t friend_number,
+    uint64_t now_ms);
+
+#endif /* PYTOX_STATS_H */
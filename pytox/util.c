@@ -20,6 +20,14 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "util.h"
 
 PyObject* ToxOpError;
@@ -78,3 +86,80 @@ void PyStringUnicode_AsStringAndSize(PyObject* object, char** str,
 # endif
 #endif
 }
+
+uint64_t current_time_monotonic_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int write_file_atomic(const char* path, const uint8_t* data, size_t length)
+{
+  size_t path_len = strlen(path);
+  char* tmp_path = malloc(path_len + sizeof(".tmp"));
+  if (tmp_path == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  memcpy(tmp_path, path, path_len);
+  memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    free(tmp_path);
+    return -1;
+  }
+
+  size_t written = 0;
+  while (written < length) {
+    ssize_t ret = write(fd, data + written, length - written);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      goto error;
+    }
+    written += ret;
+  }
+
+  if (fsync(fd) == -1) {
+    goto error;
+  }
+
+  if (close(fd) == -1) {
+    fd = -1;
+    goto error;
+  }
+  fd = -1;
+
+  if (rename(tmp_path, path) == -1) {
+    goto error;
+  }
+
+  /* Make the rename itself durable. */
+  char* dir_path = strdup(path);
+  if (dir_path != NULL) {
+    int dir_fd = open(dirname(dir_path), O_RDONLY);
+    if (dir_fd != -1) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+    free(dir_path);
+  }
+
+  free(tmp_path);
+  return 0;
+
+error:
+  {
+    int saved_errno = errno;
+    if (fd != -1) {
+      close(fd);
+    }
+    unlink(tmp_path);
+    free(tmp_path);
+    errno = saved_errno;
+  }
+  return -1;
+}
@@ -28,8 +28,7 @@
 extern PyObject* ToxOpError;
 
 #define CHECK_TOX(self)                                        \
-  if ((self)->tox == NULL) {                                   \
-    PyErr_SetString(ToxOpError, "toxcore object killed.");     \
+  if (ToxCore_ensure_tox(self) == -1) {                        \
     return NULL;                                               \
   }
 
@@ -54,4 +53,12 @@ void hex_string_to_bytes(uint8_t* hexstr, int length, uint8_t* bytes);
 void PyStringUnicode_AsStringAndSize(PyObject* object, char** str,
     Py_ssize_t* len);
 
+/* Milliseconds from a monotonic clock, for measuring intervals. */
+uint64_t current_time_monotonic_ms(void);
+
+/* Write *data* to *path* through a temporary file which is fsync()ed and
+ * renamed over *path*. Returns 0 on success, -1 with errno set on failure.
+ * Does not touch any Python object, so it may run without the GIL. */
+int write_file_atomic(const char* path, const uint8_t* data, size_t length);
+
 #endif /* PYTOX_UTIL_H */
@@ -7,7 +7,9 @@ def supports_av():
     out, err = h.communicate()
     return 'toxav' not in str(err)
 
-sources = ["pytox/pytox.c", "pytox/core.c", "pytox/util.c"]
+sources = ["pytox/pytox.c", "pytox/core.c", "pytox/bootstrap.c",
+           "pytox/log.c", "pytox/options.c", "pytox/pool.c", "pytox/stats.c",
+           "pytox/util.c"]
 libraries = [
   "opus",
   "sodium",
@@ -35,7 +37,8 @@ cflags = [
 
 if supports_av():
     libraries.append("toxav")
-    sources.append("pytox/av.c")
+    sources.extend(["pytox/av.c", "pytox/audio.c", "pytox/convert.c",
+                    "pytox/frame.c", "pytox/mixer.c"])
     cflags.append("-DENABLE_AV")
 else:
     print("Warning: AV support not found, disabled.")
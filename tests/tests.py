@@ -26,7 +26,7 @@ import re
 import sys
 import unittest
 
-from pytox import Tox, OperationFailedError
+from pytox import Tox, ToxAV, Options, OperationFailedError
 from time import sleep
 
 ADDR_SIZE = 76
@@ -231,6 +231,164 @@ class ToxTest(unittest.TestCase):
         assert self.alice.self_get_connection_status() != Tox.CONNECTION_NONE
         assert self.bob.self_get_connection_status() != Tox.CONNECTION_NONE
 
+    def test_bootstrap_many(self):
+        """
+        t:bootstrap_many
+        """
+        pk = self.bob.self_get_address()[:CLIENT_ID_SIZE]
+        hosts = {'bob.test': '127.0.0.1'}
+        nodes = [('bob.test', 33445, pk), ['nowhere.test', 33445, pk]]
+
+        results = self.alice.bootstrap_many(nodes, resolver=hosts.get)
+        assert results[0] == ('127.0.0.1', True, True)
+        assert results[1] == (None, False, False)
+
+        results = self.alice.bootstrap_many([('127.0.0.1', 33445, pk)],
+                                            tcp_relay=False)
+        assert results == [('127.0.0.1', True, False)]
+
+        self.assertRaises(ValueError, self.alice.bootstrap_many,
+                          [('127.0.0.1', 33445, 'abc')])
+
+    def test_bootstrap_start(self):
+        """
+        t:bootstrap_start
+        t:bootstrap_stop
+        t:get_bootstrap_nodes
+        """
+        pk = self.bob.self_get_address()[:CLIENT_ID_SIZE]
+        hosts = {'a.test': '127.0.0.1', 'b.test': '127.0.0.2'}
+        nodes = [('a.test', 33445, pk), ('b.test', 33446, pk),
+                 ('nowhere.test', 33445, pk)]
+        path = 'bootstrap.scores'
+
+        try:
+            assert self.alice.bootstrap_start(nodes, path=path, batch=1,
+                                              resolver=hosts.get) == 2
+            stats = self.alice.get_bootstrap_nodes()
+            assert len(stats) == 3
+            assert stats[2]['ip'] is None and stats[2]['attempts'] == 0
+            self.alice.bootstrap_stop()
+            assert self.alice.get_bootstrap_nodes() == []
+            assert os.path.exists(path)
+        finally:
+            if os.path.exists(path):
+                os.remove(path)
+
+    def test_bootstrap_retry(self):
+        """
+        t:bootstrap_start
+        """
+        pk = self.bob.self_get_address()[:CLIENT_ID_SIZE]
+        hosts = {}
+        tox = Tox(ToxOptions())
+
+        try:
+            assert tox.bootstrap_start([('late.test', 33445, pk)], timeout=0.05,
+                                       resolver=hosts.get) == 0
+            assert tox.get_bootstrap_nodes()[0]['attempts'] == 0
+
+            # an empty batch is retried, resolving again first
+            hosts['late.test'] = '127.0.0.1'
+            sleep(0.1)
+            tox.iterate()
+            node = tox.get_bootstrap_nodes()[0]
+            assert node['ip'] == '127.0.0.1' and node['attempts'] == 1
+        finally:
+            tox.kill()
+
+    def test_bootstrap_scores(self):
+        """
+        t:bootstrap_start
+        t:bootstrap_stop
+        t:get_bootstrap_nodes
+        """
+        pk = self.bob.self_get_address()[:CLIENT_ID_SIZE]
+        nodes = [('127.0.0.1', port, pk) for port in (33445, 33446, 33447)]
+        path = 'bootstrap.scores'
+        tox = Tox(ToxOptions())
+
+        def ports():
+            return [node['port'] for node in tox.get_bootstrap_nodes()]
+
+        def node(port):
+            return [n for n in tox.get_bootstrap_nodes()
+                    if n['port'] == port][0]
+
+        try:
+            # scores are the connect time in ms times 1 + failures, and
+            # nodes never seen connecting rank at the timeout
+            with open(path, 'w') as f:
+                f.write('# pytox bootstrap scores v1\n')
+                f.write('%s 33446 4 2 1 10\n' % pk)
+                f.write('%s 33447 5 5 0 15\n' % pk)
+
+            tox.bootstrap_start(nodes, path=path, batch=1, timeout=0.05)
+            assert ports() == [33447, 33446, 33445]
+            assert node(33447)['attempts'] == 6
+            assert node(33446)['attempts'] == 4
+
+            # the timed out batch is penalized, the next one tries 33446
+            sleep(0.1)
+            tox.iterate()
+            assert node(33447)['failures'] == 1
+            assert ports() == [33446, 33447, 33445]
+            assert node(33446)['attempts'] == 5
+            tox.bootstrap_stop()
+
+            # scores persist across a restart
+            tox.bootstrap_start(nodes, path=path, batch=1, timeout=60)
+            assert ports() == [33446, 33447, 33445]
+            assert node(33447)['failures'] == 1
+            assert node(33446)['attempts'] == 6
+
+            # and the batch which got the instance connected is credited
+            for i in range(2000):
+                if tox.self_get_connection_status() != Tox.CONNECTION_NONE:
+                    break
+                tox.iterate()
+                self.loop(1)
+            assert tox.self_get_connection_status() != Tox.CONNECTION_NONE
+            credited = node(33446)
+            assert credited['successes'] == 3 and credited['failures'] == 0
+            assert credited['connect_time'] is not None
+        finally:
+            tox.kill()
+            if os.path.exists(path):
+                os.remove(path)
+
+    def test_log(self):
+        """
+        t:set_log_level
+        t:set_log_rate_limit
+        t:set_log_capacity
+        t:set_log_logger
+        t:get_log_records
+        """
+        class Logger(object):
+            def __init__(self):
+                self.records = []
+
+            def log(self, level, fmt, *args):
+                self.records.append((level, fmt % args))
+
+        logger = Logger()
+        self.alice.set_log_rate_limit(0)
+        self.alice.set_log_capacity(1000)
+        self.alice.set_log_logger(logger)
+        self.loop(20)
+        records = self.alice.get_log_records(clear=True)
+        assert len(records) == len(logger.records)
+        for (time, level, file, line, func, message, suppressed), \
+                (pylevel, text) in zip(records, logger.records):
+            assert message in text and suppressed == 0
+
+        self.alice.set_log_logger(None)
+        self.alice.set_log_level(Tox.LOG_LEVEL_ERROR + 1)
+        self.loop(20)
+        assert self.alice.get_log_records() == []
+        self.assertRaises(ValueError, self.alice.set_log_level, 99)
+
     def test_address(self):
         """
         t:self_get_address
@@ -321,10 +479,18 @@ class ToxTest(unittest.TestCase):
         """
         t:friend_get_connection_status
         t:on_friend_connection_status
+        t:get_stats
         """
         self.bob_add_alice_as_friend()
 
         AID = self.aid
+        stats = self.bob.get_stats()
+        assert stats['self']['connection'] != Tox.CONNECTION_NONE
+        assert stats['connect_time']['count'] >= 1
+        assert stats['time_to_first_connect'] <= stats['uptime']
+        assert stats['friends'][AID]['connection'] in (Tox.CONNECTION_TCP,
+                                                       Tox.CONNECTION_UDP)
+        friend_disconnects = stats['friend_disconnects']
 
         def on_friend_connection_status(self, friend_id, status):
             assert friend_id == AID
@@ -340,11 +506,21 @@ class ToxTest(unittest.TestCase):
         BobTox.on_friend_connection_status = Tox.on_friend_connection_status
 
         assert self.bob.friend_get_connection_status(self.aid) is False
+        stats = self.bob.get_stats()
+        assert stats['friends'][AID]['connection'] == Tox.CONNECTION_NONE
+        assert stats['friend_disconnects'] == friend_disconnects + 1
+        assert stats['friend_session_time']['count'] >= 1
 
     def test_tox(self):
         """
         t:get_savedata_size
         t:get_savedata
+        t:save_to_path
+        t:get_save_stats
+        t:mark_dirty
+        t:autosave_start
+        t:autosave_stop
+        t:set_savedata_passphrase
         """
         assert self.alice.get_savedata_size() > 0
         data = self.alice.get_savedata()
@@ -360,6 +536,98 @@ class ToxTest(unittest.TestCase):
         self.alice = Tox(opt)
         assert addr == self.alice.self_get_address()
 
+        path = 'alice.tox'
+        try:
+            assert self.alice.save_to_path(path) > 0
+            with open(path, 'rb') as f:
+                assert f.read() == self.alice.get_savedata()
+            assert not os.path.exists(path + '.tmp')
+
+            stats = self.alice.get_save_stats()
+            assert not stats['dirty']
+            assert stats['saves'] == 1
+            self.alice.self_set_name('Alice')
+            assert self.alice.get_save_stats()['dirty']
+
+            self.alice.autosave_start(path, 0.05)
+            assert self.alice.get_save_stats()['autosave']
+            for i in range(100):
+                if not self.alice.get_save_stats()['dirty']:
+                    break
+                sleep(0.05)
+            self.alice.autosave_stop()
+            assert not self.alice.get_save_stats()['dirty']
+            assert self.alice.get_save_stats()['saves'] == 2
+            self.alice.mark_dirty()
+            assert self.alice.get_save_stats()['dirty']
+
+            self.alice.set_savedata_passphrase('secret')
+            assert self.alice.get_save_stats()['encrypted']
+            self.alice.save_to_path(path)
+            self.alice.kill()
+
+            opt = ToxOptions()
+            with open(path, 'rb') as f:
+                opt.savedata_data = f.read()
+            self.assertRaises(OperationFailedError, Tox, opt)
+
+            # a failed __init__ must not leave a fresh identity behind
+            class CarelessTox(Tox):
+                def __init__(self, opts):
+                    try:
+                        super(CarelessTox, self).__init__(opts)
+                    except OperationFailedError:
+                        pass
+
+            tox = CarelessTox(opt)
+            self.assertRaises(OperationFailedError, tox.self_get_address)
+            self.assertRaises(OperationFailedError, tox.save_to_path, path)
+
+            opt.savedata_passphrase = 'secret'
+            self.alice = Tox(opt)
+            assert addr == self.alice.self_get_address()
+            assert self.alice.get_save_stats()['encrypted']
+            self.alice.kill()
+
+            opt = ToxOptions()
+            opt.savedata_path = path
+            opt.savedata_passphrase = 'secret'
+            self.alice = Tox(opt)
+            assert addr == self.alice.self_get_address()
+            self.alice.kill()
+
+            opt = ToxOptions()
+            opt.savedata_data = memoryview(bytearray(data))
+            self.alice = Tox(opt)
+            assert addr == self.alice.self_get_address()
+            self.alice.kill()
+
+            opt = Options(savedata_data=data, local_discovery_enabled=False)
+            assert opt.ipv6_enabled and not opt.local_discovery_enabled
+            self.assertRaises(ValueError, setattr, opt, 'tcp_port', 65536)
+            self.assertRaises(ValueError, setattr, opt, 'proxy_type', 3)
+            self.assertRaises(TypeError, setattr, opt, 'savedata_data', 1)
+            copy = opt.copy()
+            assert copy.savedata_data is data
+            assert not copy.local_discovery_enabled
+            self.alice = Tox(copy)
+            assert addr == self.alice.self_get_address()
+        finally:
+            os.remove(path)
+
+    def test_lazy_init(self):
+        """
+        t:kill
+        """
+        class LazyTox(Tox):
+            def __init__(self):
+                pass
+
+        tox = LazyTox()
+        assert len(tox.self_get_address()) == ADDR_SIZE
+        tox.kill()
+        self.assertRaises(OperationFailedError, tox.self_get_address)
+
     def test_friend(self):
         """
         t:friend_delete
@@ -367,6 +635,7 @@ class ToxTest(unittest.TestCase):
         t:friend_get_public_key
         t:self_get_friend_list
         t:self_get_friend_list_size
+        t:friends
         t:self_set_name
         t:friend_get_name
         t:friend_get_name_size
@@ -392,6 +661,8 @@ class ToxTest(unittest.TestCase):
         #: Test self_get_friend_list
         assert self.alice.self_get_friend_list() == [self.bid]
         assert self.bob.self_get_friend_list() == [self.aid]
+        assert list(self.alice.self_get_friend_list(as_array=True)) == \
+            [self.bid]
         assert self.alice.self_get_friend_list_size() == 1
         assert self.bob.self_get_friend_list_size() == 1
 
@@ -414,6 +685,15 @@ class ToxTest(unittest.TestCase):
         assert self.bob.friend_get_name_size(self.aid) == len(NEWNAME)
         BobTox.on_friend_name = Tox.on_friend_name
 
+        #: Test friend views
+        friends = list(self.bob.friends())
+        assert [f.number for f in friends] == [self.aid]
+        assert friends[0].name == NEWNAME
+        assert friends[0].public_key == \
+            self.alice.self_get_address()[:CLIENT_ID_SIZE]
+        assert friends[0].connection != Tox.CONNECTION_NONE
+        assert friends[0].last_online is not None
+
     def test_friend_message_and_action(self):
         """
         t:on_friend_action
@@ -619,6 +899,8 @@ class ToxTest(unittest.TestCase):
         assert len(self.alice.conference_get_chatlist()) == self.bob.conference_get_chatlist_size()
 
         assert self.bob.conference_get_chatlist_size() == 1
+        assert list(self.bob.conference_get_chatlist(as_array=True)) == \
+            [group_id]
         self.bob.conference_delete(group_id)
         assert self.bob.conference_get_chatlist_size() == 0
 
@@ -724,6 +1006,336 @@ class ToxTest(unittest.TestCase):
         BobTox.on_file_recv_control = Tox.on_file_recv_control
         BobTox.on_file_chunk_request = Tox.on_file_chunk_request
 
+    def test_av_audio_jitter(self):
+        """
+        t:set_audio_receive_format
+        t:set_audio_jitter_buffer
+        t:audio_read
+        t:get_audio_jitter_stats
+        """
+        av = ToxAV(self.alice)
+        bid = self.alice.friend_add_norequest(
+            self.bob.self_get_address()[:CLIENT_ID_SIZE])
+
+        self.assertRaises(ValueError, av.set_audio_jitter_buffer, 60)
+        self.assertRaises(ValueError, av.audio_read, bid, 480)
+        self.assertRaises(ValueError, av.set_audio_receive_format, 7999, 1)
+        self.assertRaises(ValueError, av.set_audio_receive_format, 48000, 3)
+        av.set_audio_receive_format(48000, 2)
+        self.assertRaises(ValueError, av.set_audio_jitter_buffer, -1)
+        self.assertRaises(ValueError, av.set_audio_jitter_buffer, 1001)
+        self.assertRaises(ValueError, av.set_audio_jitter_buffer, 60, 70)
+        av.set_audio_jitter_buffer(60)
+        self.assertRaises(ValueError, av.set_audio_receive_format, 0, 0)
+
+        # nothing is buffered yet, so reads play silence without counting
+        # as underruns
+        assert av.audio_read(bid, 480) == b'\0' * (480 * 2 * 2)
+        assert av.audio_read(bid, 441) == b'\0' * (441 * 2 * 2)
+        self.assertRaises(ValueError, av.audio_read, bid, 0)
+        self.assertRaises(ValueError, av.audio_read, 2 ** 31, 480)
+        assert av.get_audio_jitter_stats(bid) == {
+            'buffered': 0, 'received': 0, 'played': 0, 'concealed': 0,
+            'dropped': 0, 'underruns': 0}
+
+        av.set_audio_jitter_buffer(0)
+        av.set_audio_receive_format(0, 0)
+
+    def test_av_audio_gate(self):
+        """
+        t:set_audio_gate
+        t:get_audio_levels
+        """
+        av = ToxAV(self.alice)
+        bid = self.alice.friend_add_norequest(
+            self.bob.self_get_address()[:CLIENT_ID_SIZE])
+
+        levels = av.get_audio_levels(bid)
+        for key in ('send_rms', 'send_peak', 'receive_rms', 'receive_peak'):
+            assert levels[key] == float('-inf')
+        assert not levels['sending']
+        assert levels['sent'] == 0 and levels['suppressed'] == 0
+
+        self.assertRaises(ValueError, av.set_audio_gate, bid, 1)
+        self.assertRaises(ValueError, av.set_audio_gate, bid, -91)
+        self.assertRaises(ValueError, av.set_audio_gate, bid, -40, -1)
+        self.assertRaises(ValueError, av.set_audio_gate, 2 ** 31, -40)
+        av.set_audio_gate(bid, -40, 100)
+        assert av.get_audio_levels(bid) == levels
+        av.set_audio_gate(bid, 0)
+
+    def test_av_group_mixer(self):
+        """
+        t:set_group_mixer
+        t:set_group_peer_gain
+        """
+        av = ToxAV(self.alice)
+
+        self.assertRaises(ValueError, av.set_group_peer_gain, 0, 0, 1.0)
+        self.assertRaises(ValueError, av.set_group_mixer, -1, 48000, 2)
+        self.assertRaises(ValueError, av.set_group_mixer, 0, 48000, 2, -2)
+        self.assertRaises(ValueError, av.set_group_mixer, 0, 48000, 0)
+        self.assertRaises(ValueError, av.set_group_mixer, 0, 48000, 3)
+        self.assertRaises(ValueError, av.set_group_mixer, 0, 7999, 1)
+        self.assertRaises(ValueError, av.set_group_mixer, 0, 0, 1)
+        # groups are sent to at Opus rates only
+        self.assertRaises(ValueError, av.set_group_mixer, 0, 44100, 2,
+                          send_to=1)
+        av.set_group_mixer(0, 0, 0)
+        self.assertRaises(ValueError, av.set_group_peer_gain, 0, 0, 1.0)
+
+        av.set_group_mixer(0, 44100, 2)
+        av.set_group_mixer(1, 48000, 1, send_to=0)
+        self.assertRaises(ValueError, av.set_group_peer_gain, -1, 0, 1.0)
+        self.assertRaises(ValueError, av.set_group_peer_gain, 2, 0, 1.0)
+        self.assertRaises(ValueError, av.set_group_peer_gain, 0, 0, -0.5)
+        self.assertRaises(ValueError, av.set_group_peer_gain, 0, 0, 4.5)
+        self.assertRaises(ValueError, av.set_group_peer_gain, 0, 0,
+                          float('nan'))
+        av.set_group_peer_gain(0, 0, 0)
+        av.set_group_peer_gain(0, 3, 4)
+        av.set_group_peer_gain(1, 0, 0.5)
+
+        av.set_group_mixer(0, 0, 0)
+        self.assertRaises(ValueError, av.set_group_peer_gain, 0, 0, 1.0)
+        av.set_group_mixer(1, 0, 0)
+
+    def test_av_video_checks(self):
+        """
+        t:set_video_format
+        t:video_send_frame
+        """
+        av = ToxAV(self.alice)
+
+        self.assertRaises(ValueError, av.set_video_format, -1)
+        self.assertRaises(ValueError, av.set_video_format, 99)
+        av.set_video_format(ToxAV.VIDEO_FORMAT_I420)
+        av.set_video_format(ToxAV.VIDEO_FORMAT_RGB)
+        self.assertRaises(ValueError, av.set_video_format,
+                          ToxAV.VIDEO_FORMAT_RGB, borrow=True)
+        av.set_video_format(ToxAV.VIDEO_FORMAT_I420, borrow=True)
+        av.set_video_format(ToxAV.VIDEO_FORMAT_RGB)
+
+        # frames are checked before anything is sent
+        rgb = b'\0' * (4 * 2 * 3)
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2, rgb, 11)
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2, rgb, 16)
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2, rgb[:-1])
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2, rgb,
+                          format=ToxAV.VIDEO_FORMAT_BGR)
+
+        I420 = ToxAV.VIDEO_FORMAT_I420
+        y, u, v = b'\0' * 8, b'\0' * 2, b'\0' * 2
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2,
+                          (y, u, v[:-1]), format=I420)
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2,
+                          (y, u), format=I420)
+        self.assertRaises(ValueError, av.video_send_frame, 0, 4, 2,
+                          (y, u, v), (4, 1, 2), format=I420)
+        self.assertRaises(TypeError, av.video_send_frame, 0, 4, 2,
+                          (y, u, v), 4, format=I420)
+
+    def av_call(self, bob_av_type, audio_bit_rate, video_bit_rate):
+        """
+        t:call
+        t:answer
+        t:on_call
+        """
+        self.bob_add_alice_as_friend()
+
+        def on_call(self, friend_number, audio_enabled, video_enabled):
+            self.called = True
+
+        alice_av = ToxAV(self.alice)
+        bob_av = bob_av_type(self.bob)
+        bob_av.called = False
+        bob_av_type.on_call = on_call
+        self.avs = (alice_av, bob_av)
+
+        alice_av.call(self.bid, audio_bit_rate, video_bit_rate)
+        for i in range(200):
+            if bob_av.called:
+                break
+            self.loop_av(10)
+        assert bob_av.called
+        bob_av.answer(self.aid, audio_bit_rate, video_bit_rate)
+
+        return alice_av, bob_av
+
+    def loop_av(self, n):
+        for i in range(n):
+            self.loop(1)
+            for av in self.avs:
+                av.iterate()
+
+    def test_av_audio_send_format(self):
+        """
+        t:set_audio_send_format
+        t:audio_send_frame
+        t:on_audio_receive_frame
+        """
+        class BobAV(ToxAV):
+            def on_audio_receive_frame(self, friend_number, pcm, sample_count,
+                                       channels, sampling_rate):
+                self.received.append((sample_count, channels, sampling_rate))
+
+        alice_av, bob_av = self.av_call(BobAV, 48, 0)
+        bob_av.received = []
+
+        self.assertRaises(ValueError, alice_av.set_audio_send_format,
+                          44100, 2)
+        self.assertRaises(ValueError, alice_av.set_audio_send_format,
+                          48000, 3)
+
+        # 10 ms of 44.1 kHz stereo goes out as 10 ms of 24 kHz mono
+        pcm = b'\x00\x10' * (441 * 2)
+        alice_av.set_audio_send_format(24000, 1)
+        self.assertRaises(ValueError, alice_av.audio_send_frame, self.bid,
+                          pcm, 441, 3, 44100)
+        self.assertRaises(ValueError, alice_av.audio_send_frame, self.bid,
+                          pcm, 441, 2, 1000)
+        for i in range(400):
+            if len(bob_av.received) >= 5:
+                break
+            try:
+                alice_av.audio_send_frame(self.bid, pcm, 441, 2, 44100)
+            except OperationFailedError:
+                pass
+            self.loop_av(1)
+        assert len(bob_av.received) >= 5
+        assert bob_av.received[-1] == (240, 1, 24000)
+
+        # toxav itself only takes opus rates
+        alice_av.set_audio_send_format(0, 0)
+        self.assertRaises(OperationFailedError, alice_av.audio_send_frame,
+                          self.bid, pcm, 441, 2, 44100)
+
+        alice_av.call_control(self.bid, ToxAV.CALL_CONTROL_CANCEL)
+
+    def test_av_audio_frames(self):
+        """
+        t:set_audio_frames
+        """
+        av = ToxAV(self.alice)
+        bid = self.alice.friend_add_norequest(
+            self.bob.self_get_address()[:CLIENT_ID_SIZE])
+
+        av.set_audio_frames(True)
+        av.set_audio_receive_format(48000, 2)
+        av.set_audio_jitter_buffer(60)
+
+        frame = av.audio_read(bid, 480)
+        assert frame.sample_count == 480 and frame.channels == 2
+        assert frame.sampling_rate == 48000
+        assert frame.nbytes == 480 * 2 * 2 and not frame.released
+
+        view = memoryview(frame)
+        assert view.format == 'h' and view.itemsize == 2
+        assert view.shape == (480, 2) and view.strides == (4, 2)
+        assert view.tobytes() == b'\0' * (480 * 2 * 2)
+
+        # the buffer cannot go back to the pool while it is viewed
+        self.assertRaises(BufferError, frame.release)
+        del view
+        frame.release()
+        assert frame.released and frame.nbytes == 0
+        self.assertRaises(ValueError, memoryview, frame)
+        frame.release()
+
+        av.set_audio_frames(False)
+        assert av.audio_read(bid, 480) == b'\0' * (480 * 2 * 2)
+        av.set_audio_jitter_buffer(0)
+        av.set_audio_receive_format(0, 0)
+
+    def test_av_video_frames(self):
+        """
+        t:on_video_receive_frame
+        """
+        class BobAV(ToxAV):
+            def on_video_receive_frame(self, friend_number, width, height,
+                                       frame):
+                self.frames.append(frame)
+
+        alice_av, bob_av = self.av_call(BobAV, 0, 500)
+        bob_av.frames = []
+        bob_av.set_video_format(ToxAV.VIDEO_FORMAT_I420)
+
+        W, H = 16, 8
+        rgb = b'\x80' * (W * H * 3)
+        for i in range(400):
+            if bob_av.frames:
+                break
+            try:
+                alice_av.video_send_frame(self.bid, W, H, rgb)
+            except OperationFailedError:
+                pass
+            self.loop_av(5)
+        assert bob_av.frames
+
+        frame = bob_av.frames[0]
+        assert frame.format == ToxAV.VIDEO_FORMAT_I420
+        assert frame.width == W and frame.height == H
+        assert frame.nbytes == W * H * 3 // 2
+
+        view = memoryview(frame)
+        assert view.shape == (frame.nbytes,) and view.itemsize == 1
+        del view
+
+        planes = frame.planes()
+        assert [p.shape for p in planes] == [(H, W), (H // 2, W // 2),
+                                             (H // 2, W // 2)]
+        assert [p.strides for p in planes] == [(W, 1), (W // 2, 1),
+                                               (W // 2, 1)]
+        self.assertRaises(BufferError, frame.release)
+        del planes
+        frame.release()
+        assert frame.released
+
+        alice_av.call_control(self.bid, ToxAV.CALL_CONTROL_CANCEL)
+
+    def test_kill_from_callback(self):
+        """
+        t:kill
+        t:on_friend_message
+        t:on_call_state
+        """
+        # each would wait for the iterate() it is called from
+        def reenter(tox, av):
+            failed = []
+            for method in (tox.kill, tox.iterate, av.iterate):
+                try:
+                    method()
+                except OperationFailedError:
+                    failed.append(method.__name__)
+            return failed
+
+        class BobAV(ToxAV):
+            def on_call_state(self, friend_number, state):
+                self.failed = reenter(self.get_tox(), self)
+
+        alice_av, bob_av = self.av_call(BobAV, 48, 0)
+        bob_av.failed = []
+        alice_av.call_control(self.bid, ToxAV.CALL_CONTROL_CANCEL)
+        for i in range(200):
+            if bob_av.failed:
+                break
+            self.loop_av(10)
+        assert bob_av.failed == ['kill', 'iterate', 'iterate']
+
+        def on_friend_message(self, fid, msg_type, message):
+            self.failed = reenter(self, bob_av)
+
+        BobTox.on_friend_message = on_friend_message
+        self.bob.failed = []
+        self.ensure_exec(self.alice.friend_send_message,
+                         (self.bid, Tox.MESSAGE_TYPE_NORMAL, 'kill'))
+        assert self.wait_callback(self.bob, 'failed')
+        BobTox.on_friend_message = Tox.on_friend_message
+        assert self.bob.failed == ['kill', 'iterate', 'iterate']
+
+        # both are still alive for tearDown
+        self.loop_av(1)
+
 if __name__ == '__main__':
     methods = set([x for x in dir(Tox)
                   if not x[0].isupper() and not x[0] == '_'])
@@ -0,0 +1,622 @@
+/**
+ * @file   audio_bench.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Correctness check and benchmark of the native audio processing, run
+ * offline:
+ *
+ *   make audio-bench
+ *   ./audio_bench [seconds]
+ *
+ * Every rate pair is checked for seamless frame boundaries, exact output
+ * length, unity DC gain and the error of a resampled tone against the
+ * ideal one, then timed converting 20 ms frames. The jitter buffer is
+ * checked to play out a bursty stream unchanged, and to conceal and count
+ * gaps and overflows. Every mixer kernel the CPU supports is compared
+ * against the scalar one and timed mixing a 50 peer group. Exits non-zero
+ * on any failure. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio.h"
+#include "mixer.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static const uint32_t rate_pairs[][2] = {
+  {44100, 48000}, {48000, 44100}, {48000, 16000}, {16000, 48000},
+  {44100, 8000}, {22050, 48000}, {11025, 48000}, {96000, 8000},
+  {32000, 24000}, {44101, 48000},
+};
+
+#define RATE_PAIRS (sizeof(rate_pairs) / sizeof(rate_pairs[0]))
+
+static const char* kernel_names[] = {"scalar", "sse2", "avx2", "neon"};
+
+#define KERNEL_NAMES (sizeof(kernel_names) / sizeof(kernel_names[0]))
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void tone(int16_t* pcm, size_t frames, int channels, uint32_t rate,
+    double hz, double amplitude)
+{
+  size_t i;
+  int c;
+
+  for (i = 0; i < frames; i++) {
+    for (c = 0; c < channels; c++) {
+      /* channels a quarter period apart */
+      pcm[i * channels + c] = (int16_t)lrint(amplitude *
+          sin(2 * M_PI * hz * i / rate + c * M_PI / 2));
+    }
+  }
+}
+
+/* Resample *frames* frames in chunks of *chunk*, returning the frames
+ * written to *out*. */
+static size_t resample_chunks(audio_resampler* resampler, const int16_t* in,
+    size_t frames, size_t chunk, int channels, int16_t* out)
+{
+  size_t done = 0, written = 0;
+
+  while (done < frames) {
+    size_t n = frames - done < chunk ? frames - done : chunk;
+    long count = audio_resample(resampler, in + done * channels, n,
+        out + written * channels);
+    if (count < 0) {
+      return 0;
+    }
+    written += count;
+    done += n;
+  }
+
+  return written;
+}
+
+static int check_rates(uint32_t in_rate, uint32_t out_rate, int channels)
+{
+  size_t frames = in_rate;      /* one second */
+  size_t out_size = (size_t)out_rate + 64;
+  int16_t* in = (int16_t*)malloc(frames * channels * sizeof(int16_t));
+  int16_t* whole = (int16_t*)malloc(out_size * channels * sizeof(int16_t));
+  int16_t* chunked = (int16_t*)malloc(out_size * channels * sizeof(int16_t));
+  audio_resampler* a = audio_resampler_new(in_rate, out_rate, channels);
+  audio_resampler* b = audio_resampler_new(in_rate, out_rate, channels);
+  int ok = 1;
+  size_t i;
+
+  /* a tone well inside the passband of either rate */
+  double hz = (in_rate < out_rate ? in_rate : out_rate) / 11.0;
+  tone(in, frames, channels, in_rate, hz, 12000.0);
+
+  size_t n = resample_chunks(a, in, frames, frames, channels, whole);
+  size_t m = resample_chunks(b, in, frames, in_rate / 50 + 7, channels,
+      chunked);
+
+  if (n != m || memcmp(whole, chunked, n * channels * sizeof(int16_t))) {
+    printf("%u -> %u: chunked output differs\n", in_rate, out_rate);
+    ok = 0;
+  }
+
+  /* output stops at most half the taps short of the input */
+  double expected = (double)frames * out_rate / in_rate;
+  if (n > expected + 1 || n + AUDIO_RESAMPLER_TAPS * 12 < expected) {
+    printf("%u -> %u: %zu frames for %.1f\n", in_rate, out_rate, n, expected);
+    ok = 0;
+  }
+
+  /* output j samples the input at j * in_rate / out_rate, skipping the
+   * leading edge where the filter still sees silence */
+  double error = 0.0, signal = 0.0;
+  size_t skip = out_rate / 100;
+  int c;
+  for (i = skip; i < n; i++) {
+    for (c = 0; c < channels; c++) {
+      double ideal = 12000.0 * sin(2 * M_PI * hz * i / out_rate + c * M_PI / 2);
+      double diff = whole[i * channels + c] - ideal;
+      error += diff * diff;
+      signal += ideal * ideal;
+    }
+  }
+  double snr = 10 * log10(signal / (error > 0 ? error : 1e-9));
+  if (snr < 60.0) {
+    printf("%u -> %u: tone SNR %.1f dB\n", in_rate, out_rate, snr);
+    ok = 0;
+  }
+
+  /* DC comes out unchanged */
+  audio_resampler_reset(a);
+  for (i = 0; i < frames * channels; i++) {
+    in[i] = -1234;
+  }
+  n = resample_chunks(a, in, frames, 960, channels, whole);
+  for (i = skip * channels; i < n * channels; i++) {
+    if (whole[i] != -1234) {
+      printf("%u -> %u: DC %d at %zu\n", in_rate, out_rate, whole[i], i);
+      ok = 0;
+      break;
+    }
+  }
+
+  printf("%6u -> %6u %d ch  %-4s  tone SNR %.1f dB\n", in_rate, out_rate,
+      channels, ok ? "ok" : "FAIL", snr);
+
+  audio_resampler_free(a);
+  audio_resampler_free(b);
+  free(in);
+  free(whole);
+  free(chunked);
+
+  return ok;
+}
+
+static int check_remix(void)
+{
+  int16_t stereo[8] = {100, 200, -32768, -32768, 32767, 32767, -3, 4};
+  int16_t mono[4];
+  int16_t back[8];
+  int ok = 1;
+
+  audio_remix(stereo, 4, 2, mono, 1);
+  if (mono[0] != 150 || mono[1] != -32768 || mono[2] != 32767 ||
+      mono[3] != 0) {
+    printf("downmix: %d %d %d %d\n", mono[0], mono[1], mono[2], mono[3]);
+    ok = 0;
+  }
+
+  audio_remix(mono, 4, 1, back, 2);
+  if (back[0] != 150 || back[1] != 150 || back[6] != 0 || back[7] != 0) {
+    printf("upmix: %d %d %d %d\n", back[0], back[1], back[6], back[7]);
+    ok = 0;
+  }
+
+  /* in place */
+  memcpy(back, mono, sizeof(mono));
+  audio_remix(back, 4, 1, back, 2);
+  if (back[2] != -32768 || back[3] != -32768 || back[4] != 32767) {
+    printf("in place upmix: %d %d %d\n", back[2], back[3], back[4]);
+    ok = 0;
+  }
+
+  printf("remix                       %s\n", ok ? "ok" : "FAIL");
+
+  return ok;
+}
+
+/* 44.1 kHz stereo in 20 ms frames converted to 48 kHz mono, sent in whole
+ * 960 frame codec frames the way av.c does. */
+static int check_converter(void)
+{
+  audio_converter converter;
+  audio_fifo fifo;
+  int16_t pcm[882 * 2];
+  int ok = 1;
+  int i;
+
+  audio_converter_init(&converter);
+  audio_fifo_init(&fifo, 1);
+  tone(pcm, 882, 2, 44100, 441.0, 8000.0);
+
+  if (audio_converter_set(&converter, 44100, 2, 48000, 1) == -1) {
+    return 0;
+  }
+  audio_fifo_write(&fifo, NULL, 480);
+
+  for (i = 0; i < 500; i++) {
+    const int16_t* out = NULL;
+    long n = audio_convert(&converter, pcm, 882, &out);
+    if (n < 0 || audio_fifo_write(&fifo, out, n) == -1) {
+      ok = 0;
+      break;
+    }
+    if (fifo.frames < 960) {
+      printf("converter: short of a frame after %d frames\n", i);
+      ok = 0;
+      break;
+    }
+    audio_fifo_consume(&fifo, 960);
+  }
+
+  /* matching formats pass the input through */
+  const int16_t* out = NULL;
+  audio_converter_set(&converter, 48000, 2, 48000, 2);
+  if (audio_convert(&converter, pcm, 882, &out) != 882 || out != pcm) {
+    printf("converter: matching formats copied\n");
+    ok = 0;
+  }
+
+  printf("converter                   %s\n", ok ? "ok" : "FAIL");
+
+  audio_converter_free(&converter);
+  audio_fifo_free(&fifo);
+
+  return ok;
+}
+
+/* 48 kHz mono in 20 ms frames, numbered by sample, read 10 ms at a time. */
+static int check_jitter(void)
+{
+  audio_jitter jitter;
+  int16_t in[960];
+  int16_t out[480];
+  int16_t next = 0, expect = 0;
+  int ok = 1;
+  int i, j;
+
+  audio_jitter_init(&jitter);
+  if (audio_jitter_configure(&jitter, 1, 2880, 5760, 480) == -1) {
+    return 0;
+  }
+
+  /* nothing is played before 60 ms arrived, and silence is not counted as
+   * concealed before the first frame played */
+  audio_jitter_read(&jitter, out, 480);
+  if (out[0] != 0 || out[479] != 0 || jitter.concealed != 0) {
+    printf("jitter: prebuffering not silent\n");
+    ok = 0;
+  }
+
+  /* frames arrive in bursts of up to three but on average on time */
+  for (i = 0; i < 300 && ok; i++) {
+    int burst = i % 6 == 0 ? 3 : i % 6 < 3 ? 0 : 1;
+    for (j = 0; j < burst; j++) {
+      int k;
+      for (k = 0; k < 960; k++) {
+        in[k] = next++;
+      }
+      audio_jitter_write(&jitter, in, 960);
+    }
+    audio_jitter_read(&jitter, out, 480);
+    if (!jitter.playing && i < 3) {
+      continue;
+    }
+    for (j = 0; j < 480; j++) {
+      if (out[j] != expect++) {
+        printf("jitter: got %d for %d after %d reads\n", out[j], expect - 1, i);
+        ok = 0;
+        break;
+      }
+    }
+    audio_jitter_read(&jitter, out, 480);
+    for (j = 0; j < 480 && ok; j++) {
+      if (out[j] != expect++) {
+        printf("jitter: got %d for %d after %d reads\n", out[j], expect - 1, i);
+        ok = 0;
+      }
+    }
+  }
+  if (ok && (jitter.underruns != 0 || jitter.dropped != 0)) {
+    printf("jitter: %llu underruns, %llu dropped on a steady stream\n",
+        (unsigned long long)jitter.underruns,
+        (unsigned long long)jitter.dropped);
+    ok = 0;
+  }
+
+  /* running dry conceals the rest of the read, fading out */
+  while (jitter.fifo.frames >= 480) {
+    audio_jitter_read(&jitter, out, 480);
+  }
+  size_t left = jitter.fifo.frames;
+  audio_jitter_read(&jitter, out, 480);
+  if (jitter.underruns != 1 || jitter.concealed != 480 - left ||
+      abs(out[479]) >= abs(out[left])) {
+    printf("jitter: underrun not concealed\n");
+    ok = 0;
+  }
+  audio_jitter_read(&jitter, out, 480);
+  audio_jitter_read(&jitter, out, 480);
+  if (out[0] != 0 || out[479] != 0) {
+    printf("jitter: concealment did not fade out\n");
+    ok = 0;
+  }
+
+  /* a flood beyond max drops back to target */
+  for (i = 0; i < 10; i++) {
+    audio_jitter_write(&jitter, in, 960);
+  }
+  if (jitter.fifo.frames > 5760 || jitter.dropped == 0) {
+    printf("jitter: %zu frames buffered after a flood\n", jitter.fifo.frames);
+    ok = 0;
+  }
+
+  printf("jitter buffer               %s\n", ok ? "ok" : "FAIL");
+
+  audio_jitter_free(&jitter);
+
+  return ok;
+}
+
+static int check_gate(void)
+{
+  audio_gate gate;
+  audio_level level;
+  int16_t loud[960 * 2], quiet[960 * 2];
+  int sent[12];
+  int ok = 1;
+  int i;
+
+  for (i = 0; i < 960 * 2; i++) {
+    loud[i] = i % 2 ? 1000 : -1000;
+    quiet[i] = i % 2 ? 10 : -10;
+  }
+  loud[7] = -20000;
+
+  audio_measure(loud, 960 * 2, &level);
+  if (level.rms < 1090 || level.rms > 1110 || level.peak != 20000) {
+    printf("gate: measured rms %d peak %d\n", level.rms, level.peak);
+    ok = 0;
+  }
+
+  /* 20 ms frames at 48 kHz with 60 ms of hangover: leading silence is held
+   * back, the talk spurt and three quiet frames after it pass */
+  audio_gate_init(&gate);
+  audio_gate_configure(&gate, 100, 60);
+  for (i = 0; i < 12; i++) {
+    sent[i] = audio_gate_process(&gate, i >= 2 && i < 5 ? loud : quiet, 960, 2,
+        48000);
+  }
+  for (i = 0; i < 12; i++) {
+    if (sent[i] != (i >= 2 && i < 8)) {
+      printf("gate: frame %d %s\n", i, sent[i] ? "sent" : "held back");
+      ok = 0;
+    }
+  }
+  if (gate.passed != 6 * 960 || gate.suppressed != 6 * 960) {
+    printf("gate: counted %llu passed, %llu suppressed\n",
+        (unsigned long long)gate.passed, (unsigned long long)gate.suppressed);
+    ok = 0;
+  }
+
+  /* without a threshold it only meters */
+  audio_gate_configure(&gate, 0, 60);
+  if (!audio_gate_process(&gate, quiet, 960, 2, 48000) || gate.level.rms != 10) {
+    printf("gate: open gate held back a frame\n");
+    ok = 0;
+  }
+
+  printf("gate                        %s\n", ok ? "ok" : "FAIL");
+
+  return ok;
+}
+
+static void noise(int16_t* pcm, size_t count)
+{
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    /* full scale often enough to saturate */
+    pcm[i] = (int16_t)(rand() % 4 == 0 ? (rand() & 1 ? 32767 : -32768) :
+        (rand() & 0xffff) - 32768);
+  }
+}
+
+static int check_accumulate(void)
+{
+  static const int gains[] = {MIXER_UNITY_GAIN, 1, 2048, 4095, 12345,
+    MIXER_MAX_GAIN};
+  int16_t mix[203], in[203], expected[203];
+  int ok = 1;
+  size_t k, g;
+  int round;
+
+  for (k = 0; k < KERNEL_NAMES; k++) {
+    int kernel_ok = 1;
+
+    if (mixer_set_kernel(kernel_names[k]) == -1) {
+      continue;
+    }
+
+    for (round = 0; round < 50; round++) {
+      for (g = 0; g < sizeof(gains) / sizeof(gains[0]); g++) {
+        size_t count = 1 + rand() % 203;
+        noise(mix, count);
+        noise(in, count);
+        memcpy(expected, mix, count * sizeof(int16_t));
+
+        mixer_set_kernel("scalar");
+        mixer_accumulate(expected, in, count, gains[g]);
+        mixer_set_kernel(kernel_names[k]);
+        mixer_accumulate(mix, in, count, gains[g]);
+
+        if (memcmp(mix, expected, count * sizeof(int16_t))) {
+          kernel_ok = 0;
+        }
+      }
+    }
+
+    printf("mixer %-6s                %s\n", kernel_names[k],
+        kernel_ok ? "ok" : "FAIL");
+    ok &= kernel_ok;
+  }
+
+  return ok;
+}
+
+static void constant(int16_t* pcm, size_t frames, int16_t value)
+{
+  size_t i;
+
+  for (i = 0; i < frames; i++) {
+    pcm[i] = value;
+  }
+}
+
+static int check_group_mixer(void)
+{
+  group_mixer* mixer = group_mixer_new(48000, 1, 960);
+  int16_t pcm[960 * 2];
+  int ok = 1;
+
+  /* frames wait for peers with audio queued */
+  constant(pcm, 960, 1000);
+  group_mixer_write(mixer, 3, pcm, 960, 1, 48000);
+  constant(pcm, 960, 2000);
+  group_mixer_write(mixer, 7, pcm, 480, 1, 48000);
+  if (group_mixer_mix(mixer)) {
+    printf("group mixer: mixed while a peer was short\n");
+    ok = 0;
+  }
+  group_mixer_write(mixer, 7, pcm, 480, 1, 48000);
+  if (!group_mixer_mix(mixer) || mixer->mix[0] != 3000 ||
+      mixer->mix[959] != 3000 || mixer->mixed_peers != 2) {
+    printf("group mixer: %d, expected 3000\n", mixer->mix[0]);
+    ok = 0;
+  }
+
+  /* gain, saturation, and peers in other formats */
+  group_mixer_set_gain(mixer, 3, MIXER_UNITY_GAIN / 2);
+  constant(pcm, 960, 1000);
+  group_mixer_write(mixer, 3, pcm, 960, 1, 48000);
+  if (!group_mixer_mix(mixer) || mixer->mix[0] != 500) {
+    printf("group mixer: gain gave %d, expected 500\n", mixer->mix[0]);
+    ok = 0;
+  }
+  constant(pcm, 960 * 2, 30000);
+  group_mixer_write(mixer, 7, pcm, 960, 2, 48000);
+  group_mixer_write(mixer, 9, pcm, 960, 2, 48000);
+  if (!group_mixer_mix(mixer) || mixer->mix[0] != 32767) {
+    printf("group mixer: %d, expected saturation\n", mixer->mix[0]);
+    ok = 0;
+  }
+
+  /* a late peer is waited for two frames at most */
+  constant(pcm, 960, 100);
+  group_mixer_write(mixer, 3, pcm, 960, 1, 48000);
+  group_mixer_write(mixer, 7, pcm, 100, 1, 48000);
+  int mixed = group_mixer_mix(mixer);
+  group_mixer_write(mixer, 3, pcm, 960, 1, 48000);
+  if (mixed || !group_mixer_mix(mixer) || mixer->mix[0] != 150 ||
+      mixer->mix[100] != 50) {
+    printf("group mixer: late peer not mixed in\n");
+    ok = 0;
+  }
+
+  printf("group mixer                 %s\n", ok ? "ok" : "FAIL");
+
+  group_mixer_free(mixer);
+
+  return ok;
+}
+
+/* One 20 ms stereo 48 kHz frame of *peers* peers, half at unity gain. */
+static void bench_mixer(int peers, int seconds)
+{
+  size_t count = 960 * 2;
+  int16_t* in = (int16_t*)malloc(count * peers * sizeof(int16_t));
+  int16_t* mix = (int16_t*)malloc(count * sizeof(int16_t));
+  int frames = seconds * 50;
+  size_t k;
+  int i, p;
+
+  noise(in, count * peers);
+
+  for (k = 0; k < KERNEL_NAMES; k++) {
+    if (mixer_set_kernel(kernel_names[k]) == -1) {
+      continue;
+    }
+
+    double start = now();
+    for (i = 0; i < frames; i++) {
+      memset(mix, 0, count * sizeof(int16_t));
+      for (p = 0; p < peers; p++) {
+        mixer_accumulate(mix, in + count * p, count,
+            p & 1 ? MIXER_UNITY_GAIN : 3000);
+      }
+    }
+    double elapsed = now() - start;
+
+    printf("%-6s mix %d peers        %8.2f us/frame  %7.0fx realtime\n",
+        kernel_names[k], peers, elapsed * 1e6 / frames, seconds / elapsed);
+  }
+
+  free(in);
+  free(mix);
+}
+
+static void bench(uint32_t in_rate, uint32_t out_rate, int channels,
+    int seconds)
+{
+  size_t frame = in_rate / 50;
+  int16_t* in = (int16_t*)malloc(frame * channels * sizeof(int16_t));
+  int16_t* out = (int16_t*)malloc(((size_t)out_rate / 50 + 64) * channels *
+      sizeof(int16_t));
+  audio_resampler* resampler = audio_resampler_new(in_rate, out_rate,
+      channels);
+  int frames = seconds * 50;
+  int i;
+
+  tone(in, frame, channels, in_rate, 440.0, 8000.0);
+
+  double start = now();
+  for (i = 0; i < frames; i++) {
+    audio_resample(resampler, in, frame, out);
+  }
+  double elapsed = now() - start;
+
+  printf("%6u -> %6u %d ch  %8.2f us/frame  %7.0fx realtime\n", in_rate,
+      out_rate, channels, elapsed * 1e6 / frames, seconds / elapsed);
+
+  audio_resampler_free(resampler);
+  free(in);
+  free(out);
+}
+
+int main(int argc, char* argv[])
+{
+  int seconds = argc > 1 ? atoi(argv[1]) : 60;
+  int ok = 1;
+  size_t i;
+
+  for (i = 0; i < RATE_PAIRS; i++) {
+    ok &= check_rates(rate_pairs[i][0], rate_pairs[i][1], 1);
+    ok &= check_rates(rate_pairs[i][0], rate_pairs[i][1], 2);
+  }
+  ok &= check_remix();
+  ok &= check_converter();
+  ok &= check_jitter();
+  ok &= check_gate();
+  ok &= check_accumulate();
+  ok &= check_group_mixer();
+
+  if (!ok) {
+    return 1;
+  }
+
+  for (i = 0; i < RATE_PAIRS; i++) {
+    bench(rate_pairs[i][0], rate_pairs[i][1], 2, seconds);
+  }
+  bench_mixer(10, seconds);
+  bench_mixer(50, seconds);
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+# simple micro benchmarks for the native bindings, run offline:
+#
+#   python tools/benchmark.py friend_list [count]
+#   python tools/benchmark.py options [count]
+#   python tools/benchmark.py startup [count]
+
+import binascii
+import os
+import sys
+import timeit
+
+from pytox import Tox, Options
+
+
+class ToxOptions():
+    def __init__(self):
+        self.ipv6_enabled = True
+        self.udp_enabled = True
+        self.proxy_type = 0
+        self.proxy_host = ''
+        self.proxy_port = 0
+        self.start_port = 0
+        self.end_port = 0
+        self.tcp_port = 0
+        self.savedata_type = 0
+        self.savedata_data = b''
+        self.savedata_length = 0
+
+
+def random_address():
+    return binascii.hexlify(os.urandom(38)).decode('ascii').upper()
+
+
+def report(name, number, seconds):
+    print("%-36s %10.3f us/call" % (name, seconds * 1e6 / number))
+
+
+def bench_friend_list(count=10000):
+    tox = Tox(ToxOptions())
+    for i in range(count):
+        tox.friend_add_norequest(random_address())
+
+    number = 100
+    report("self_get_friend_list() [%d]" % count, number,
+           timeit.timeit(tox.self_get_friend_list, number=number))
+    report("self_get_friend_list(as_array=True) [%d]" % count, number,
+           timeit.timeit(lambda: tox.self_get_friend_list(as_array=True),
+                         number=number))
+    tox.kill()
+
+
+def bench_options(count=100):
+    template = Options()
+    number = 10000
+    report("Options.copy()", number,
+           timeit.timeit(template.copy, number=number))
+
+    def create(make_options):
+        instances = [Tox(make_options()) for i in range(count)]
+        for tox in instances:
+            tox.kill()
+
+    report("Tox(ToxOptions()) [%d]" % count, count,
+           timeit.timeit(lambda: create(ToxOptions), number=1))
+    report("Tox(Options.copy()) [%d]" % count, count,
+           timeit.timeit(lambda: create(template.copy), number=1))
+
+
+def bench_startup(count=1000):
+    opts = Options(local_discovery_enabled=False)
+
+    # killed as they go, since only 101 ports are free for UDP by default
+    def create():
+        for i in range(count):
+            Tox(opts).kill()
+
+    report("Tox(opts) [%d]" % count, count, timeit.timeit(create, number=1))
+
+
+BENCHMARKS = {
+    'friend_list': bench_friend_list,
+    'options': bench_options,
+    'startup': bench_startup,
+}
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2 or sys.argv[1] not in BENCHMARKS:
+        print("usage: %s <%s> [args...]" % (sys.argv[0],
+                                            "|".join(sorted(BENCHMARKS))))
+        sys.exit(1)
+
+    BENCHMARKS[sys.argv[1]](*[int(x) for x in sys.argv[2:]])
@@ -0,0 +1,740 @@
+/**
+ * @file   convert_bench.c
+ * @author Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ *
+ * Copyright (C) 2013 - 2014  Wei-Ning Huang (AZ) <aitjcize@gmail.com>
+ * All Rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/* Correctness check and benchmark of the native pixel conversion kernels,
+ * run offline:
+ *
+ *   make convert-bench
+ *   ./convert_bench [frames]
+ *
+ * Every kernel the CPU supports is compared byte for byte against a direct
+ * per pixel reference, over odd and even sizes and padded strides, on the
+ * calling thread and split over a pool, before being timed. Exits non-zero
+ * on any mismatch. The RGB to I420 timings include the single pixel chroma
+ * conversion av.c used before, as a baseline, and the default kernel is
+ * timed with 1 to 8 threads at 1080p. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "convert.h"
+
+static const char* kernel_names[] = {"scalar", "sse2", "ssse3", "avx2",
+  "neon"};
+
+#define KERNEL_NAMES (sizeof(kernel_names) / sizeof(kernel_names[0]))
+
+typedef struct {
+  int width, height;
+  int ystride, ustride, vstride;
+  uint8_t *y, *u, *v;
+} i420_image;
+
+static void fill(uint8_t* data, size_t length)
+{
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    data[i] = rand() & 0xff;
+  }
+}
+
+static void image_new(i420_image* image, int width, int height, int padding)
+{
+  image->width = width;
+  image->height = height;
+  image->ystride = width + padding;
+  image->ustride = (width + 1) / 2 + padding;
+  image->vstride = (width + 1) / 2 + padding;
+  image->y = (uint8_t*)malloc((size_t)image->ystride * height);
+  image->u = (uint8_t*)malloc((size_t)image->ustride * ((height + 1) / 2));
+  image->v = (uint8_t*)malloc((size_t)image->vstride * ((height + 1) / 2));
+  fill(image->y, (size_t)image->ystride * height);
+  fill(image->u, (size_t)image->ustride * ((height + 1) / 2));
+  fill(image->v, (size_t)image->vstride * ((height + 1) / 2));
+}
+
+static void image_free(i420_image* image)
+{
+  free(image->y);
+  free(image->u);
+  free(image->v);
+}
+
+static uint8_t clamp(int value)
+{
+  return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static const char* format_names[] = {"i420", "nv12", "rgb", "bgr", "rgba"};
+
+/* The conversion toxav clients always did, one pixel at a time. */
+static void reference_i420_to_packed(const i420_image* image,
+    convert_format format, uint8_t* out, int stride)
+{
+  int bytes_per_pixel = format == CONVERT_FORMAT_RGBA ? 4 : 3;
+  int first = format == CONVERT_FORMAT_BGR ? 2 : 0;
+  int x, row;
+
+  for (row = 0; row < image->height; row++) {
+    for (x = 0; x < image->width; x++) {
+      int Y = image->y[row * image->ystride + x];
+      int U = image->u[row / 2 * image->ustride + x / 2];
+      int V = image->v[row / 2 * image->vstride + x / 2];
+      uint8_t* pixel = out + row * stride + bytes_per_pixel * x;
+
+      pixel[first] = clamp(Y + (351 * (V - 128)) / 256);
+      pixel[1] = clamp(Y - (179 * (V - 128)) / 256 - (86 * (U - 128)) / 256);
+      pixel[2 - first] = clamp(Y + (444 * (U - 128)) / 256);
+      if (bytes_per_pixel == 4) {
+        pixel[3] = 0xff;
+      }
+    }
+  }
+}
+
+static int check_i420_to_packed(pool_t* pool, const char* kernel,
+    convert_format format, int width, int height, int padding)
+{
+  i420_image image;
+  int stride = (format == CONVERT_FORMAT_RGBA ? 4 : 3) * width + padding;
+  size_t size = (size_t)stride * height;
+  uint8_t* expected = (uint8_t*)malloc(size);
+  uint8_t* actual = (uint8_t*)malloc(size);
+  int failed = 0;
+
+  image_new(&image, width, height, padding);
+
+  /* padding must come out untouched */
+  memset(expected, 0xa5, size);
+  memset(actual, 0xa5, size);
+  reference_i420_to_packed(&image, format, expected, stride);
+  convert_i420_to_packed(pool, format, width, height, image.y, image.u,
+      image.v, image.ystride, image.ustride, image.vstride, actual, stride);
+
+  if (memcmp(expected, actual, size) != 0) {
+    printf("FAIL %s i420_to_%s %dx%d padding %d\n", kernel,
+        format_names[format], width, height, padding);
+    failed = 1;
+  }
+
+  image_free(&image);
+  free(expected);
+  free(actual);
+
+  return failed;
+}
+
+static int check_i420_to_nv12(pool_t* pool, const char* kernel, int width,
+    int height, int padding)
+{
+  i420_image image;
+  int chroma_width = (width + 1) / 2;
+  int chroma_height = (height + 1) / 2;
+  int ystride = width + padding;
+  int uvstride = 2 * chroma_width + padding;
+  size_t size = (size_t)ystride * height + (size_t)uvstride * chroma_height;
+  uint8_t* expected = (uint8_t*)malloc(size);
+  uint8_t* actual = (uint8_t*)malloc(size);
+  int failed = 0, x, row;
+
+  image_new(&image, width, height, padding);
+
+  memset(expected, 0xa5, size);
+  memset(actual, 0xa5, size);
+  for (row = 0; row < height; row++) {
+    memcpy(expected + row * ystride, image.y + row * image.ystride, width);
+  }
+  uint8_t* uv = expected + (size_t)ystride * height;
+  for (row = 0; row < chroma_height; row++) {
+    for (x = 0; x < chroma_width; x++) {
+      uv[row * uvstride + 2 * x] = image.u[row * image.ustride + x];
+      uv[row * uvstride + 2 * x + 1] = image.v[row * image.vstride + x];
+    }
+  }
+
+  convert_i420_to_nv12(pool, width, height, image.y, image.u, image.v,
+      image.ystride, image.ustride, image.vstride, actual, ystride,
+      actual + (size_t)ystride * height, uvstride);
+
+  if (memcmp(expected, actual, size) != 0) {
+    printf("FAIL %s i420_to_nv12 %dx%d padding %d\n", kernel, width, height,
+        padding);
+    failed = 1;
+  }
+
+  image_free(&image);
+  free(expected);
+  free(actual);
+
+  return failed;
+}
+
+static int compare_planes(const i420_image* a, const i420_image* b)
+{
+  size_t chroma_rows = (a->height + 1) / 2;
+
+  return memcmp(a->y, b->y, (size_t)a->ystride * a->height) != 0 ||
+    memcmp(a->u, b->u, (size_t)a->ustride * chroma_rows) != 0 ||
+    memcmp(a->v, b->v, (size_t)a->vstride * chroma_rows) != 0;
+}
+
+/* NV12 and back must give the same planes. */
+static int check_nv12_to_i420(const char* kernel, int width, int height,
+    int padding)
+{
+  i420_image image, back;
+  int chroma_height = (height + 1) / 2;
+  int uvstride = 2 * ((width + 1) / 2) + padding;
+  uint8_t* uv = (uint8_t*)malloc((size_t)uvstride * chroma_height);
+  int failed = 0;
+
+  image_new(&image, width, height, padding);
+  image_new(&back, width, height, padding);
+  memcpy(back.y, image.y, (size_t)image.ystride * height);
+  memcpy(back.u, image.u, (size_t)image.ustride * chroma_height);
+  memcpy(back.v, image.v, (size_t)image.vstride * chroma_height);
+  memset(back.u, 0, (size_t)((width + 1) / 2));
+  memset(back.v, 0, (size_t)((width + 1) / 2));
+
+  convert_i420_to_nv12(NULL, width, height, image.y, image.u, image.v,
+      image.ystride, image.ustride, image.vstride, back.y, back.ystride, uv,
+      uvstride);
+  convert_nv12_to_i420(width, height, back.y, back.ystride, uv, uvstride,
+      NULL, 0, back.u, back.ustride, back.v, back.vstride);
+
+  if (compare_planes(&image, &back) != 0) {
+    printf("FAIL %s nv12_to_i420 %dx%d padding %d\n", kernel, width, height,
+        padding);
+    failed = 1;
+  }
+
+  image_free(&image);
+  image_free(&back);
+  free(uv);
+
+  return failed;
+}
+
+static const int16_t coefficients[][9] = {
+  {66, 129, 25, -38, -74, 112, 112, -94, -18},
+  {47, 157, 16, -26, -87, 112, 112, -102, -10},
+};
+
+/* Straight from the definition, odd edges averaging with themselves. */
+static void reference_rgb_to_i420(int width, int height, const uint8_t* rgb,
+    int rgb_stride, i420_image* image, convert_matrix matrix)
+{
+  const int16_t* c = coefficients[matrix];
+  int x, row, i;
+
+  for (row = 0; row < height; row++) {
+    for (x = 0; x < width; x++) {
+      const uint8_t* p = rgb + row * rgb_stride + 3 * x;
+      image->y[row * image->ystride + x] =
+        ((c[0] * p[0] + c[1] * p[1] + c[2] * p[2] + 128) >> 8) + 16;
+    }
+  }
+
+  for (row = 0; row < height; row += 2) {
+    for (x = 0; x < width; x += 2) {
+      int sum[3] = {0, 0, 0};
+      int dx, dy;
+
+      for (dy = 0; dy < 2; dy++) {
+        for (dx = 0; dx < 2; dx++) {
+          int px = x + dx < width ? x + dx : x;
+          int py = row + dy < height ? row + dy : row;
+          for (i = 0; i < 3; i++) {
+            sum[i] += rgb[py * rgb_stride + 3 * px + i];
+          }
+        }
+      }
+
+      int r = (sum[0] + 2) >> 2;
+      int g = (sum[1] + 2) >> 2;
+      int b = (sum[2] + 2) >> 2;
+      image->u[row / 2 * image->ustride + x / 2] =
+        ((c[3] * r + c[4] * g + c[5] * b + 128) >> 8) + 128;
+      image->v[row / 2 * image->vstride + x / 2] =
+        ((c[6] * r + c[7] * g + c[8] * b + 128) >> 8) + 128;
+    }
+  }
+}
+
+static int check_rgb_to_i420(pool_t* pool, const char* kernel, int width,
+    int height, int padding, convert_matrix matrix)
+{
+  i420_image expected, actual;
+  int rgb_stride = 3 * width + padding;
+  uint8_t* rgb = (uint8_t*)malloc((size_t)rgb_stride * height);
+  int failed = 0;
+
+  fill(rgb, (size_t)rgb_stride * height);
+  image_new(&expected, width, height, padding);
+  image_new(&actual, width, height, padding);
+
+  /* padding must come out untouched */
+  memcpy(actual.y, expected.y, (size_t)expected.ystride * height);
+  memcpy(actual.u, expected.u, (size_t)expected.ustride * ((height + 1) / 2));
+  memcpy(actual.v, expected.v, (size_t)expected.vstride * ((height + 1) / 2));
+
+  reference_rgb_to_i420(width, height, rgb, rgb_stride, &expected, matrix);
+  convert_rgb_to_i420(pool, width, height, rgb, rgb_stride, actual.y,
+      actual.u, actual.v, actual.ystride, actual.ustride, actual.vstride,
+      matrix);
+
+  if (compare_planes(&expected, &actual) != 0) {
+    printf("FAIL %s rgb_to_i420 %dx%d padding %d matrix %d\n", kernel, width,
+        height, padding, matrix);
+    failed = 1;
+  }
+
+  image_free(&expected);
+  image_free(&actual);
+  free(rgb);
+
+  return failed;
+}
+
+/* Scaling a flat image keeps it flat, whatever the filter. */
+static int check_scale_flat(pool_t* pool, const char* kernel, int channels,
+    int src_width, int src_height, int dst_width, int dst_height)
+{
+  size_t src_size = (size_t)src_width * src_height * channels;
+  size_t dst_size = (size_t)dst_width * dst_height * channels;
+  uint8_t* src = (uint8_t*)malloc(src_size);
+  uint8_t* dst = (uint8_t*)malloc(dst_size);
+  convert_scaler* scaler = convert_scaler_new();
+  size_t i;
+  int failed = 0;
+
+  memset(src, 0xa7, src_size);
+  if (convert_scale_plane(pool, scaler, channels, src_width, src_height, src,
+        src_width * channels, dst_width, dst_height, dst,
+        dst_width * channels) != 0) {
+    failed = 1;
+  }
+  for (i = 0; i < dst_size && !failed; i++) {
+    failed = dst[i] != 0xa7;
+  }
+
+  if (failed) {
+    printf("FAIL %s scale flat %dx%d -> %dx%d channels %d\n", kernel,
+        src_width, src_height, dst_width, dst_height, channels);
+  }
+
+  convert_scaler_free(scaler);
+  free(src);
+  free(dst);
+
+  return failed;
+}
+
+/* Halving averages each pair of rows, then each pair of columns. */
+static int check_scale_half(pool_t* pool, const char* kernel, int width,
+    int height, int padding)
+{
+  int src_stride = 2 * width * 3 + padding;
+  uint8_t* src = (uint8_t*)malloc((size_t)src_stride * 2 * height);
+  uint8_t* dst = (uint8_t*)malloc((size_t)width * height * 3);
+  convert_scaler* scaler = convert_scaler_new();
+  int x, row, c, failed = 0;
+
+  fill(src, (size_t)src_stride * 2 * height);
+  convert_scale_plane(pool, scaler, 3, 2 * width, 2 * height, src,
+      src_stride, width, height, dst, width * 3);
+
+  for (row = 0; row < height && !failed; row++) {
+    for (x = 0; x < width * 3 && !failed; x++) {
+      const uint8_t* p = src + 2 * row * src_stride + x % 3 + x / 3 * 6;
+      int left = (p[0] + p[src_stride] + 1) >> 1;
+      int right = (p[3] + p[src_stride + 3] + 1) >> 1;
+      c = (left + right + 1) >> 1;
+      failed = dst[row * width * 3 + x] != c;
+    }
+  }
+
+  if (failed) {
+    printf("FAIL %s scale half %dx%d padding %d\n", kernel, width, height,
+        padding);
+  }
+
+  convert_scaler_free(scaler);
+  free(src);
+  free(dst);
+
+  return failed;
+}
+
+/* Scaling and converting in one call matches doing one after the other,
+ * and the SIMD filters match the scalar ones. */
+static int check_scale_rgb_to_i420(pool_t* pool, const char* kernel,
+    int src_width, int src_height, int width, int height, int padding)
+{
+  i420_image expected, actual;
+  int rgb_stride = 3 * src_width + padding;
+  uint8_t* rgb = (uint8_t*)malloc((size_t)rgb_stride * src_height);
+  uint8_t* scaled = (uint8_t*)malloc((size_t)width * height * 3);
+  uint8_t* reference = (uint8_t*)malloc((size_t)width * height * 3);
+  convert_scaler* scaler = convert_scaler_new();
+  int failed = 0;
+
+  fill(rgb, (size_t)rgb_stride * src_height);
+  image_new(&expected, width, height, padding);
+  image_new(&actual, width, height, padding);
+  memcpy(actual.y, expected.y, (size_t)expected.ystride * height);
+  memcpy(actual.u, expected.u, (size_t)expected.ustride * ((height + 1) / 2));
+  memcpy(actual.v, expected.v, (size_t)expected.vstride * ((height + 1) / 2));
+
+  convert_set_kernel("scalar");
+  convert_scale_plane(NULL, scaler, 3, src_width, src_height, rgb,
+      rgb_stride, width, height, reference, width * 3);
+  convert_set_kernel(kernel);
+
+  convert_scale_plane(pool, scaler, 3, src_width, src_height, rgb,
+      rgb_stride, width, height, scaled, width * 3);
+  convert_rgb_to_i420(NULL, width, height, scaled, width * 3, expected.y,
+      expected.u, expected.v, expected.ystride, expected.ustride,
+      expected.vstride, CONVERT_BT601);
+  if (convert_scale_rgb_to_i420(pool, scaler, src_width, src_height, rgb,
+        rgb_stride, width, height, actual.y, actual.u, actual.v,
+        actual.ystride, actual.ustride, actual.vstride, CONVERT_BT601) != 0 ||
+      memcmp(scaled, reference, (size_t)width * height * 3) != 0 ||
+      compare_planes(&expected, &actual) != 0) {
+    printf("FAIL %s scale_rgb_to_i420 %dx%d -> %dx%d padding %d\n", kernel,
+        src_width, src_height, width, height, padding);
+    failed = 1;
+  }
+
+  convert_scaler_free(scaler);
+  image_free(&expected);
+  image_free(&actual);
+  free(rgb);
+  free(scaled);
+  free(reference);
+
+  return failed;
+}
+
+/* The SIMD resampling across rows matches the scalar one for any number of
+ * channels, right up to the end of an unpadded image. */
+static int check_scale_channels(pool_t* pool, const char* kernel,
+    int channels, int src_width, int src_height, int width, int height)
+{
+  size_t src_size = (size_t)src_width * src_height * channels;
+  size_t size = (size_t)width * height * channels;
+  uint8_t* src = (uint8_t*)malloc(src_size);
+  uint8_t* expected = (uint8_t*)malloc(size);
+  uint8_t* actual = (uint8_t*)malloc(size);
+  convert_scaler* scaler = convert_scaler_new();
+  int failed = 0;
+
+  fill(src, src_size);
+  convert_set_kernel("scalar");
+  convert_scale_plane(NULL, scaler, channels, src_width, src_height, src,
+      src_width * channels, width, height, expected, width * channels);
+  convert_set_kernel(kernel);
+  convert_scale_plane(pool, scaler, channels, src_width, src_height, src,
+      src_width * channels, width, height, actual, width * channels);
+
+  if (memcmp(expected, actual, size) != 0) {
+    printf("FAIL %s scale %dx%d -> %dx%d channels %d\n", kernel, src_width,
+        src_height, width, height, channels);
+    failed = 1;
+  }
+
+  convert_scaler_free(scaler);
+  free(src);
+  free(expected);
+  free(actual);
+
+  return failed;
+}
+
+static int check_scale(pool_t* pool, const char* kernel)
+{
+  static const int sizes[][4] = {
+    {1, 1, 3, 2}, {5, 5, 9, 9}, {16, 3, 1, 1}, {33, 17, 33, 9},
+    {33, 17, 20, 17}, {100, 48, 7, 3}, {64, 64, 32, 32}, {320, 240, 20, 15},
+    {1279, 721, 640, 360}, {1920, 1080, 1280, 720}, {1921, 1081, 427, 240}
+  };
+  size_t i;
+  int padding, channels, failed = 0;
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (channels = 1; channels <= 3; channels++) {
+      failed |= check_scale_flat(pool, kernel, channels, sizes[i][0],
+          sizes[i][1], sizes[i][2], sizes[i][3]);
+    }
+    for (channels = 1; channels <= 4; channels++) {
+      failed |= check_scale_channels(pool, kernel, channels, sizes[i][0],
+          sizes[i][1], sizes[i][2], sizes[i][3]);
+    }
+    for (padding = 0; padding < 40; padding += 13) {
+      failed |= check_scale_rgb_to_i420(pool, kernel, sizes[i][0],
+          sizes[i][1], sizes[i][2], sizes[i][3], padding);
+    }
+  }
+
+  for (padding = 0; padding < 40; padding += 13) {
+    failed |= check_scale_half(pool, kernel, 1, 1, padding);
+    failed |= check_scale_half(pool, kernel, 37, 21, padding);
+    failed |= check_scale_half(pool, kernel, 960, 540, padding);
+  }
+
+  /* beyond CONVERT_SCALE_MAX_RATIO */
+  convert_scaler* scaler = convert_scaler_new();
+  uint8_t pixels[17 * 3];
+  if (convert_scale_plane(NULL, scaler, 3, 17, 1, pixels, 17 * 3, 1, 1,
+        pixels, 3) != -1) {
+    printf("FAIL %s scale accepted a ratio of 17\n", kernel);
+    failed = 1;
+  }
+  convert_scaler_free(scaler);
+
+  return failed;
+}
+
+static int check(pool_t* pool, const char* kernel)
+{
+  static const int sizes[][2] = {
+    {1, 1}, {2, 2}, {3, 3}, {1, 7}, {15, 2}, {16, 16}, {17, 17}, {31, 5},
+    {33, 9}, {47, 3}, {64, 64}, {65, 33}, {176, 144}, {1025, 3},
+    {2049, 5}, {1279, 721}, {1921, 1081}
+  };
+  size_t i;
+  int padding, failed = 0;
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (padding = 0; padding < 40; padding += 13) {
+      failed |= check_i420_to_packed(pool, kernel, CONVERT_FORMAT_RGB,
+          sizes[i][0], sizes[i][1], padding);
+      failed |= check_i420_to_packed(pool, kernel, CONVERT_FORMAT_BGR,
+          sizes[i][0], sizes[i][1], padding);
+      failed |= check_i420_to_packed(pool, kernel, CONVERT_FORMAT_RGBA,
+          sizes[i][0], sizes[i][1], padding);
+      failed |= check_i420_to_nv12(pool, kernel, sizes[i][0], sizes[i][1],
+          padding);
+      failed |= check_nv12_to_i420(kernel, sizes[i][0], sizes[i][1],
+          padding);
+      failed |= check_rgb_to_i420(pool, kernel, sizes[i][0], sizes[i][1],
+          padding, CONVERT_BT601);
+      failed |= check_rgb_to_i420(pool, kernel, sizes[i][0], sizes[i][1],
+          padding, CONVERT_BT709);
+    }
+  }
+
+  return failed | check_scale(pool, kernel);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_i420_to_rgb(pool_t* pool, const char* kernel, int width,
+    int height, int frames)
+{
+  i420_image image;
+  uint8_t* rgb = (uint8_t*)malloc((size_t)width * height * 3);
+  int i;
+
+  image_new(&image, width, height, 0);
+
+  double start = now();
+  for (i = 0; i < frames; i++) {
+    convert_i420_to_packed(pool, CONVERT_FORMAT_RGB, width, height, image.y,
+        image.u, image.v, image.ystride, image.ustride, image.vstride, rgb,
+        3 * width);
+  }
+  double seconds = now() - start;
+
+  printf("%-8s i420_to_rgb %4dx%-4d %d thread(s) %8.3f ms/frame "
+      "%7.1f Mpixel/s\n", kernel, width, height,
+      pool ? pool_size(pool) + 1 : 1, seconds * 1e3 / frames,
+      (double)width * height * frames / seconds / 1e6);
+
+  image_free(&image);
+  free(rgb);
+}
+
+/* What av.c did before: even sizes only, chroma from one pixel. */
+static void legacy_rgb_to_i420(int width, int height, const uint8_t* rgb,
+    uint8_t* y, uint8_t* u, uint8_t* v)
+{
+  int upos = 0, vpos = 0, i = 0, x, line;
+
+  for (line = 0; line < height; ++line) {
+    if (!(line % 2)) {
+      for (x = 0; x < width; x += 2) {
+        uint8_t r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        y[i++] = ((66 * r + 129 * g + 25 * b) >> 8) + 16;
+        u[upos++] = ((-38 * r + -74 * g + 112 * b) >> 8) + 128;
+        v[vpos++] = ((112 * r + -94 * g + -18 * b) >> 8) + 128;
+        r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        y[i++] = ((66 * r + 129 * g + 25 * b) >> 8) + 16;
+      }
+    } else {
+      for (x = 0; x < width; x += 1) {
+        uint8_t r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        y[i++] = ((66 * r + 129 * g + 25 * b) >> 8) + 16;
+      }
+    }
+  }
+}
+
+static void bench_rgb_to_i420(pool_t* pool, const char* kernel, int width,
+    int height, int frames)
+{
+  i420_image image;
+  uint8_t* rgb = (uint8_t*)malloc((size_t)width * height * 3);
+  int i;
+
+  fill(rgb, (size_t)width * height * 3);
+  image_new(&image, width, height, 0);
+
+  double start = now();
+  for (i = 0; i < frames; i++) {
+    if (kernel == NULL) {
+      legacy_rgb_to_i420(width, height, rgb, image.y, image.u, image.v);
+    } else {
+      convert_rgb_to_i420(pool, width, height, rgb, 3 * width, image.y,
+          image.u, image.v, image.ystride, image.ustride, image.vstride,
+          CONVERT_BT601);
+    }
+  }
+  double seconds = now() - start;
+
+  printf("%-8s rgb_to_i420 %4dx%-4d %d thread(s) %8.3f ms/frame "
+      "%7.1f Mpixel/s\n", kernel ? kernel : "legacy", width, height,
+      pool ? pool_size(pool) + 1 : 1, seconds * 1e3 / frames,
+      (double)width * height * frames / seconds / 1e6);
+
+  image_free(&image);
+  free(rgb);
+}
+
+/* Shrinking from capture size, the scaling alone and followed by the
+ * conversion. */
+static void bench_scale_rgb_to_i420(pool_t* pool, const char* kernel,
+    int src_width, int src_height, int width, int height, int frames)
+{
+  i420_image image;
+  uint8_t* rgb = (uint8_t*)malloc((size_t)src_width * src_height * 3);
+  uint8_t* scaled = (uint8_t*)malloc((size_t)width * height * 3);
+  convert_scaler* scaler = convert_scaler_new();
+  int convert, i;
+
+  fill(rgb, (size_t)src_width * src_height * 3);
+  image_new(&image, width, height, 0);
+
+  for (convert = 0; convert <= 1; convert++) {
+    double start = now();
+    for (i = 0; i < frames; i++) {
+      if (convert) {
+        convert_scale_rgb_to_i420(pool, scaler, src_width, src_height, rgb,
+            3 * src_width, width, height, image.y, image.u, image.v,
+            image.ystride, image.ustride, image.vstride, CONVERT_BT601);
+      } else {
+        convert_scale_plane(pool, scaler, 3, src_width, src_height, rgb,
+            3 * src_width, width, height, scaled, 3 * width);
+      }
+    }
+    double seconds = now() - start;
+
+    printf("%-8s %-17s %4dx%-4d -> %4dx%-4d %d thread(s) %8.3f ms/frame\n",
+        kernel, convert ? "scale_rgb_to_i420" : "scale_rgb", src_width,
+        src_height, width, height, pool ? pool_size(pool) + 1 : 1,
+        seconds * 1e3 / frames);
+  }
+
+  convert_scaler_free(scaler);
+  image_free(&image);
+  free(rgb);
+  free(scaled);
+}
+
+int main(int argc, char* argv[])
+{
+  static const int resolutions[][2] = {{640, 480}, {1280, 720}, {1920, 1080}};
+  int frames = argc > 1 ? atoi(argv[1]) : 200;
+  int failed = 0;
+  size_t k, i;
+  int threads;
+
+  /* bands of odd heights, checked with every kernel */
+  pool_t* pool = pool_new(3);
+
+  const char* best = convert_kernel();
+  printf("default kernel: %s\n", best);
+
+  for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+    bench_rgb_to_i420(NULL, NULL, resolutions[i][0], resolutions[i][1],
+        frames);
+  }
+
+  for (k = 0; k < KERNEL_NAMES; k++) {
+    const char* kernel = kernel_names[k];
+    if (convert_set_kernel(kernel) != 0) {
+      continue;
+    }
+
+    if (check(NULL, kernel) != 0 || check(pool, kernel) != 0) {
+      failed = 1;
+      continue;
+    }
+    printf("%-8s ok\n", kernel);
+
+    for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+      bench_i420_to_rgb(NULL, kernel, resolutions[i][0], resolutions[i][1],
+          frames);
+    }
+    for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+      bench_rgb_to_i420(NULL, kernel, resolutions[i][0], resolutions[i][1],
+          frames);
+    }
+    bench_scale_rgb_to_i420(NULL, kernel, 1920, 1080, 1280, 720, frames);
+    bench_scale_rgb_to_i420(NULL, kernel, 1920, 1080, 640, 360, frames);
+  }
+
+  pool_free(pool);
+
+  /* scaling of the default kernel over row bands */
+  convert_set_kernel(best);
+  for (threads = 1; threads <= 8; threads *= 2) {
+    pool = pool_new(threads - 1);
+    bench_i420_to_rgb(pool, convert_kernel(), 1920, 1080, frames);
+    bench_rgb_to_i420(pool, convert_kernel(), 1920, 1080, frames);
+    bench_scale_rgb_to_i420(pool, convert_kernel(), 1920, 1080, 640, 360,
+        frames);
+    pool_free(pool);
+  }
+
+  return failed;
+}